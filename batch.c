@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "types.h"
+#include "riscv.h"
+#include "emulator.h"
+#include "trace.h"
+#include "batch.h"
+
+#define BATCH_TIMEOUT 60         // seconds, as the driver allows
+#define TIMEOUT_STATUS 124       // what timeout(1) exits with
+#define CLOCK_INTERVAL 0x10000   // steps between clock checks
+#define BATCH_MAX_THREADS 64
+#define PROFILE_SPOTS 20         // hot spots a -p report lists
+
+typedef struct {
+    BatchJob *jobs;
+    int count;
+    int next;       // first job no worker has taken
+    Engine engine;
+    pthread_mutex_t lock;
+} BatchQueue;
+
+/* Parses one manifest line into job. Returns 1 for a job, 0 for a blank or
+ * comment line and -1 if the line is malformed. */
+static int parse_job(char *line, BatchJob *job)
+{
+    char *token, *save;
+
+    memset(job, 0, sizeof(BatchJob));
+    token = strtok_r(line, " \t\r\n", &save);
+    if (!token || token[0] == '#')
+    {
+        return 0;
+    }
+    job->timeout = BATCH_TIMEOUT;
+    if (!strcmp(token, "timeout"))
+    {
+        if (!(token = strtok_r(NULL, " \t\r\n", &save)) || sscanf(token, "%u", &job->timeout) != 1)
+        {
+            return -1;
+        }
+        token = strtok_r(NULL, " \t\r\n", &save);
+    }
+    if (token && strstr(token, "riscv"))
+    {
+        token = strtok_r(NULL, " \t\r\n", &save);
+    }
+    for (; token; token = strtok_r(NULL, " \t\r\n", &save))
+    {
+        if (!strcmp(token, "-d"))
+        {
+            job->disassemble = 1;
+        }
+        else if (!strcmp(token, "-r"))
+        {
+            job->trace = 1;
+        }
+        else if (!strcmp(token, "-b"))
+        {
+            job->binary = 1;
+        }
+        else if (!strcmp(token, "-p"))
+        {
+            job->profile = 1;
+        }
+        else if (!strcmp(token, "-e") || !strcmp(token, "-v"))
+        {
+            continue;
+        }
+        else if (!strcmp(token, "-s"))
+        {
+            if (!(token = strtok_r(NULL, " \t\r\n", &save)))
+            {
+                return -1;
+            }
+            job->data = strdup(token);
+        }
+        else if (!strcmp(token, "-a"))
+        {
+            if (!(token = strtok_r(NULL, " \t\r\n", &save)) ||
+                sscanf(token, "%x,%x", &job->data_words, &job->data_address) != 2)
+            {
+                return -1;
+            }
+        }
+        else if (token[0] == '>')
+        {
+            if (!token[1] && !(token = strtok_r(NULL, " \t\r\n", &save)))
+            {
+                return -1;
+            }
+            job->output = strdup(token[0] == '>' ? token + 1 : token);
+        }
+        else if (token[0] == '-' || job->program)
+        {
+            return -1;
+        }
+        else
+        {
+            job->program = strdup(token);
+        }
+    }
+    return job->program && job->output ? 1 : -1;
+}
+
+/* The monotonic clock in seconds, which job deadlines are measured on. */
+static double seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Steps the loaded program while PC stays inside its words as the driver
+ * does, tracing to writer or output. Returns the job's exit status. */
+static int step_job(const BatchJob *job, Emulator *emulator, long words, FILE *output,
+                    TraceWriter *writer)
+{
+    Processor *processor = emulator_processor(emulator);
+    double deadline = seconds() + job->timeout;
+    char block[TRACE_TEXT_BLOCK];
+    unsigned long steps;
+
+    for (steps = 0; processor->PC - EMULATOR_ENTRY < 4 * (Address)words; steps++)
+    {
+        if (steps % CLOCK_INTERVAL == CLOCK_INTERVAL - 1 && seconds() > deadline)
+        {
+            return TIMEOUT_STATUS;
+        }
+        if (emulator_run(emulator, 1) != STOP_STEPS)
+        {
+            return emulator_exit_status(emulator);
+        }
+        if (writer)
+        {
+            trace_step(writer, processor);
+        }
+        else if (job->trace)
+        {
+            trace_format(block, processor);
+            fwrite(block, 1, TRACE_TEXT_BLOCK, output);
+        }
+    }
+    return 0;
+}
+
+/* Loads and runs one job. Its output goes to output, except that a binary
+ * trace (output is then NULL) creates the output file itself and takes the
+ * program's output into the trace. Returns the job's exit status. */
+static int execute_job(const BatchJob *job, Emulator *emulator, FILE *output)
+{
+    FILE *messages = output ? output : stderr;
+    TraceWriter *writer;
+    long words;
+    int status;
+
+    words = emulator_load_hex(emulator, job->program, EMULATOR_ENTRY, -1);
+    if (words < 0)
+    {
+        fprintf(messages, "cannot read %s\n", job->program);
+        return -1;
+    }
+    if (job->disassemble)
+    {
+        if (emulator_disassemble(emulator, EMULATOR_ENTRY, words) != STOP_STEPS)
+        {
+            return emulator_exit_status(emulator);
+        }
+        return 0;
+    }
+    if (job->data)
+    {
+        if (emulator_load_hex(emulator, job->data, job->data_address, job->data_words) < 0)
+        {
+            fprintf(messages, "cannot read %s\n", job->data);
+            return -1;
+        }
+        emulator_processor(emulator)->R[11] = job->data_address;
+    }
+    if (output)
+    {
+        return step_job(job, emulator, words, output, NULL);
+    }
+    writer = trace_create(job->output, emulator_processor(emulator));
+    if (!writer)
+    {
+        fprintf(stderr, "cannot create %s\n", job->output);
+        return -1;
+    }
+    emulator_set_output(emulator, trace_output, writer);
+    status = step_job(job, emulator, words, NULL, writer);
+    if (trace_close(writer) != 0)
+    {
+        fprintf(stderr, "cannot write %s\n", job->output);
+        return -1;
+    }
+    return status;
+}
+
+/* Writes the job's profile next to its output, as output.prof. */
+static void write_profile(const BatchJob *job, Emulator *emulator)
+{
+    char path[1024];
+    FILE *file;
+
+    snprintf(path, sizeof(path), "%s.prof", job->output);
+    if (!(file = fopen(path, "w")))
+    {
+        fprintf(stderr, "cannot create %s\n", path);
+        return;
+    }
+    emulator_profile_report(emulator, file, PROFILE_SPOTS);
+    fclose(file);
+}
+
+/* Runs one job on a fresh emulator of its own. */
+static void run_job(BatchJob *job, Engine engine)
+{
+    Emulator *emulator = emulator_create();
+    int binary = job->trace && job->binary && !job->disassemble;
+    int profiling = job->profile && !job->disassemble;
+    FILE *output = binary ? NULL : fopen(job->output, "w");
+
+    if (!emulator || (!binary && !output))
+    {
+        fprintf(stderr, "batch: cannot start %s\n", job->program);
+        job->status = -1;
+    }
+    else
+    {
+        emulator_set_engine(emulator, engine);
+        if (output)
+        {
+            emulator_set_output(emulator, emulator_output_file, output);
+        }
+        if (profiling && emulator_set_profiling(emulator, 1) != 0)
+        {
+            profiling = 0;
+        }
+        job->status = execute_job(job, emulator, output);
+        if (profiling)
+        {
+            write_profile(job, emulator);
+        }
+    }
+    if (output)
+    {
+        fclose(output);
+    }
+    if (emulator)
+    {
+        emulator_destroy(emulator);
+    }
+}
+
+static void *batch_worker(void *argument)
+{
+    BatchQueue *queue = argument;
+    int index;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&queue->lock);
+        index = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        if (index >= queue->count)
+        {
+            return NULL;
+        }
+        run_job(&queue->jobs[index], queue->engine);
+    }
+}
+
+static void free_jobs(BatchJob *jobs, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        free(jobs[i].program);
+        free(jobs[i].data);
+        free(jobs[i].output);
+    }
+    free(jobs);
+}
+
+/* Runs every job in manifest on up to threads worker threads, each job with
+ * its own Processor, memory and instance. Prints a line for each job that
+ * failed and returns how many did, or -1 if the manifest cannot be read. */
+int run_batch(const char *manifest, int threads, Engine engine)
+{
+    BatchQueue queue = {NULL, 0, 0, engine, PTHREAD_MUTEX_INITIALIZER};
+    pthread_t workers[BATCH_MAX_THREADS];
+    FILE *file = fopen(manifest, "r");
+    BatchJob *grown;
+    char line[1024];
+    int capacity = 0, line_number = 0, failed = 0, parsed = 0, i;
+
+    if (!file)
+    {
+        printf("cannot read %s\n", manifest);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), file))
+    {
+        line_number++;
+        if (queue.count == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 64;
+            grown = realloc(queue.jobs, capacity * sizeof(BatchJob));
+            if (!grown)
+            {
+                printf("out of memory\n");
+                parsed = -1;
+                break;
+            }
+            queue.jobs = grown;
+        }
+        parsed = parse_job(line, &queue.jobs[queue.count]);
+        if (parsed < 0)
+        {
+            printf("%s:%d: malformed job\n", manifest, line_number);
+            queue.count++; // so its strings are freed
+            break;
+        }
+        queue.count += parsed;
+    }
+    fclose(file);
+    if (parsed < 0)
+    {
+        free_jobs(queue.jobs, queue.count);
+        return -1;
+    }
+
+    if (threads > BATCH_MAX_THREADS)
+    {
+        threads = BATCH_MAX_THREADS;
+    }
+    if (threads > queue.count)
+    {
+        threads = queue.count;
+    }
+    if (threads < 1)
+    {
+        threads = 1;
+    }
+    for (i = 0; i < threads; i++)
+    {
+        pthread_create(&workers[i], NULL, batch_worker, &queue);
+    }
+    for (i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i], NULL);
+    }
+
+    for (i = 0; i < queue.count; i++)
+    {
+        if (queue.jobs[i].status != 0)
+        {
+            printf("%s: exit status %d\n", queue.jobs[i].program, queue.jobs[i].status);
+            failed++;
+        }
+    }
+    free_jobs(queue.jobs, queue.count);
+    return failed;
+}
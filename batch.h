@@ -0,0 +1,38 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "types.h"
+#include "riscv.h"
+
+/* Runs many programs in one process. A manifest holds one job per line,
+ * written like the driver's commands without the ./riscv:
+ *
+ *   [-d] [-r [-b]] [-p] [-s data -a count,address] program > output
+ *
+ * -d disassembles instead of running, -r traces the registers after every
+ * step, -b writes that trace in binary form (see trace.h), -p writes an
+ * instruction profile (see profile.h) to output.prof, -s loads count hex
+ * words of data at address and points a1 at it.
+ * -e and -v are accepted and ignored, and a leading "timeout N ./riscv"
+ * sets the job's time limit (60 seconds by default) and is otherwise
+ * skipped, so lines can be pasted from driver.py. Blank lines and lines
+ * starting with # are ignored. */
+
+typedef struct {
+    char *program;          // hex words, one per line, loaded at 0x1000
+    char *data;             // hex data words, NULL for none
+    Word data_words;
+    Address data_address;
+    int disassemble;
+    int trace;
+    int binary;             // -r writes a binary trace
+    int profile;            // -p writes output.prof
+    char *output;
+    unsigned timeout;       // seconds before the job is stopped
+    int status;             // exit status once run, 0 on success
+} BatchJob;
+
+/* see batch.c */
+int run_batch(const char *manifest, int threads, Engine engine);
+
+#endif
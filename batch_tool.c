@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "types.h"
+#include "riscv.h"
+#include "batch.h"
+
+/* Command line front end for run_batch():
+ *
+ *   batch_tool [-n threads] [-t | -j] manifest
+ *
+ * -t and -j pick the threaded or JIT engine for every job. Exits with the
+ * number of failed jobs, capped at 255. Build it with make batch_tool. */
+
+int main(int argc, char **argv)
+{
+    Engine engine = ENGINE_INTERPRETER;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int option, failed;
+
+    while ((option = getopt(argc, argv, "n:tj")) != -1)
+    {
+        switch (option)
+        {
+        case 'n':
+            threads = atoi(optarg);
+            break;
+        case 't':
+            engine = ENGINE_THREADED;
+            break;
+        case 'j':
+            engine = ENGINE_JIT;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n threads] [-t | -j] manifest\n", argv[0]);
+            return 255;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-n threads] [-t | -j] manifest\n", argv[0]);
+        return 255;
+    }
+    failed = run_batch(argv[optind], threads, engine);
+    return failed < 0 || failed > 255 ? 255 : failed;
+}
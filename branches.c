@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "riscv.h"
+#include "predecode.h"
+#include "predictor.h"
+#include "instance.h"
+#include "branches.h"
+
+/* Runs the predictors over retired branches and counts what they got
+ * wrong. See branches.h for what is recorded. */
+
+static void report_at_exit(void)
+{
+    branches_report(stderr, INSTANCE_WORST);
+    // the last outcomes are still buffered
+    branches_stop();
+}
+
+/* Writes the buffered outcomes, with the byte in progress if partial. */
+static void write_outcomes(Branches *branches, int partial)
+{
+    Word bytes = branches->outcome_bits >> 3;
+
+    if (partial && branches->outcome_bits & 7)
+    {
+        bytes++;
+    }
+    fwrite(branches->outcomes, 1, bytes, branches->bitstream);
+    branches->outcome_bits = 0;
+    memset(branches->outcomes, 0, bytes);
+}
+
+void branches_destroy(Branches *branches)
+{
+    PredictorKind kind;
+
+    for (kind = 0; kind < PREDICTOR_KINDS; kind++)
+    {
+        if (branches->predictors[kind])
+        {
+            predictor_destroy(branches->predictors[kind]);
+        }
+    }
+    if (branches->bitstream)
+    {
+        write_outcomes(branches, 1);
+        fflush(branches->bitstream);
+    }
+    instance_pc_table_free(branches->counts, sizeof(BranchCounts));
+    free(branches);
+}
+
+/* Starts running the predictor kinds set in the mask predictors, bit
+ * 1 << kind each, over the current instance's branches with no history.
+ * Outcomes go to bitstream unless it is NULL; the caller closes it after
+ * branches_stop(). Statistics already running are replaced. Returns -1 if
+ * no known kind is set or out of memory. */
+int branches_start(unsigned predictors, FILE *bitstream)
+{
+    Branches *branches;
+    PredictorKind kind;
+
+    if (!(predictors & BRANCHES_ALL) || !(branches = calloc(1, sizeof(Branches))))
+    {
+        return -1;
+    }
+    for (kind = 0; kind < PREDICTOR_KINDS; kind++)
+    {
+        if (predictors & 1u << kind && !(branches->predictors[kind] = predictor_create(kind)))
+        {
+            branches_destroy(branches);
+            return -1;
+        }
+    }
+    branches->counts = instance_pc_table(sizeof(BranchCounts));
+    if (!branches->counts)
+    {
+        branches_destroy(branches);
+        return -1;
+    }
+    if (current_instance->branches)
+    {
+        branches_destroy(current_instance->branches);
+    }
+    branches->bitstream = bitstream;
+    current_instance->branches = branches;
+    instance_flush(current_instance);
+    instance_report_at_exit(report_at_exit);
+    return 0;
+}
+
+/* Stops the current instance's statistics, writes out the outcomes still
+ * buffered and drops the counts. */
+void branches_stop(void)
+{
+    if (!current_instance->branches)
+    {
+        return;
+    }
+    branches_destroy(current_instance->branches);
+    current_instance->branches = NULL;
+    instance_flush(current_instance);
+}
+
+/* Shows the instruction at pc, which has run and left PC at next, to the
+ * predictors if it is a branch or a jump. */
+void branches_retire(Branches *branches, const DecodedInstruction *decoded, Address pc, Address next)
+{
+    BranchCounts *counts = &branches->elsewhere;
+    Predictor *predictor;
+    PredictorKind kind;
+    int taken;
+
+    switch (decoded->op)
+    {
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLT:
+    case OP_BGE:
+    case OP_BLTU:
+    case OP_BGEU:
+        break;
+    case OP_JAL:
+    case OP_JALR:
+        branches->jumps++;
+        for (kind = 0; kind < PREDICTOR_KINDS; kind++)
+        {
+            if ((predictor = branches->predictors[kind]))
+            {
+                predictor->update(predictor, pc, next, 1);
+            }
+        }
+        return;
+    default:
+        return;
+    }
+
+    if (!(pc & 0x1) && pc < MEMORY_SPACE)
+    {
+        counts = &branches->counts[pc >> 1];
+    }
+    taken = next != pc + decoded->length;
+    counts->word = decoded->instruction.bits;
+    counts->executed++;
+    counts->taken += taken;
+    branches->total.executed++;
+    branches->total.taken += taken;
+    for (kind = 0; kind < PREDICTOR_KINDS; kind++)
+    {
+        if (!(predictor = branches->predictors[kind]))
+        {
+            continue;
+        }
+        if (predictor->predict(predictor, pc, pc + decoded->imm) != taken)
+        {
+            counts->mispredicted[kind]++;
+            branches->total.mispredicted[kind]++;
+        }
+        predictor->update(predictor, pc, pc + decoded->imm, taken);
+    }
+    if (branches->bitstream)
+    {
+        branches->outcomes[branches->outcome_bits >> 3] |= taken << (branches->outcome_bits & 7);
+        if (++branches->outcome_bits == BRANCHES_BUFFER * 8)
+        {
+            write_outcomes(branches, 0);
+        }
+    }
+}
+
+/* The mispredictions of the predictor kind context points to. */
+static unsigned long mispredicted(const void *entry, const void *context)
+{
+    return ((const BranchCounts *)entry)->mispredicted[*(const PredictorKind *)context];
+}
+
+static double percent(unsigned long part, unsigned long whole)
+{
+    return whole ? 100.0 * part / whole : 0.0;
+}
+
+/* Prints the current instance's branch counts, each predictor's accuracy,
+ * and the worst branch PCs by the mispredictions of the most accurate
+ * predictor, which are the branches no predictor here gets right. */
+void branches_report(FILE *output, unsigned worst)
+{
+    const Branches *branches = current_instance->branches;
+    const BranchCounts *counts;
+    PredictorKind kind, best = PREDICTOR_KINDS;
+    Address *ranked;
+    char disassembly[64];
+    unsigned found, j;
+
+    if (!branches)
+    {
+        return;
+    }
+    fprintf(output, "branches: %lu conditional branches, %.1f%% taken, %lu jumps\n", branches->total.executed,
+            percent(branches->total.taken, branches->total.executed), branches->jumps);
+    fprintf(output, "branches: %-16s %12s %9s\n", "predictor", "mispredicted", "accuracy");
+    for (kind = 0; kind < PREDICTOR_KINDS; kind++)
+    {
+        if (!branches->predictors[kind])
+        {
+            continue;
+        }
+        fprintf(output, "branches: %-16s %12lu %8.2f%%\n", branches->predictors[kind]->name,
+                branches->total.mispredicted[kind],
+                100.0 - percent(branches->total.mispredicted[kind], branches->total.executed));
+        if (best == PREDICTOR_KINDS || branches->total.mispredicted[kind] < branches->total.mispredicted[best])
+        {
+            best = kind;
+        }
+    }
+
+    ranked = instance_rank(branches->counts, sizeof(BranchCounts), mispredicted, &best, worst, &found);
+    if (!ranked)
+    {
+        return;
+    }
+    if (found)
+    {
+        fprintf(output, "branches: PCs %s mispredicts most (executed, taken, mispredicted by each)\n",
+                branches->predictors[best]->name);
+    }
+    for (j = 0; j < found; j++)
+    {
+        counts = &branches->counts[ranked[j]];
+        disassemble_word(counts->word, disassembly, sizeof(disassembly));
+        fprintf(output, "branches:   %08x %10lu %6.1f%%", ranked[j] << 1, counts->executed,
+                percent(counts->taken, counts->executed));
+        for (kind = 0; kind < PREDICTOR_KINDS; kind++)
+        {
+            if (branches->predictors[kind])
+            {
+                fprintf(output, "  %s %lu", branches->predictors[kind]->name, counts->mispredicted[kind]);
+            }
+        }
+        fprintf(output, "  %s\n", disassembly);
+    }
+    free(ranked);
+}
@@ -0,0 +1,47 @@
+#ifndef BRANCHES_H
+#define BRANCHES_H
+
+#include <stdio.h>
+#include "types.h"
+#include "predecode.h"
+#include "predictor.h"
+#include "instance.h"
+
+/* Branch statistics: runs any set of predictors (see predictor.h) side by
+ * side over every conditional branch, feeds them every jal and jalr as a
+ * taken jump, and counts their mispredictions overall and per branch PC.
+ * Optionally writes each conditional branch's outcome to a bitstream for
+ * offline analysis, one bit per branch in execution order, 1 for taken,
+ * starting from the least significant bit of each byte; the last byte is
+ * padded with zeros. Like a profile (see profile.h) the predictors see
+ * branches through the observed handler, so an instance without them runs
+ * exactly as before. */
+
+#define BRANCHES_ALL ((1u << PREDICTOR_KINDS) - 1) // every predictor kind
+#define BRANCHES_BUFFER 4096 // bytes of outcomes written at a time
+
+typedef struct {
+    unsigned long executed;
+    unsigned long taken;
+    unsigned long mispredicted[PREDICTOR_KINDS];
+    Word word; // the branch last run there, for the report
+} BranchCounts;
+
+struct Branches {
+    Predictor *predictors[PREDICTOR_KINDS]; // NULL for kinds left out
+    BranchCounts *counts;   // per parcel, indexed by PC >> 1
+    BranchCounts total;
+    BranchCounts elsewhere; // PCs without a slot, only in the total
+    unsigned long jumps;
+    FILE *bitstream;        // NULL unless exporting outcomes
+    Byte outcomes[BRANCHES_BUFFER];
+    Word outcome_bits;      // outcomes buffered so far
+};
+
+/* see branches.c */
+int branches_start(unsigned predictors, FILE *bitstream);
+void branches_stop(void);
+void branches_retire(Branches *branches, const DecodedInstruction *decoded, Address pc, Address next);
+void branches_report(FILE *output, unsigned worst);
+
+#endif
@@ -0,0 +1,508 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "types.h"
+#include "riscv.h"
+#include "predecode.h"
+#include "instance.h"
+#include "cache.h"
+
+/* Set-associative caches with LRU, tree PLRU or random replacement, and
+ * the counters behind the report. See cache.h for the hierarchy. */
+
+#define LINE_VALID 0x1
+#define LINE_DIRTY 0x2
+#define LINE_NONE 0xFFFFFFFFu // no line address is this large
+typedef enum {
+    ACCESS_HIT,
+    ACCESS_MISS,
+    ACCESS_WRITEBACK, // a miss that evicted a dirty line
+} AccessResult;
+
+static const char *const level_names[CACHE_LEVELS] = {
+    [CACHE_L1I] = "L1I",
+    [CACHE_L1D] = "L1D",
+    [CACHE_L2] = "L2",
+};
+
+static const char *const replacement_names[] = {
+    [REPLACE_LRU] = "lru",
+    [REPLACE_PLRU] = "plru",
+    [REPLACE_RANDOM] = "random",
+};
+
+static void report_at_exit(void)
+{
+    cache_report(stderr, INSTANCE_WORST);
+}
+
+void cache_defaults(CacheHierarchyConfig *config)
+{
+    static const CacheConfig defaults[CACHE_LEVELS] = {
+        [CACHE_L1I] = {32 << 10, 8, 64, REPLACE_LRU},
+        [CACHE_L1D] = {32 << 10, 8, 64, REPLACE_LRU},
+        [CACHE_L2] = {256 << 10, 16, 64, REPLACE_LRU},
+    };
+
+    memcpy(config->levels, defaults, sizeof(defaults));
+}
+
+/* Changes the levels spec names from the configuration in config. The spec
+ * is a comma-separated list of level=size:ways:line[:policy] or level=off,
+ * for example "l1d=16k:4:32:plru,l2=off". Returns -1 if it is malformed. */
+int cache_parse(const char *spec, CacheHierarchyConfig *config)
+{
+    char copy[256], *item, *save, *at;
+    CacheConfig *level;
+    unsigned long size;
+    int i;
+
+    snprintf(copy, sizeof(copy), "%s", spec);
+    for (item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save))
+    {
+        if (!(at = strchr(item, '=')))
+        {
+            return -1;
+        }
+        *at++ = '\0';
+        for (i = 0; i < CACHE_LEVELS && strcasecmp(item, level_names[i]); i++)
+        {
+        }
+        if (i == CACHE_LEVELS)
+        {
+            return -1;
+        }
+        level = &config->levels[i];
+        if (!strcmp(at, "off"))
+        {
+            level->size = 0;
+            continue;
+        }
+        size = strtoul(at, &at, 0);
+        if (*at == 'k' || *at == 'K')
+        {
+            size <<= 10;
+            at++;
+        }
+        else if (*at == 'm' || *at == 'M')
+        {
+            size <<= 20;
+            at++;
+        }
+        level->size = size;
+        if (*at++ != ':')
+        {
+            return -1;
+        }
+        level->ways = strtoul(at, &at, 0);
+        if (*at++ != ':')
+        {
+            return -1;
+        }
+        level->line = strtoul(at, &at, 0);
+        level->replacement = REPLACE_LRU;
+        if (*at == ':')
+        {
+            for (i = 0; i <= REPLACE_RANDOM && strcmp(at + 1, replacement_names[i]); i++)
+            {
+            }
+            if (i > REPLACE_RANDOM)
+            {
+                return -1;
+            }
+            level->replacement = i;
+        }
+        else if (*at)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* The n with value == 1 << n, or -1 if value is not a power of two. */
+static int log2_exact(Word value)
+{
+    int n = 0;
+
+    if (!value || (value & (value - 1)))
+    {
+        return -1;
+    }
+    while (value >>= 1)
+    {
+        n++;
+    }
+    return n;
+}
+
+static int init_level(CacheLevel *level, const CacheConfig *config)
+{
+    int offset, index;
+
+    memset(level, 0, sizeof(CacheLevel));
+    level->config = *config;
+    if (!config->size)
+    {
+        return 0;
+    }
+    offset = log2_exact(config->line);
+    if (offset < 2 || !config->ways || config->size % (config->line * config->ways))
+    {
+        return -1;
+    }
+    level->sets = config->size / (config->line * config->ways);
+    index = log2_exact(level->sets);
+    if (index < 0 || config->replacement > REPLACE_RANDOM ||
+        (config->replacement == REPLACE_PLRU && (log2_exact(config->ways) < 0 || config->ways > 32)))
+    {
+        return -1;
+    }
+    level->lines = calloc((size_t)level->sets * config->ways, sizeof(Word));
+    if (config->replacement == REPLACE_PLRU)
+    {
+        level->trees = calloc(level->sets, sizeof(Word));
+    }
+    if (!level->lines || (config->replacement == REPLACE_PLRU && !level->trees))
+    {
+        return -1;
+    }
+    level->offset_bits = offset;
+    level->tag_shift = offset + index;
+    level->random = 0x2545F491;
+    level->last_line = LINE_NONE;
+    return 0;
+}
+
+void cache_destroy(Cache *cache)
+{
+    int i;
+
+    for (i = 0; i < CACHE_LEVELS; i++)
+    {
+        free(cache->levels[i].lines);
+        free(cache->levels[i].trees);
+    }
+    instance_pc_table_free(cache->counts, sizeof(CacheCounts));
+    free(cache);
+}
+
+/* Starts simulating the current instance's caches with config, or the
+ * defaults if it is NULL, all lines invalid. A simulation already running
+ * is replaced. Returns -1 if a level's geometry is unusable or out of
+ * memory. */
+int cache_start(const CacheHierarchyConfig *config)
+{
+    CacheHierarchyConfig defaults;
+    Cache *cache = calloc(1, sizeof(Cache));
+    int i;
+
+    if (!cache)
+    {
+        return -1;
+    }
+    if (!config)
+    {
+        cache_defaults(&defaults);
+        config = &defaults;
+    }
+    for (i = 0; i < CACHE_LEVELS; i++)
+    {
+        if (init_level(&cache->levels[i], &config->levels[i]) != 0)
+        {
+            cache_destroy(cache);
+            return -1;
+        }
+    }
+    cache->counts = instance_pc_table(sizeof(CacheCounts));
+    if (!cache->counts)
+    {
+        cache_destroy(cache);
+        return -1;
+    }
+    if (current_instance->cache)
+    {
+        cache_destroy(current_instance->cache);
+    }
+    current_instance->cache = cache;
+    instance_flush(current_instance);
+    instance_report_at_exit(report_at_exit);
+    return 0;
+}
+
+/* Stops simulating the current instance's caches and drops the counts. */
+void cache_stop(void)
+{
+    if (!current_instance->cache)
+    {
+        return;
+    }
+    cache_destroy(current_instance->cache);
+    current_instance->cache = NULL;
+    instance_flush(current_instance);
+}
+
+/* Points the PLRU tree of a set away from way. */
+static void plru_touch(Word *tree, Word ways, Word way)
+{
+    Word node = 1, half;
+
+    for (half = ways >> 1; half; half >>= 1)
+    {
+        if (way & half)
+        {
+            *tree &= ~(1u << node);
+            node = 2 * node + 1;
+        }
+        else
+        {
+            *tree |= 1u << node;
+            node = 2 * node;
+        }
+    }
+}
+
+/* The way to replace in a set whose ways are all valid. */
+static Word choose_victim(CacheLevel *level, Word set)
+{
+    Word ways = level->config.ways;
+    Word node = 1;
+
+    switch (level->config.replacement)
+    {
+    case REPLACE_PLRU:
+        while (node < ways)
+        {
+            node = 2 * node + ((level->trees[set] >> node) & 1);
+        }
+        return node - ways;
+    case REPLACE_RANDOM:
+        level->random ^= level->random << 13;
+        level->random ^= level->random >> 17;
+        level->random ^= level->random << 5;
+        return level->random % ways;
+    default:
+        return ways - 1; // ways are kept most recently used first
+    }
+}
+
+/* Looks the line holding address up in level and leaves it there as the
+ * most recently used, brought in on a miss and dirty if write. A dirty line
+ * evicted to make room is reported with its address in *victim. */
+static AccessResult access_level(CacheLevel *level, Address address, int write, Address *victim)
+{
+    Word set = (address >> level->offset_bits) & (level->sets - 1);
+    Word ways = level->config.ways;
+    Word *lines = level->lines + (size_t)set * ways;
+    Word wanted = (address >> level->tag_shift) << 2 | LINE_VALID;
+    Word way, line;
+    AccessResult result = ACCESS_HIT;
+
+    level->accesses++;
+    // only this level's accesses move its lines, so one to the line used
+    // last hits where it left it, and leaves the replacement state as it is
+    if (address >> level->offset_bits == level->last_line)
+    {
+        *level->last_entry |= write ? LINE_DIRTY : 0;
+        return ACCESS_HIT;
+    }
+    for (way = 0; way < ways && (lines[way] & ~LINE_DIRTY) != wanted; way++)
+    {
+    }
+    if (way < ways)
+    {
+        line = lines[way];
+    }
+    else
+    {
+        level->misses++;
+        result = ACCESS_MISS;
+        if (level->config.replacement == REPLACE_LRU)
+        {
+            way = ways - 1;
+        }
+        else
+        {
+            for (way = 0; way < ways && (lines[way] & LINE_VALID); way++)
+            {
+            }
+            if (way == ways)
+            {
+                way = choose_victim(level, set);
+            }
+        }
+        if ((lines[way] & (LINE_VALID | LINE_DIRTY)) == (LINE_VALID | LINE_DIRTY))
+        {
+            level->writebacks++;
+            *victim = (lines[way] >> 2) << level->tag_shift | set << level->offset_bits;
+            result = ACCESS_WRITEBACK;
+        }
+        line = wanted;
+    }
+    if (write)
+    {
+        line |= LINE_DIRTY;
+    }
+    if (level->config.replacement == REPLACE_LRU)
+    {
+        for (; way > 0; way--)
+        {
+            lines[way] = lines[way - 1];
+        }
+    }
+    else if (level->config.replacement == REPLACE_PLRU)
+    {
+        plru_touch(&level->trees[set], ways, way);
+    }
+    lines[way] = line;
+    level->last_line = address >> level->offset_bits;
+    level->last_entry = &lines[way];
+    return result;
+}
+
+static void access_l2(Cache *cache, Address address, int write, CacheCounts *counts)
+{
+    CacheLevel *l2 = &cache->levels[CACHE_L2];
+    Address victim;
+    AccessResult result;
+
+    if (!l2->lines)
+    {
+        return;
+    }
+    counts->accesses[CACHE_L2]++;
+    result = access_level(l2, address, write, &victim);
+    if (result != ACCESS_HIT)
+    {
+        counts->misses[CACHE_L2]++;
+    }
+    if (result == ACCESS_WRITEBACK)
+    {
+        counts->writebacks++;
+    }
+}
+
+/* Reads or writes the line holding address through an L1 and then L2. */
+static void access_hierarchy(Cache *cache, CacheLevelId first, Address address, int write,
+                             CacheCounts *counts)
+{
+    CacheLevel *l1 = &cache->levels[first];
+    Address victim;
+    AccessResult result;
+
+    if (l1->lines)
+    {
+        counts->accesses[first]++;
+        result = access_level(l1, address, write, &victim);
+        if (result == ACCESS_HIT)
+        {
+            return;
+        }
+        counts->misses[first]++;
+        if (result == ACCESS_WRITEBACK)
+        {
+            counts->writebacks++;
+            access_l2(cache, victim, 1, counts);
+        }
+        write = 0; // L2 only supplies the line, L1 holds the new data
+    }
+    access_l2(cache, address, write, counts);
+}
+
+/* Runs the accesses of the instruction at pc, which loaded or stored at
+ * address if it is a load or store. */
+void cache_retire(Cache *cache, const DecodedInstruction *decoded, Address pc, Address address)
+{
+    CacheCounts *counts = &cache->elsewhere;
+    Word size, line;
+    int write;
+
+    if (!(pc & 0x1) && pc < MEMORY_SPACE)
+    {
+        counts = &cache->counts[pc >> 1];
+    }
+    counts->word = decoded->instruction.bits;
+    access_hierarchy(cache, CACHE_L1I, pc, 0, counts);
+    switch (isa_formats[decoded->op])
+    {
+    case FORMAT_LOAD:
+        write = 0;
+        break;
+    case FORMAT_STORE:
+        write = 1;
+        break;
+    default:
+        return;
+    }
+    size = isa_widths[decoded->op];
+    access_hierarchy(cache, CACHE_L1D, address, write, counts);
+    // an unaligned access may reach into the next line as well
+    line = cache->levels[CACHE_L1D].lines ? cache->levels[CACHE_L1D].config.line :
+                                            cache->levels[CACHE_L2].config.line;
+    if (line && (address & (line - 1)) + size > line)
+    {
+        access_hierarchy(cache, CACHE_L1D, address + size - 1, write, counts);
+    }
+}
+
+static unsigned long misses(const void *entry, const void *context)
+{
+    const CacheCounts *counts = entry;
+
+    return counts->misses[CACHE_L1I] + counts->misses[CACHE_L1D] + counts->misses[CACHE_L2];
+}
+
+/* Prints the current instance's accesses, misses and writebacks per level
+ * and the worst PCs by misses. */
+void cache_report(FILE *output, unsigned worst)
+{
+    const Cache *cache = current_instance->cache;
+    const CacheLevel *level;
+    const CacheCounts *counts;
+    Address *ranked;
+    char disassembly[64];
+    unsigned found, j;
+    int id;
+
+    if (!cache)
+    {
+        return;
+    }
+    fprintf(output, "cache: %-5s %8s %5s %5s %-7s %12s %12s %7s %12s\n", "level", "size", "ways", "line",
+            "policy", "accesses", "misses", "miss%", "writebacks");
+    for (id = 0; id < CACHE_LEVELS; id++)
+    {
+        level = &cache->levels[id];
+        if (!level->lines)
+        {
+            continue;
+        }
+        fprintf(output, "cache: %-5s %8u %5u %5u %-7s %12lu %12lu %6.2f%% %12lu\n", level_names[id],
+                level->config.size, level->config.ways, level->config.line,
+                replacement_names[level->config.replacement], level->accesses, level->misses,
+                level->accesses ? 100.0 * level->misses / level->accesses : 0.0, level->writebacks);
+    }
+
+    ranked = instance_rank(cache->counts, sizeof(CacheCounts), misses, NULL, worst, &found);
+    if (!ranked)
+    {
+        return;
+    }
+    if (found)
+    {
+        fprintf(output, "cache: PCs with the most misses (misses/accesses)\n");
+    }
+    for (j = 0; j < found; j++)
+    {
+        counts = &cache->counts[ranked[j]];
+        disassemble_word(counts->word, disassembly, sizeof(disassembly));
+        fprintf(output, "cache:   %08x", ranked[j] << 1);
+        for (id = 0; id < CACHE_LEVELS; id++)
+        {
+            fprintf(output, "  %s %lu/%lu", level_names[id], counts->misses[id], counts->accesses[id]);
+        }
+        fprintf(output, "  wb %lu  %s\n", counts->writebacks, disassembly);
+    }
+    free(ranked);
+}
@@ -0,0 +1,80 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+#include "types.h"
+#include "predecode.h"
+#include "instance.h"
+
+/* Cache hierarchy simulator: split L1 instruction and data caches in front
+ * of a unified L2, all write-back and write-allocate. Every instruction is
+ * fetched through L1I and every load and store goes through L1D at its
+ * effective address; an L1 miss or dirty eviction goes to L2. Like a
+ * profile (see profile.h) the simulator sees instructions through the
+ * observed handler, so an instance without one runs exactly as before.
+ *
+ * Each line is one Word holding its tag above a dirty and a valid bit. LRU
+ * sets keep their ways in most recently used order, so they need no age
+ * bits; PLRU sets keep their tree of ways - 1 bits in a Word. */
+
+typedef enum {
+    CACHE_L1I,
+    CACHE_L1D,
+    CACHE_L2,
+    CACHE_LEVELS
+} CacheLevelId;
+
+typedef enum {
+    REPLACE_LRU,
+    REPLACE_PLRU,   // tree pseudo-LRU, needs a power-of-two number of ways
+    REPLACE_RANDOM,
+} Replacement;
+
+typedef struct {
+    Word size;      // bytes, 0 leaves the level out
+    Word ways;
+    Word line;      // bytes per line, a power of two of at least 4
+    Replacement replacement;
+} CacheConfig;
+
+struct CacheHierarchyConfig {
+    CacheConfig levels[CACHE_LEVELS];
+};
+
+typedef struct {
+    CacheConfig config;
+    Word *lines;        // sets * ways tagged lines
+    Word *trees;        // PLRU bits of each set
+    Word sets;
+    Byte offset_bits;
+    Byte tag_shift;     // offset plus index bits
+    Word random;        // xorshift state for REPLACE_RANDOM
+    Address last_line;  // address >> offset_bits of the line used last
+    Word *last_entry;   // and where it is
+    unsigned long accesses;
+    unsigned long misses;
+    unsigned long writebacks;
+} CacheLevel;
+
+typedef struct {
+    unsigned long accesses[CACHE_LEVELS];
+    unsigned long misses[CACHE_LEVELS];
+    unsigned long writebacks;  // dirty lines this PC's accesses evicted
+    Word word;                 // the instruction last run there, for the report
+} CacheCounts;
+
+struct Cache {
+    CacheLevel levels[CACHE_LEVELS];
+    CacheCounts *counts;    // per parcel, indexed by PC >> 1
+    CacheCounts elsewhere;  // PCs without a slot
+};
+
+/* see cache.c */
+void cache_defaults(CacheHierarchyConfig *config);
+int cache_parse(const char *spec, CacheHierarchyConfig *config);
+int cache_start(const CacheHierarchyConfig *config);
+void cache_stop(void);
+void cache_retire(Cache *cache, const DecodedInstruction *decoded, Address pc, Address address);
+void cache_report(FILE *output, unsigned worst);
+
+#endif
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "riscv.h"
+#include "predecode.h"
+#include "instance.h"
+#include "debug.h"
+
+/* Breakpoints and watchpoints of the current instance, see debug.h. */
+
+#define DEBUG_SLOTS 64 // breakpoint slots to start with
+
+/* Multiplicative hash of the word index, taking the well-mixed high bits. */
+static Word slot_of(const Debug *debug, Address pc)
+{
+    return ((pc >> 2) * 0x9E3779B1u) >> debug->shift;
+}
+
+static void insert(Debug *debug, Address pc)
+{
+    Word slot = slot_of(debug, pc);
+
+    while (debug->breakpoints[slot] != DEBUG_NONE)
+    {
+        slot = (slot + 1) & (debug->capacity - 1);
+    }
+    debug->breakpoints[slot] = pc;
+}
+
+/* Moves the set into capacity slots, leaving out except. */
+static int rehash(Debug *debug, Word capacity, Address except)
+{
+    Address *old = debug->breakpoints;
+    Word old_capacity = debug->capacity, i;
+
+    if (!(debug->breakpoints = malloc(sizeof(Address) * capacity)))
+    {
+        debug->breakpoints = old;
+        return -1;
+    }
+    memset(debug->breakpoints, 0xFF, sizeof(Address) * capacity);
+    debug->capacity = capacity;
+    for (debug->shift = 32; capacity > 1; capacity >>= 1)
+    {
+        debug->shift--;
+    }
+    for (i = 0; i < old_capacity; i++)
+    {
+        if (old[i] != DEBUG_NONE && old[i] != except)
+        {
+            insert(debug, old[i]);
+        }
+    }
+    free(old);
+    return 0;
+}
+
+void debug_destroy(Debug *debug)
+{
+    free(debug->breakpoints);
+    free(debug);
+}
+
+/* Whether pc is a breakpoint. */
+int debug_breakpoint(const Debug *debug, Address pc)
+{
+    Word slot;
+
+    if (!debug->breakpoint_count)
+    {
+        return 0;
+    }
+    for (slot = slot_of(debug, pc); debug->breakpoints[slot] != DEBUG_NONE;
+         slot = (slot + 1) & (debug->capacity - 1))
+    {
+        if (debug->breakpoints[slot] == pc)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* The current instance's debug state, created on first use. */
+static Debug *attach(void)
+{
+    Debug *debug = current_instance->debug;
+
+    if (debug)
+    {
+        return debug;
+    }
+    if (!(debug = calloc(1, sizeof(Debug))) || rehash(debug, DEBUG_SLOTS, DEBUG_NONE) != 0)
+    {
+        free(debug);
+        return NULL;
+    }
+    debug->step_over = DEBUG_NONE;
+    current_instance->debug = debug;
+    return debug;
+}
+
+/* Drops the debug state once nothing is set, so the engines run again. */
+static void detach(void)
+{
+    Debug *debug = current_instance->debug;
+
+    if (!debug->breakpoint_count && !debug->watch_count)
+    {
+        debug_destroy(debug);
+        current_instance->debug = NULL;
+    }
+}
+
+/* Sets or clears a breakpoint at pc on the current instance. Returns -1
+ * if out of memory or pc is DEBUG_NONE. */
+int debug_set_breakpoint(Address pc, int enabled)
+{
+    Debug *debug;
+
+    if (pc == DEBUG_NONE || !(debug = attach()))
+    {
+        return -1;
+    }
+    if (enabled && !debug_breakpoint(debug, pc))
+    {
+        // keep the set at most half full so probes stay short
+        if (2 * (debug->breakpoint_count + 1) > debug->capacity &&
+            rehash(debug, 2 * debug->capacity, DEBUG_NONE) != 0)
+        {
+            detach();
+            return -1;
+        }
+        insert(debug, pc);
+        debug->breakpoint_count++;
+    }
+    else if (!enabled && debug_breakpoint(debug, pc))
+    {
+        // removals are rare, so rebuilding beats tombstones
+        if (rehash(debug, debug->capacity, pc) != 0)
+        {
+            return -1;
+        }
+        debug->breakpoint_count--;
+    }
+    // the word decodes again, with or without the breakpoint
+    predecode_invalidate(pc, LENGTH_WORD);
+    detach();
+    return 0;
+}
+
+/* Sets or clears a watchpoint of kind on length bytes at address on the
+ * current instance. Clearing needs the same range and kind. Returns -1 if
+ * all DEBUG_WATCHPOINTS are taken, nothing matches or out of memory. */
+int debug_set_watchpoint(Address address, Word length, WatchKind kind, int enabled)
+{
+    Debug *debug;
+    Word i;
+    int flush;
+
+    if (!length || !(kind & WATCH_ACCESS) || !(debug = attach()))
+    {
+        return -1;
+    }
+    for (i = 0; i < debug->watch_count; i++)
+    {
+        if (debug->watchpoints[i].address == address && debug->watchpoints[i].length == length &&
+            debug->watchpoints[i].kind == kind)
+        {
+            break;
+        }
+    }
+    if (enabled && i == debug->watch_count && i < DEBUG_WATCHPOINTS)
+    {
+        debug->watchpoints[debug->watch_count].address = address;
+        debug->watchpoints[debug->watch_count].length = length;
+        debug->watchpoints[debug->watch_count++].kind = kind;
+    }
+    else if (!enabled && i < debug->watch_count)
+    {
+        debug->watchpoints[i] = debug->watchpoints[--debug->watch_count];
+    }
+    else if (i == debug->watch_count)
+    {
+        detach();
+        return -1;
+    }
+    // records pick the observed handler when decoded
+    flush = !current_instance->watching != !debug->watch_count;
+    current_instance->watching = debug->watch_count;
+    if (flush)
+    {
+        instance_flush(current_instance);
+    }
+    detach();
+    return 0;
+}
+
+/* Stops the run if the instruction just executed loaded from or stored to
+ * a watched range. address is the one it computed before it ran. */
+void debug_watch(Debug *debug, const DecodedInstruction *decoded, Address address)
+{
+    const Watchpoint *watchpoint;
+    WatchKind kind;
+    Word size, i;
+
+    switch (isa_formats[decoded->op])
+    {
+    case FORMAT_LOAD:
+        kind = WATCH_READ;
+        break;
+    case FORMAT_STORE:
+        kind = WATCH_WRITE;
+        break;
+    default:
+        return;
+    }
+    size = isa_widths[decoded->op];
+    for (i = 0; i < debug->watch_count; i++)
+    {
+        watchpoint = &debug->watchpoints[i];
+        // the ranges overlap, written so neither end can wrap
+        if (watchpoint->kind & kind &&
+            (address - watchpoint->address < watchpoint->length || watchpoint->address - address < size))
+        {
+            debug->hit = address;
+            debug->hit_kind = watchpoint->kind;
+            current_instance->left--; // the instruction itself did retire
+            instance_stop(STOP_WATCHPOINT, 0);
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include "types.h"
+#include "predecode.h"
+#include "instance.h"
+
+/* Debugger state of an instance: software breakpoints and watchpoints.
+ * Breakpoints are a hashed set of PCs consulted only when a word is
+ * predecoded (see part2.c). A word at a breakpoint decodes to a record
+ * whose handler stops the run before it, so every other instruction runs
+ * from its cached record as it would without a debugger. The threaded
+ * engine and the JIT dispatch without handlers, so an instance with any
+ * breakpoint or watchpoint set runs the interpreter. Watchpoints need the
+ * address of every load and store and see them through the observed
+ * handler, like the side models. */
+
+#define DEBUG_NONE 0xFFFFFFFFu // a free breakpoint slot, never a breakpoint
+#define DEBUG_WATCHPOINTS 16
+
+typedef struct {
+    Address address;
+    Word length;
+    WatchKind kind;
+} Watchpoint;
+
+struct Debug {
+    Address *breakpoints;  // open addressing, DEBUG_NONE where free
+    Word capacity;         // slots, a power of two
+    Word shift;            // 32 - log2(capacity), for the hash
+    Word breakpoint_count;
+    Watchpoint watchpoints[DEBUG_WATCHPOINTS];
+    Word watch_count;
+    Address step_over;     // the breakpoint a run started at, which it executes
+    Address hit;           // data address the last watchpoint stop touched
+    WatchKind hit_kind;    // and the kind of the watchpoint it touched
+};
+
+/* see debug.c */
+int debug_set_breakpoint(Address pc, int enabled);
+int debug_set_watchpoint(Address address, Word length, WatchKind kind, int enabled);
+int debug_breakpoint(const Debug *debug, Address pc);
+void debug_watch(Debug *debug, const DecodedInstruction *decoded, Address address);
+
+#endif
@@ -0,0 +1,147 @@
+#include <stddef.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "types.h"
+#include "decoder.h"
+
+/* Batch decoding, see decoder.h. Every field and immediate is a fixed
+ * combination of shifts and masks of the word, whatever its format, so a
+ * batch is decoded without looking at the opcode. The vector and scalar
+ * paths compute the same expressions. */
+
+#define FIELD(word, shift, mask) (((word) >> (shift)) & (mask))
+
+static void decode_word(Word word, const DecodedFields *fields, size_t i)
+{
+    fields->opcode[i] = FIELD(word, 0, 0x7F);
+    fields->rd[i] = FIELD(word, 7, 0x1F);
+    fields->funct3[i] = FIELD(word, 12, 0x07);
+    fields->rs1[i] = FIELD(word, 15, 0x1F);
+    fields->rs2[i] = FIELD(word, 20, 0x1F);
+    fields->funct7[i] = FIELD(word, 25, 0x7F);
+    fields->itype_imm[i] = (sWord)word >> 20;
+    fields->store_offset[i] = ((sWord)word >> 20 & ~0x1F) | FIELD(word, 7, 0x1F);
+    fields->branch_offset[i] = ((sWord)word >> 19 & ~0xFFF) | (word << 4 & 0x800) | FIELD(word, 20, 0x7E0) |
+                               FIELD(word, 7, 0x1E);
+    fields->jump_offset[i] = ((sWord)word >> 11 & ~0xFFFFF) | (word & 0xFF000) | FIELD(word, 9, 0x800) |
+                             FIELD(word, 20, 0x7FE);
+    fields->utype_imm[i] = word & ~0xFFF;
+}
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+#if defined(__AVX2__)
+#define VECTOR_WORDS 8
+typedef __m256i Vector;
+#define load_vector(p) _mm256_loadu_si256((const __m256i *)(p))
+#define store_vector(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define splat _mm256_set1_epi32
+#define and_vector _mm256_and_si256
+#define or_vector _mm256_or_si256
+#define srl_vector _mm256_srli_epi32
+#define sra_vector _mm256_srai_epi32
+#define sll_vector _mm256_slli_epi32
+
+/* Narrows two vectors of fields, all below 128, to 16 bytes in order. */
+static void store_bytes(Byte *out, const Vector *fields)
+{
+    // packing works within each 128-bit lane, so the lanes' dwords end up
+    // interleaved and the permute puts them back in word order
+    Vector bytes = _mm256_packs_epi32(fields[0], fields[1]);
+
+    bytes = _mm256_packus_epi16(bytes, bytes);
+    bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 1, 5, 0, 0, 0, 0));
+    _mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(bytes));
+}
+#else
+#define VECTOR_WORDS 4
+typedef __m128i Vector;
+#define load_vector(p) _mm_loadu_si128((const __m128i *)(p))
+#define store_vector(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define splat _mm_set1_epi32
+#define and_vector _mm_and_si128
+#define or_vector _mm_or_si128
+#define srl_vector _mm_srli_epi32
+#define sra_vector _mm_srai_epi32
+#define sll_vector _mm_slli_epi32
+
+/* Narrows four vectors of fields, all below 128, to 16 bytes in order. */
+static void store_bytes(Byte *out, const Vector *fields)
+{
+    _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(_mm_packs_epi32(fields[0], fields[1]),
+                                                      _mm_packs_epi32(fields[2], fields[3])));
+}
+#endif
+
+#define VECTORS (DECODER_BATCH / VECTOR_WORDS)
+
+static void store_field(Byte *out, const Vector *words, int shift, Word mask)
+{
+    Vector fields[VECTORS];
+    int v;
+
+    for (v = 0; v < VECTORS; v++)
+    {
+        fields[v] = and_vector(srl_vector(words[v], shift), splat(mask));
+    }
+    store_bytes(out, fields);
+}
+
+/* Decodes words[0..DECODER_BATCH) into entry i onwards of fields. */
+static void decode_batch(const Word *words, const DecodedFields *fields, size_t i)
+{
+    Vector word[VECTORS], high;
+    size_t at;
+    int v;
+
+    for (v = 0; v < VECTORS; v++)
+    {
+        word[v] = load_vector(words + v * VECTOR_WORDS);
+    }
+    store_field(fields->opcode + i, word, 0, 0x7F);
+    store_field(fields->rd + i, word, 7, 0x1F);
+    store_field(fields->funct3 + i, word, 12, 0x07);
+    store_field(fields->rs1 + i, word, 15, 0x1F);
+    store_field(fields->rs2 + i, word, 20, 0x1F);
+    store_field(fields->funct7 + i, word, 25, 0x7F);
+    for (v = 0; v < VECTORS; v++)
+    {
+        at = i + v * VECTOR_WORDS;
+        high = sra_vector(word[v], 20);
+        store_vector(fields->itype_imm + at, high);
+        store_vector(fields->store_offset + at,
+                     or_vector(and_vector(high, splat(~0x1F)), and_vector(srl_vector(word[v], 7), splat(0x1F))));
+        store_vector(fields->branch_offset + at,
+                     or_vector(or_vector(and_vector(sra_vector(word[v], 19), splat(~0xFFF)),
+                                         and_vector(sll_vector(word[v], 4), splat(0x800))),
+                               or_vector(and_vector(srl_vector(word[v], 20), splat(0x7E0)),
+                                         and_vector(srl_vector(word[v], 7), splat(0x1E)))));
+        store_vector(fields->jump_offset + at,
+                     or_vector(or_vector(and_vector(sra_vector(word[v], 11), splat(~0xFFFFF)),
+                                         and_vector(word[v], splat(0xFF000))),
+                               or_vector(and_vector(srl_vector(word[v], 9), splat(0x800)),
+                                         and_vector(srl_vector(word[v], 20), splat(0x7FE)))));
+        store_vector(fields->utype_imm + at, and_vector(word[v], splat(~0xFFF)));
+    }
+}
+
+#endif
+
+/* Decodes count words into entries 0..count of fields, each array of
+ * which must have room for count. */
+void decode_words(const Word *words, size_t count, const DecodedFields *fields)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    for (; i + DECODER_BATCH <= count; i += DECODER_BATCH)
+    {
+        decode_batch(words + i, fields, i);
+    }
+#endif
+    for (; i < count; i++)
+    {
+        decode_word(words[i], fields, i);
+    }
+}
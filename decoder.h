@@ -0,0 +1,34 @@
+#ifndef DECODER_H
+#define DECODER_H
+
+#include <stddef.h>
+#include "types.h"
+
+/* Batch instruction decoder. Splits whole runs of words into their fields
+ * and every immediate form at once, a vector of words at a time where the
+ * compiler targets AVX2 or SSE2 and one word at a time otherwise. Each
+ * field goes to its own array, entry i for words[i]. The values agree with
+ * parse_instruction() and the offset helpers in utils.c, quirks included,
+ * for the opcodes parse_instruction() knows; other words are split the
+ * same way instead of stopping the instance. */
+
+#define DECODER_BATCH 16 // words decoded per vector step
+
+typedef struct {
+    Byte *opcode;
+    Byte *rd;
+    Byte *funct3;
+    Byte *rs1;
+    Byte *rs2;
+    Byte *funct7;
+    sWord *itype_imm;     // sign_extend_number(itype.imm, 12)
+    sWord *store_offset;  // get_store_offset()
+    sWord *branch_offset; // get_branch_offset()
+    sWord *jump_offset;   // get_jump_offset()
+    sWord *utype_imm;     // utype.imm already in the upper 20 bits
+} DecodedFields;
+
+/* see decoder.c */
+void decode_words(const Word *words, size_t count, const DecodedFields *fields);
+
+#endif
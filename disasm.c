@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "types.h"
+#include "isa.h"
+#include "image.h"
+#include "disasm.h"
+
+/* Table-driven disassembly of runs of words, see disasm.h. */
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static char *put_hex(char *out, Word value)
+{
+    int i;
+
+    for (i = 7; i >= 0; i--, value >>= 4)
+    {
+        out[i] = hex_digits[value & 0xF];
+    }
+    return out + 8;
+}
+
+static char *put_int(char *out, sWord value)
+{
+    char digits[12];
+    Word magnitude = value < 0 ? -(Word)value : (Word)value;
+    int n = 0;
+
+    if (value < 0)
+    {
+        *out++ = '-';
+    }
+    do
+    {
+        digits[n++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude);
+    while (n)
+    {
+        *out++ = digits[--n];
+    }
+    return out;
+}
+
+static char *put_register(char *out, Word number)
+{
+    *out++ = 'x';
+    if (number >= 10)
+    {
+        *out++ = '0' + number / 10;
+    }
+    *out++ = '0' + number % 10;
+    return out;
+}
+
+static char *put_text(char *out, const char *text)
+{
+    while (*text)
+    {
+        *out++ = *text++;
+    }
+    return out;
+}
+
+/* sign_extend_number() of the low n bits. */
+static sWord extend(Word field, int n)
+{
+    return (sWord)(field << (32 - n)) >> (32 - n);
+}
+
+/* Formats one line for bits at address; the same text decode_instruction()
+ * prints after the address, computed the way utils.c does. */
+static char *format_word(char *out, Word bits, Address address)
+{
+    Op op = isa_decode(bits);
+    Byte format = isa_formats[op];
+    Word rd = (bits >> 7) & 31, rs1 = (bits >> 15) & 31, rs2 = (bits >> 20) & 31;
+    Word imm5 = (bits >> 7) & 0x1F, imm7 = bits >> 25, upper = bits >> 12;
+
+    out = put_hex(out, address);
+    *out++ = ':';
+    *out++ = ' ';
+    if (format == FORMAT_INVALID)
+    {
+        out = put_text(out, "Invalid Instruction: 0x");
+        out = put_hex(out, bits);
+        *out++ = '\n';
+        return out;
+    }
+    out = put_text(out, isa_names[op]);
+    switch (format)
+    {
+    case FORMAT_R:
+        *out++ = '\t';
+        out = put_register(out, rd);
+        out = put_text(out, ", ");
+        out = put_register(out, rs1);
+        out = put_text(out, ", ");
+        out = put_register(out, rs2);
+        break;
+    case FORMAT_I:
+    case FORMAT_SHIFT:
+    case FORMAT_JR:
+        *out++ = '\t';
+        out = put_register(out, rd);
+        out = put_text(out, ", ");
+        out = put_register(out, rs1);
+        out = put_text(out, ", ");
+        out = put_int(out, format == FORMAT_SHIFT ? (sWord)((bits >> 20) & 0x1F) : extend(bits >> 20, 12));
+        break;
+    case FORMAT_LOAD:
+    case FORMAT_STORE:
+        *out++ = '\t';
+        out = put_register(out, format == FORMAT_LOAD ? rd : rs2);
+        out = put_text(out, ", ");
+        out = put_int(out, format == FORMAT_LOAD ? extend(bits >> 20, 12) : extend(imm5 | imm7 << 5, 12));
+        *out++ = '(';
+        out = put_register(out, rs1);
+        *out++ = ')';
+        break;
+    case FORMAT_BRANCH:
+        *out++ = '\t';
+        out = put_register(out, rs1);
+        out = put_text(out, ", ");
+        out = put_register(out, rs2);
+        out = put_text(out, ", ");
+        out = put_int(out, extend((imm5 & 0x1E) | (imm7 & 0x3F) << 5 | (imm5 & 1) << 11 | (imm7 & 0x40) << 6, 13));
+        break;
+    case FORMAT_U:
+        *out++ = '\t';
+        out = put_register(out, rd);
+        out = put_text(out, ", ");
+        out = put_int(out, upper);
+        break;
+    case FORMAT_J:
+        *out++ = '\t';
+        out = put_register(out, rd);
+        out = put_text(out, ", ");
+        out = put_int(out, extend((upper & 0xFF) << 12 | (upper & 0x100) << 3 | (upper & 0x7FE00) >> 8 |
+                                  (upper & 0x80000) << 1, 21));
+        break;
+    }
+    *out++ = '\n';
+    return out;
+}
+
+/* Formats count words starting at address into out, which needs room for
+ * DISASM_LINE bytes per word. Returns the bytes written, not terminated. */
+size_t disasm_words(const Word *words, size_t count, Address address, char *out)
+{
+    char *start = out;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        out = format_word(out, words[i], address + 4 * i);
+    }
+    return out - start;
+}
+
+typedef struct {
+    pthread_t thread;
+    const Word *words;
+    size_t count;
+    Address address;
+    char *text;
+    size_t length;
+} Chunk;
+
+static void *format_chunk(void *argument)
+{
+    Chunk *chunk = argument;
+
+    chunk->length = disasm_words(chunk->words, chunk->count, chunk->address, chunk->text);
+    return NULL;
+}
+
+/* Formats count words a batch of chunks at a time, one thread per chunk,
+ * and writes the batches out in order. */
+static int disasm_parallel(const Word *words, size_t count, Address address, FILE *output, int threads)
+{
+    Chunk *chunks = calloc(threads, sizeof(Chunk));
+    size_t done = 0;
+    int i, used, result = 0;
+
+    for (i = 0; chunks && i < threads; i++)
+    {
+        if (!(chunks[i].text = malloc((size_t)DISASM_LINE * DISASM_CHUNK)))
+        {
+            result = -1;
+        }
+    }
+    if (!chunks || result != 0)
+    {
+        for (i = 0; chunks && i < threads; i++)
+        {
+            free(chunks[i].text);
+        }
+        free(chunks);
+        return -1;
+    }
+    while (done < count && result == 0)
+    {
+        for (used = 0; used < threads && done < count; used++)
+        {
+            chunks[used].words = words + done;
+            chunks[used].count = count - done < DISASM_CHUNK ? count - done : DISASM_CHUNK;
+            chunks[used].address = address + 4 * done;
+            done += chunks[used].count;
+            // the first chunk of a batch runs here, the rest on threads
+            if (used && pthread_create(&chunks[used].thread, NULL, format_chunk, &chunks[used]) != 0)
+            {
+                format_chunk(&chunks[used]);
+                chunks[used].thread = 0;
+            }
+        }
+        format_chunk(&chunks[0]);
+        for (i = 0; i < used; i++)
+        {
+            if (i && chunks[i].thread)
+            {
+                pthread_join(chunks[i].thread, NULL);
+                chunks[i].thread = 0;
+            }
+            if (fwrite(chunks[i].text, 1, chunks[i].length, output) != chunks[i].length)
+            {
+                result = -1;
+            }
+        }
+    }
+    for (i = 0; i < threads; i++)
+    {
+        free(chunks[i].text);
+    }
+    free(chunks);
+    return result;
+}
+
+/* Reads all of input into a buffer that has room for a terminator. */
+static char *read_all(FILE *input, size_t *size)
+{
+    size_t capacity = 1 << 16, n;
+    char *data = malloc(capacity), *grown;
+
+    *size = 0;
+    while (data && (n = fread(data + *size, 1, capacity - *size - 1, input)) > 0)
+    {
+        *size += n;
+        if (capacity - *size - 1 == 0)
+        {
+            grown = realloc(data, capacity * 2);
+            if (!grown)
+            {
+                free(data);
+                return NULL;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+    }
+    if (data)
+    {
+        data[*size] = '\0';
+    }
+    return data;
+}
+
+/* Parses the driver's hex input in place of fscanf("%x"): words separated
+ * by white space, each with an optional 0x, up to the first that is not
+ * hex. text must be NUL-terminated. Returns the number of words stored in
+ * words. */
+static size_t parse_hex(const char *text, Word *words)
+{
+    signed char values[256];
+    const unsigned char *p = (const unsigned char *)text;
+    size_t count = 0;
+    Word word;
+    int i;
+
+    // -1 for everything that is not a hex digit
+    memset(values, -1, sizeof(values));
+    for (i = 0; i < 10; i++)
+    {
+        values['0' + i] = i;
+    }
+    for (i = 0; i < 6; i++)
+    {
+        values['a' + i] = values['A' + i] = 10 + i;
+    }
+    for (;;)
+    {
+        while (*p == ' ' || (*p >= '\t' && *p <= '\r'))
+        {
+            p++;
+        }
+        if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+        {
+            p += 2;
+        }
+        if (values[*p] < 0)
+        {
+            return count;
+        }
+        for (word = 0; values[*p] >= 0; p++)
+        {
+            word = word << 4 | values[*p];
+        }
+        words[count++] = word;
+    }
+}
+
+/* Disassembles the executable segments of the image in data. */
+static int disasm_image(const char *data, size_t size, FILE *output, int threads)
+{
+    const ImageHeader *header = (const ImageHeader *)data;
+    const ImageSegment *segment;
+    Word *words;
+    Word i;
+    int result = 0;
+
+    if (size < sizeof(ImageHeader) || header->segment_count > IMAGE_MAX_SEGMENTS)
+    {
+        return -1;
+    }
+    for (i = 0; i < header->segment_count && result == 0; i++)
+    {
+        segment = &header->segments[i];
+        if (!(segment->flags & SEGMENT_EXEC))
+        {
+            continue;
+        }
+        if (segment->offset > size || segment->size > size - segment->offset ||
+            !(words = malloc(segment->size + 4)))
+        {
+            return -1;
+        }
+        memcpy(words, data + segment->offset, segment->size);
+        result = disasm_parallel(words, segment->size / 4, segment->address, output, threads);
+        free(words);
+    }
+    return result;
+}
+
+/* Disassembles all of input to output with threads threads. Hex text and
+ * raw words, when binary is set, start at address; an image has its own
+ * addresses. Returns 0 on success, -1 if input cannot be read or output
+ * written. */
+int disasm_stream(FILE *input, FILE *output, Address address, int binary, int threads)
+{
+    size_t size, count;
+    char *data = read_all(input, &size);
+    Word *words;
+    int result;
+
+    threads = threads < 1 ? 1 : threads;
+    if (!data)
+    {
+        return -1;
+    }
+    if (size >= sizeof(ImageHeader) && !memcmp(data, IMAGE_MAGIC, 4))
+    {
+        result = disasm_image(data, size, output, threads);
+        free(data);
+        return result;
+    }
+    if (binary)
+    {
+        result = disasm_parallel((const Word *)data, size / 4, address, output, threads);
+        free(data);
+        return result;
+    }
+    // a word takes at least two characters of text, so it fits in half
+    words = malloc(sizeof(Word) * (size / 2 + 1));
+    count = words ? parse_hex(data, words) : 0;
+    result = words ? disasm_parallel(words, count, address, output, threads) : -1;
+    free(words);
+    free(data);
+    return result;
+}
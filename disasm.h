@@ -0,0 +1,27 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "types.h"
+
+/* Streaming disassembler. Formats whole runs of words straight into a
+ * buffer, decoding them with the isa.def tables decode_instruction() uses
+ * (see isa.h), and prints exactly the lines -d does:
+ * "<address>: <instruction>". A word -d would stop on, because its opcode
+ * is unknown, gets the same "Invalid Instruction" line as one with a bad
+ * funct3 instead, and the rest of the input still comes out.
+ *
+ * disasm_stream() takes a program image (see image.h), detected by its
+ * magic, raw little-endian words, or the hex text the driver reads. It cuts
+ * the words into chunks of DISASM_CHUNK, formats a batch of them at a time
+ * on separate threads and writes each batch out in order. */
+
+#define DISASM_LINE 64           // longest line, newline included
+#define DISASM_CHUNK (1u << 16)  // words one thread formats at a time
+
+/* see disasm.c */
+size_t disasm_words(const Word *words, size_t count, Address address, char *out);
+int disasm_stream(FILE *input, FILE *output, Address address, int binary, int threads);
+
+#endif
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "types.h"
+#include "disasm.h"
+
+/* Disassembles a whole program the way -d does, see disasm.h:
+ *
+ *   disasm_tool [-b] [-a address] [-n threads] [program]
+ *
+ * program is hex words, or raw little-endian words with -b, placed at
+ * address (0x1000 unless given), or a program image, which carries its own
+ * addresses. Without program it reads stdin. Build it with make disasm_tool.
+ */
+
+int main(int argc, char **argv)
+{
+    Address address = 0x1000;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN), binary = 0, option, result;
+    FILE *input = stdin;
+
+    while ((option = getopt(argc, argv, "ba:n:")) != -1)
+    {
+        switch (option)
+        {
+        case 'b':
+            binary = 1;
+            break;
+        case 'a':
+            address = strtoul(optarg, NULL, 0);
+            break;
+        case 'n':
+            threads = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-b] [-a address] [-n threads] [program]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind < argc - 1 || (optind == argc - 1 && !(input = fopen(argv[optind], "rb"))))
+    {
+        if (optind == argc - 1)
+        {
+            perror(argv[optind]);
+            return 1;
+        }
+        fprintf(stderr, "usage: %s [-b] [-a address] [-n threads] [program]\n", argv[0]);
+        return 2;
+    }
+    // a big buffer, as the tool writes large blocks anyway
+    setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+    result = disasm_stream(input, stdout, address, binary, threads);
+    if (input != stdin)
+    {
+        fclose(input);
+    }
+    if (fflush(stdout) != 0 || result != 0)
+    {
+        fprintf(stderr, "cannot disassemble %s\n", optind < argc ? argv[optind] : "stdin");
+        return 1;
+    }
+    return 0;
+}
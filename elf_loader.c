@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "types.h"
+#include "riscv.h"
+#include "memory.h"
+#include "instance.h"
+#include "disasm.h"
+#include "elf_loader.h"
+
+/* Loader for statically linked ELF32 RISC-V executables. The whole pages of
+ * each PT_LOAD segment are mapped copy-on-write from the file, so the kernel
+ * faults them in on first touch and a large sparse binary costs neither
+ * startup time nor resident memory. Only the partial pages at either end of
+ * a segment, which may be shared with a neighbouring segment, are copied. */
+
+#define PAGE_MASK ((Address)MEMORY_PAGE_SIZE - 1)
+#define ELF_DISASSEMBLY 256 // .text words disassembled at a time
+
+/* Maps the file at path read-only and checks that it is a little-endian
+ * ELF32 RISC-V executable. Returns NULL after reporting the problem. */
+static const Elf32_Ehdr *open_elf(const char *path, int *fd, off_t *size)
+{
+    const Elf32_Ehdr *header;
+    struct stat st;
+
+    *fd = open(path, O_RDONLY);
+    if (*fd < 0)
+    {
+        perror(path);
+        return NULL;
+    }
+    if (fstat(*fd, &st) < 0 || st.st_size < (off_t)sizeof(Elf32_Ehdr))
+    {
+        fprintf(stderr, "%s: not an ELF file\n", path);
+        close(*fd);
+        return NULL;
+    }
+    header = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, *fd, 0);
+    if (header == MAP_FAILED)
+    {
+        perror(path);
+        close(*fd);
+        return NULL;
+    }
+    *size = st.st_size;
+    if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 ||
+        header->e_ident[EI_CLASS] != ELFCLASS32 || header->e_ident[EI_DATA] != ELFDATA2LSB ||
+        header->e_machine != EM_RISCV || header->e_type != ET_EXEC)
+    {
+        fprintf(stderr, "%s: not an ELF32 RISC-V executable\n", path);
+    }
+    else if ((off_t)header->e_phoff + (off_t)header->e_phnum * sizeof(Elf32_Phdr) > st.st_size ||
+             (off_t)header->e_shoff + (off_t)header->e_shnum * sizeof(Elf32_Shdr) > st.st_size)
+    {
+        fprintf(stderr, "%s: truncated ELF file\n", path);
+    }
+    else
+    {
+        return header;
+    }
+    munmap((void *)header, st.st_size);
+    close(*fd);
+    return NULL;
+}
+
+static void close_elf(const Elf32_Ehdr *header, int fd, off_t size)
+{
+    munmap((void *)header, size);
+    close(fd);
+}
+
+static int copy_range(int fd, Byte *memory, Address address, Word size, Elf32_Off offset)
+{
+    Word done = 0;
+    ssize_t n;
+
+    while (done < size)
+    {
+        n = pread(fd, memory + address + done, size - done, offset + done);
+        if (n <= 0)
+        {
+            return 0;
+        }
+        done += n;
+    }
+    return 1;
+}
+
+/* Places the file bytes of one segment in memory. The bss part past
+ * p_filesz is left alone, since guest memory starts out zeroed. */
+static int load_segment(int fd, const Elf32_Phdr *segment, Byte *memory)
+{
+    Address start = segment->p_vaddr;
+    Address end = segment->p_vaddr + segment->p_filesz;
+    Address first = (start + PAGE_MASK) & ~PAGE_MASK;
+    Address last = end & ~PAGE_MASK;
+
+    if (((segment->p_vaddr - segment->p_offset) & PAGE_MASK) ||
+        ((uintptr_t)memory & PAGE_MASK) || first >= last)
+    {
+        return copy_range(fd, memory, start, segment->p_filesz, segment->p_offset);
+    }
+    if (mmap(memory + first, last - first, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             fd, segment->p_offset + (first - start)) == MAP_FAILED)
+    {
+        return 0;
+    }
+    return copy_range(fd, memory, start, first - start, segment->p_offset) &&
+           copy_range(fd, memory, last, end - last, segment->p_offset + (last - start));
+}
+
+/* Loads every PT_LOAD segment of the executable at path into memory, which
+ * should come zeroed from allocate_memory() in memory.c, declares each as
+ * a region with its p_flags rights and stores e_entry. Returns 0 on
+ * success, -1 on error. */
+int load_elf(const char *path, Byte *memory, Address *entry)
+{
+    const Elf32_Ehdr *header;
+    const Elf32_Phdr *segments;
+    off_t size;
+    int fd, ok = 1;
+    Word i;
+
+    header = open_elf(path, &fd, &size);
+    if (!header)
+    {
+        return -1;
+    }
+    segments = (const Elf32_Phdr *)((const Byte *)header + header->e_phoff);
+    for (i = 0; ok && i < header->e_phnum; i++)
+    {
+        if (segments[i].p_type != PT_LOAD)
+        {
+            continue;
+        }
+        if (segments[i].p_filesz > segments[i].p_memsz ||
+            segments[i].p_vaddr > MEMORY_SPACE ||
+            segments[i].p_memsz > MEMORY_SPACE - segments[i].p_vaddr ||
+            (off_t)segments[i].p_offset + segments[i].p_filesz > size)
+        {
+            fprintf(stderr, "%s: segment %u does not fit in memory\n", path, i);
+            ok = 0;
+            break;
+        }
+        memory_commit(memory, segments[i].p_vaddr, segments[i].p_memsz);
+        if (!load_segment(fd, &segments[i], memory))
+        {
+            fprintf(stderr, "%s: cannot read segment %u\n", path, i);
+            ok = 0;
+        }
+        else if (memory_map(memory, segments[i].p_vaddr, segments[i].p_memsz,
+                            ((segments[i].p_flags & PF_R) ? MEMORY_READ : 0) |
+                            ((segments[i].p_flags & PF_W) ? MEMORY_WRITE : 0) |
+                            ((segments[i].p_flags & PF_X) ? MEMORY_EXEC : 0)) != 0)
+        {
+            fprintf(stderr, "%s: too many segments\n", path);
+            ok = 0;
+        }
+    }
+    if (ok)
+    {
+        *entry = header->e_entry;
+    }
+    close_elf(header, fd, size); // the mappings keep the file alive
+    return ok ? 0 : -1;
+}
+
+/* Prints the .text section of the executable at path in the same format
+ * as -d does for hex input. Returns 0 on success, -1 on error. */
+int disassemble_elf(const char *path)
+{
+    const Elf32_Ehdr *header;
+    const Elf32_Shdr *sections;
+    const char *names;
+    const Byte *text = NULL;
+    Address address = 0;
+    Word words[ELF_DISASSEMBLY], i, length = 0, count;
+    char lines[DISASM_LINE * ELF_DISASSEMBLY];
+    off_t size;
+    int fd;
+
+    header = open_elf(path, &fd, &size);
+    if (!header)
+    {
+        return -1;
+    }
+    sections = (const Elf32_Shdr *)((const Byte *)header + header->e_shoff);
+    if (header->e_shstrndx < header->e_shnum &&
+        (off_t)sections[header->e_shstrndx].sh_offset + sections[header->e_shstrndx].sh_size <= size)
+    {
+        names = (const char *)header + sections[header->e_shstrndx].sh_offset;
+        for (i = 0; i < header->e_shnum; i++)
+        {
+            if (sections[i].sh_name < sections[header->e_shstrndx].sh_size &&
+                strcmp(names + sections[i].sh_name, ".text") == 0 &&
+                sections[i].sh_type == SHT_PROGBITS &&
+                (off_t)sections[i].sh_offset + sections[i].sh_size <= size)
+            {
+                text = (const Byte *)header + sections[i].sh_offset;
+                address = sections[i].sh_addr;
+                length = sections[i].sh_size;
+                break;
+            }
+        }
+    }
+    if (!text)
+    {
+        fprintf(stderr, "%s: no .text section\n", path);
+        close_elf(header, fd, size);
+        return -1;
+    }
+    for (i = 0; i + 4 <= length; i += 4 * count)
+    {
+        count = (length - i) / 4 < ELF_DISASSEMBLY ? (length - i) / 4 : ELF_DISASSEMBLY;
+        memcpy(words, text + i, 4 * count);
+        instance_write(lines, disasm_words(words, count, address + i, lines));
+    }
+    close_elf(header, fd, size);
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef ELF_LOADER_H
+#define ELF_LOADER_H
+
+#include "types.h"
+
+/* see elf_loader.c */
+int load_elf(const char *path, Byte *memory, Address *entry);
+int disassemble_elf(const char *path);
+
+#endif
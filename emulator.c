@@ -0,0 +1,639 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include "types.h"
+#include "riscv.h"
+#include "memory.h"
+#include "image.h"
+#include "elf_loader.h"
+#include "instance.h"
+#include "profile.h"
+#include "timing.h"
+#include "cache.h"
+#include "branches.h"
+#include "snapshot.h"
+#include "replay.h"
+#include "debug.h"
+#include "disasm.h"
+#include "emulator.h"
+
+struct Emulator {
+    Instance *instance;
+    Byte *memory;
+    Processor processor;
+    Double steps; // instructions retired
+    unsigned long snapshot_every; // instructions between snapshots, 0 for none
+    char *snapshot_prefix;
+    Recording *recording; // NULL unless recording, see replay.h
+};
+
+#define EMULATOR_DISASSEMBLY 256 // words disassembled at a time
+
+typedef void (*GuardedBody)(Emulator *emulator, Address address, unsigned long count);
+
+/* Returns NULL if out of memory. The registers start as the driver sets
+ * them, with PC at EMULATOR_ENTRY. */
+Emulator *emulator_create(void)
+{
+    Emulator *emulator = calloc(1, sizeof(Emulator));
+
+    if (!emulator)
+    {
+        return NULL;
+    }
+    emulator->instance = instance_create();
+    emulator->memory = allocate_memory();
+    if (!emulator->instance || !emulator->memory)
+    {
+        emulator_destroy(emulator);
+        return NULL;
+    }
+    emulator_reset(emulator, EMULATOR_ENTRY);
+    return emulator;
+}
+
+void emulator_destroy(Emulator *emulator)
+{
+    if (emulator->recording)
+    {
+        recording_stop(emulator, emulator->recording);
+    }
+    if (emulator->instance)
+    {
+        instance_destroy(emulator->instance);
+    }
+    if (emulator->memory)
+    {
+        free_memory(emulator->memory);
+    }
+    free(emulator->snapshot_prefix);
+    free(emulator);
+}
+
+/* Sends the emulator's output to sink, or to stdout when sink is NULL. */
+void emulator_set_output(Emulator *emulator, OutputSink sink, void *context)
+{
+    emulator->instance->sink = sink;
+    emulator->instance->sink_context = context;
+}
+
+/* A sink writing to the FILE * passed as its context. */
+void emulator_output_file(void *file, const char *text, size_t length)
+{
+    fwrite(text, 1, length, file);
+}
+
+void emulator_set_engine(Emulator *emulator, Engine engine)
+{
+    emulator->instance->engine = engine;
+}
+
+/* Prints how often the threaded engine ran each fused sequence (see
+ * fusion.c). Prints nothing unless one ran. */
+void emulator_fusion_report(Emulator *emulator, FILE *output)
+{
+    Instance *previous = current_instance;
+
+    current_instance = emulator->instance;
+    fusion_report(output);
+    current_instance = previous;
+}
+
+/* Prints what the JIT engine compiled and how much of the guest ran
+ * natively (see jit.c). Prints nothing unless it compiled. */
+void emulator_jit_report(Emulator *emulator, FILE *output)
+{
+    Instance *previous = current_instance;
+
+    current_instance = emulator->instance;
+    jit_report(output);
+    current_instance = previous;
+}
+
+/* Turns decoding of RV32C compressed instructions on or off. Off, the
+ * default, a word whose low two bits are not 0b11 is invalid as in RV32IM.
+ * Records decoded under the other setting are dropped. */
+void emulator_set_compressed(Emulator *emulator, int enabled)
+{
+    emulator->instance->compressed = enabled;
+    instance_flush(emulator->instance);
+}
+
+/* Clears the registers and the step count, sets the stack and global
+ * pointers the way the driver does and starts at pc. Memory is left
+ * alone. */
+void emulator_reset(Emulator *emulator, Address pc)
+{
+    memset(&emulator->processor, 0, sizeof(Processor));
+    emulator->steps = 0;
+    emulator->processor.PC = pc;
+    emulator->processor.R[2] = 0xEFFFF;
+    emulator->processor.R[3] = 0x3000;
+}
+
+Processor *emulator_processor(Emulator *emulator)
+{
+    return &emulator->processor;
+}
+
+Byte *emulator_memory(Emulator *emulator)
+{
+    return emulator->memory;
+}
+
+/* Copies size bytes into guest memory regardless of the regions' rights,
+ * as a loader would, and drops whatever was decoded from them. Returns -1
+ * if the range leaves MEMORY_SPACE. */
+int emulator_write(Emulator *emulator, Address address, const void *data, Word size)
+{
+    Instance *previous = current_instance;
+    Address offset;
+
+    if (address >= MEMORY_SPACE || size > MEMORY_SPACE - address)
+    {
+        return -1;
+    }
+    if (emulator->recording)
+    {
+        recording_write(emulator->recording, emulator->steps, address, data, size);
+    }
+    memory_commit(emulator->memory, address, size);
+    memcpy(emulator->memory + address, data, size);
+    current_instance = emulator->instance;
+    for (offset = address & ~(Address)3; offset < address + size; offset += 4)
+    {
+        predecode_invalidate(offset, LENGTH_WORD);
+        jit_invalidate(offset, LENGTH_WORD);
+    }
+    current_instance = previous;
+    return 0;
+}
+
+/* Copies size bytes out of guest memory regardless of the regions' rights.
+ * Pages the guest never touched read as zero and stay uncommitted. Returns
+ * -1 if the range leaves MEMORY_SPACE. */
+int emulator_read(Emulator *emulator, Address address, void *data, Word size)
+{
+    const PageTable *table = page_table(emulator->memory);
+    Byte *out = data;
+    Word chunk;
+
+    if (address >= MEMORY_SPACE || size > MEMORY_SPACE - address)
+    {
+        return -1;
+    }
+    while (size)
+    {
+        chunk = MEMORY_PAGE_SIZE - (address & MEMORY_PAGE_MASK);
+        if (chunk > size)
+        {
+            chunk = size;
+        }
+        if (table->pages[address >> MEMORY_PAGE_SHIFT] & PAGE_COMMITTED)
+        {
+            memcpy(out, emulator->memory + address, chunk);
+        }
+        else
+        {
+            memset(out, 0, chunk);
+        }
+        out += chunk;
+        address += chunk;
+        size -= chunk;
+    }
+    return 0;
+}
+
+/* Writes up to limit hex words from path, one per line as the driver reads
+ * them, starting at address; every word if limit is negative. Returns the
+ * number written, or -1 if path cannot be read. */
+long emulator_load_hex(Emulator *emulator, const char *path, Address address, long limit)
+{
+    FILE *file = fopen(path, "r");
+    Word word;
+    long count = 0;
+
+    if (!file)
+    {
+        return -1;
+    }
+    while ((limit < 0 || count < limit) && fscanf(file, "%x", &word) == 1)
+    {
+        if (emulator_write(emulator, address + 4 * count, &word, 4) != 0)
+        {
+            break;
+        }
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+/* Loads a program image (see image.h) or an ELF executable (see
+ * elf_loader.h) and resets the registers to start at its entry point.
+ * Returns what the loader does: 0 on success, -1 on failure. */
+int emulator_load_image(Emulator *emulator, const char *path)
+{
+    Instance *previous = current_instance;
+    Address entry;
+    int result;
+
+    current_instance = emulator->instance;
+    result = load_image(path, emulator->memory, &entry);
+    instance_flush(emulator->instance);
+    current_instance = previous;
+    if (result == 0)
+    {
+        emulator_reset(emulator, entry);
+    }
+    return result;
+}
+
+int emulator_load_elf(Emulator *emulator, const char *path)
+{
+    Instance *previous = current_instance;
+    Address entry;
+    int result;
+
+    current_instance = emulator->instance;
+    result = load_elf(path, emulator->memory, &entry);
+    instance_flush(emulator->instance);
+    current_instance = previous;
+    if (result == 0)
+    {
+        emulator_reset(emulator, entry);
+    }
+    return result;
+}
+
+/* Runs body on the emulator's instance with a stop point set, so exits
+ * and errors inside it come back here as a StopReason. */
+static StopReason guarded(Emulator *emulator, GuardedBody body, Address address, unsigned long count)
+{
+    Instance *previous = current_instance;
+    jmp_buf stop;
+    StopReason reason = STOP_STEPS;
+
+    current_instance = emulator->instance;
+    emulator->instance->stop = &stop;
+    if (!setjmp(stop))
+    {
+        body(emulator, address, count);
+    }
+    else
+    {
+        reason = emulator->instance->reason;
+    }
+    emulator->instance->stop = NULL;
+    current_instance = previous;
+    return reason;
+}
+
+static void run_body(Emulator *emulator, Address address, unsigned long count)
+{
+    emulator->steps += execute_steps(&emulator->processor, emulator->memory, count);
+}
+
+static void disassemble_body(Emulator *emulator, Address address, unsigned long count)
+{
+    Word words[EMULATOR_DISASSEMBLY];
+    char text[DISASM_LINE * EMULATOR_DISASSEMBLY];
+    unsigned long i, n;
+
+    for (; count; count -= n, address += 4 * n)
+    {
+        n = count < EMULATOR_DISASSEMBLY ? count : EMULATOR_DISASSEMBLY;
+        for (i = 0; i < n; i++)
+        {
+            words[i] = load(emulator->memory, address + 4 * i, LENGTH_WORD);
+        }
+        instance_write(text, disasm_words(words, n, address, text));
+    }
+}
+
+/* Executes up to steps instructions. Returns STOP_STEPS when all of them
+ * ran; otherwise PC is left at the instruction that stopped the run, or
+ * after the one that touched a watchpoint. A breakpoint at the PC a run
+ * starts from does not stop it. With
+ * periodic snapshots the run pauses at every multiple of the interval to
+ * take one. */
+StopReason emulator_run(Emulator *emulator, unsigned long steps)
+{
+    StopReason reason = STOP_STEPS;
+    unsigned long chunk, until;
+    char *path;
+
+    if (emulator->recording)
+    {
+        recording_run(emulator->recording, emulator->steps, &emulator->processor);
+    }
+    if (emulator->instance->debug)
+    {
+        // resuming from a breakpoint runs it
+        emulator->instance->debug->step_over = emulator->processor.PC;
+    }
+    while (reason == STOP_STEPS && steps)
+    {
+        chunk = steps;
+        if (emulator->snapshot_every)
+        {
+            until = emulator->snapshot_every - emulator->steps % emulator->snapshot_every;
+            chunk = chunk < until ? chunk : until;
+        }
+        reason = guarded(emulator, run_body, 0, chunk);
+        if (reason != STOP_STEPS)
+        {
+            // the stop skipped run_body's count
+            emulator->steps += chunk - emulator->instance->left;
+        }
+        steps -= chunk;
+        if (reason != STOP_STEPS || !emulator->snapshot_every ||
+            emulator->steps % emulator->snapshot_every)
+        {
+            continue;
+        }
+        path = malloc(strlen(emulator->snapshot_prefix) + 24);
+        if (!path)
+        {
+            return STOP_SNAPSHOT;
+        }
+        sprintf(path, "%s.%llu", emulator->snapshot_prefix, (unsigned long long)emulator->steps);
+        if (emulator_save_snapshot(emulator, path) != 0)
+        {
+            reason = STOP_SNAPSHOT;
+        }
+        free(path);
+    }
+    if (emulator->recording)
+    {
+        recording_ran(emulator->recording, &emulator->processor);
+    }
+    return reason;
+}
+
+/* Prints count words starting at address the way the driver's -d does,
+ * except that a word with an unknown opcode is reported and passed over
+ * rather than ending the listing, see disasm.h. */
+StopReason emulator_disassemble(Emulator *emulator, Address address, Word count)
+{
+    return guarded(emulator, disassemble_body, address, count);
+}
+
+/* The status the program exited with, or the error status of the stop. */
+int emulator_exit_status(const Emulator *emulator)
+{
+    return emulator->instance->status;
+}
+
+/* Starts or stops counting every instruction the emulator runs, see
+ * profile.h. Profiled runs use the handler loop whatever the engine.
+ * Starting drops the collected counts of an earlier profile only if it was
+ * stopped. Returns -1 if out of memory. */
+int emulator_set_profiling(Emulator *emulator, int enabled)
+{
+    Instance *previous = current_instance;
+    int result = 0;
+
+    current_instance = emulator->instance;
+    if (enabled)
+    {
+        result = profile_start();
+    }
+    else
+    {
+        profile_stop();
+    }
+    current_instance = previous;
+    return result;
+}
+
+/* Prints the profile collected so far, with the hot most executed
+ * instructions. Prints nothing unless profiling. */
+void emulator_profile_report(Emulator *emulator, FILE *output, unsigned hot)
+{
+    Instance *previous = current_instance;
+
+    current_instance = emulator->instance;
+    profile_report(output, hot);
+    current_instance = previous;
+}
+
+/* Starts the timing model (see timing.h) with config, or the defaults if
+ * it is NULL, or stops it. Like profiling, it runs on the handlers. Returns
+ * -1 if config is unusable or out of memory. */
+int emulator_set_timing(Emulator *emulator, int enabled, const TimingConfig *config)
+{
+    Instance *previous = current_instance;
+    int result = 0;
+
+    current_instance = emulator->instance;
+    if (enabled)
+    {
+        result = timing_start(config);
+    }
+    else
+    {
+        timing_stop();
+    }
+    current_instance = previous;
+    return result;
+}
+
+/* Gives the words from base to base + size their own line in the timing
+ * report. Returns -1 unless the model runs or if there are too many. */
+int emulator_timing_region(Emulator *emulator, const char *name, Address base, Word size)
+{
+    Instance *previous = current_instance;
+    int result;
+
+    current_instance = emulator->instance;
+    result = timing_region(name, base, size);
+    current_instance = previous;
+    return result;
+}
+
+void emulator_timing_report(Emulator *emulator, FILE *output)
+{
+    Instance *previous = current_instance;
+
+    current_instance = emulator->instance;
+    timing_report(output);
+    current_instance = previous;
+}
+
+/* Starts simulating caches (see cache.h) configured by config, or the
+ * defaults if it is NULL, or stops. Like profiling, it runs on the
+ * handlers. Returns -1 if config is unusable or out of memory. */
+int emulator_set_caches(Emulator *emulator, int enabled, const CacheHierarchyConfig *config)
+{
+    Instance *previous = current_instance;
+    int result = 0;
+
+    current_instance = emulator->instance;
+    if (enabled)
+    {
+        result = cache_start(config);
+    }
+    else
+    {
+        cache_stop();
+    }
+    current_instance = previous;
+    return result;
+}
+
+void emulator_cache_report(Emulator *emulator, FILE *output, unsigned worst)
+{
+    Instance *previous = current_instance;
+
+    current_instance = emulator->instance;
+    cache_report(output, worst);
+    current_instance = previous;
+}
+
+/* Starts running the predictors in the mask predictors (see branches.h)
+ * over the branches, writing outcomes to bitstream unless it is NULL, or
+ * stops and writes out the last outcomes. Like profiling, it runs on the
+ * handlers. Returns -1 if no predictor is set or out of memory. */
+int emulator_set_branches(Emulator *emulator, int enabled, unsigned predictors, FILE *bitstream)
+{
+    Instance *previous = current_instance;
+    int result = 0;
+
+    current_instance = emulator->instance;
+    if (enabled)
+    {
+        result = branches_start(predictors, bitstream);
+    }
+    else
+    {
+        branches_stop();
+    }
+    current_instance = previous;
+    return result;
+}
+
+void emulator_branch_report(Emulator *emulator, FILE *output, unsigned worst)
+{
+    Instance *previous = current_instance;
+
+    current_instance = emulator->instance;
+    branches_report(output, worst);
+    current_instance = previous;
+}
+
+/* Instructions retired so far, or since the snapshot last restored. A
+ * stopped run counts those before the one that stopped it, and the one
+ * that touched a watchpoint. */
+Double emulator_steps(const Emulator *emulator)
+{
+    return emulator->steps;
+}
+
+/* Saves the registers, guest memory and step count to path, see
+ * snapshot.h. Returns -1 if it cannot be written. */
+int emulator_save_snapshot(Emulator *emulator, const char *path)
+{
+    return snapshot_save(path, &emulator->processor, emulator->memory, emulator->steps);
+}
+
+/* Replaces the registers, guest memory and step count with the snapshot at
+ * path and drops everything decoded from the old memory. Output, engine
+ * and side models stay as they are. Returns -1, with the emulator
+ * unchanged, if path is not a usable snapshot. */
+int emulator_restore_snapshot(Emulator *emulator, const char *path)
+{
+    Instance *previous = current_instance;
+    int result;
+
+    current_instance = emulator->instance;
+    result = snapshot_restore(path, &emulator->processor, emulator->memory, &emulator->steps);
+    instance_flush(emulator->instance);
+    current_instance = previous;
+    return result;
+}
+
+/* Makes runs save a snapshot to prefix.<steps> whenever the step count
+ * reaches a multiple of every, or stops that when every is 0. Returns -1
+ * if out of memory. */
+int emulator_set_snapshots(Emulator *emulator, unsigned long every, const char *prefix)
+{
+    char *copy = NULL;
+
+    if (every && !(copy = strdup(prefix)))
+    {
+        return -1;
+    }
+    free(emulator->snapshot_prefix);
+    emulator->snapshot_prefix = copy;
+    emulator->snapshot_every = every;
+    return 0;
+}
+
+/* Starts recording runs into directory, see replay.h, with a checkpoint
+ * every interval steps, or stops recording when directory is NULL. A
+ * recording already running is stopped first. Returns -1 if the directory
+ * cannot be written. */
+int emulator_record(Emulator *emulator, const char *directory, unsigned long interval)
+{
+    if (emulator->recording)
+    {
+        recording_stop(emulator, emulator->recording);
+        emulator->recording = NULL;
+    }
+    if (!directory)
+    {
+        return 0;
+    }
+    emulator->recording = recording_start(emulator, directory, interval);
+    return emulator->recording ? 0 : -1;
+}
+
+/* Sets or clears a software breakpoint at pc, see debug.h. Runs stop with
+ * STOP_BREAKPOINT before executing it. Returns -1 if out of memory. */
+int emulator_set_breakpoint(Emulator *emulator, Address pc, int enabled)
+{
+    Instance *previous = current_instance;
+    int result;
+
+    current_instance = emulator->instance;
+    result = debug_set_breakpoint(pc, enabled);
+    current_instance = previous;
+    return result;
+}
+
+/* Whether pc has a breakpoint. A run that reaches it with its last step
+ * ends with STOP_STEPS, and the next one would start there and run it,
+ * so code running in chunks checks this in between. */
+int emulator_breakpoint(const Emulator *emulator, Address pc)
+{
+    return emulator->instance->debug && debug_breakpoint(emulator->instance->debug, pc);
+}
+
+/* Sets or clears a watchpoint on length bytes at address. Runs stop with
+ * STOP_WATCHPOINT after a load or store of kind touches them. Returns -1
+ * if the watchpoints are all taken, or when clearing one that is not set. */
+int emulator_set_watchpoint(Emulator *emulator, Address address, Word length, WatchKind kind, int enabled)
+{
+    Instance *previous = current_instance;
+    int result;
+
+    current_instance = emulator->instance;
+    result = debug_set_watchpoint(address, length, kind, enabled);
+    current_instance = previous;
+    return result;
+}
+
+/* The data address of the access that last stopped a run at a watchpoint,
+ * and the kind of that watchpoint if kind is not NULL. */
+Address emulator_watch_hit(const Emulator *emulator, WatchKind *kind)
+{
+    const Debug *debug = emulator->instance->debug;
+
+    if (kind)
+    {
+        *kind = debug ? debug->hit_kind : WATCH_ACCESS;
+    }
+    return debug ? debug->hit : 0;
+}
@@ -0,0 +1,90 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "types.h"
+#include "riscv.h"
+
+/* Embedding interface. An Emulator owns a Processor, guest memory and the
+ * state the engines keep, so any number of them can live in one process
+ * and run on different threads. Nothing here exits the process: runs end
+ * with a StopReason, and everything the guest or the disassembler prints
+ * goes to the emulator's output sink. make libriscv.a builds the library
+ * from every source but riscv.c and the tools, see Makefile. */
+
+#define EMULATOR_ENTRY 0x1000 // where the driver loads and starts hex programs
+
+typedef struct Emulator Emulator;
+typedef struct TimingConfig TimingConfig; // see timing.h
+typedef struct CacheHierarchyConfig CacheHierarchyConfig; // see cache.h
+
+typedef enum {
+    STOP_STEPS,               // ran the requested number of steps
+    STOP_EXIT,                // the program made the exit ecall
+    STOP_INVALID_INSTRUCTION, // PC reached a word that does not decode
+    STOP_INVALID_READ,        // a load or fetch outside what memory allows
+    STOP_INVALID_WRITE,       // a store outside what memory allows
+    STOP_INVALID_ECALL,       // an ecall number the emulator does not know
+    STOP_SNAPSHOT,            // a periodic snapshot could not be written or replay found no checkpoint
+    STOP_BREAKPOINT,          // PC reached a breakpoint, which has not run
+    STOP_WATCHPOINT,          // the instruction before PC touched a watched range
+} StopReason;
+
+typedef enum {
+    WATCH_WRITE = 1,  // stores into the range
+    WATCH_READ = 2,   // loads from it
+    WATCH_ACCESS = 3, // either
+} WatchKind;
+
+/* Receives length bytes of output. The text is not NUL-terminated. */
+typedef void (*OutputSink)(void *context, const char *text, size_t length);
+
+/* see emulator.c */
+Emulator *emulator_create(void);
+void emulator_destroy(Emulator *emulator);
+void emulator_set_output(Emulator *emulator, OutputSink sink, void *context);
+void emulator_output_file(void *file, const char *text, size_t length);
+void emulator_set_engine(Emulator *emulator, Engine engine);
+void emulator_set_compressed(Emulator *emulator, int enabled);
+void emulator_fusion_report(Emulator *emulator, FILE *output);
+void emulator_jit_report(Emulator *emulator, FILE *output);
+void emulator_reset(Emulator *emulator, Address pc);
+
+Processor *emulator_processor(Emulator *emulator);
+Byte *emulator_memory(Emulator *emulator);
+int emulator_write(Emulator *emulator, Address address, const void *data, Word size);
+int emulator_read(Emulator *emulator, Address address, void *data, Word size);
+long emulator_load_hex(Emulator *emulator, const char *path, Address address, long limit);
+int emulator_load_image(Emulator *emulator, const char *path);
+int emulator_load_elf(Emulator *emulator, const char *path);
+
+StopReason emulator_run(Emulator *emulator, unsigned long steps);
+StopReason emulator_disassemble(Emulator *emulator, Address address, Word count);
+int emulator_exit_status(const Emulator *emulator);
+Double emulator_steps(const Emulator *emulator);
+
+int emulator_save_snapshot(Emulator *emulator, const char *path);
+int emulator_restore_snapshot(Emulator *emulator, const char *path);
+int emulator_set_snapshots(Emulator *emulator, unsigned long every, const char *prefix);
+int emulator_record(Emulator *emulator, const char *directory, unsigned long interval);
+
+int emulator_set_breakpoint(Emulator *emulator, Address pc, int enabled);
+int emulator_breakpoint(const Emulator *emulator, Address pc);
+int emulator_set_watchpoint(Emulator *emulator, Address address, Word length, WatchKind kind, int enabled);
+Address emulator_watch_hit(const Emulator *emulator, WatchKind *kind);
+
+int emulator_set_profiling(Emulator *emulator, int enabled);
+void emulator_profile_report(Emulator *emulator, FILE *output, unsigned hot);
+
+int emulator_set_timing(Emulator *emulator, int enabled, const TimingConfig *config);
+int emulator_timing_region(Emulator *emulator, const char *name, Address base, Word size);
+void emulator_timing_report(Emulator *emulator, FILE *output);
+
+int emulator_set_caches(Emulator *emulator, int enabled, const CacheHierarchyConfig *config);
+void emulator_cache_report(Emulator *emulator, FILE *output, unsigned worst);
+
+int emulator_set_branches(Emulator *emulator, int enabled, unsigned predictors, FILE *bitstream);
+void emulator_branch_report(Emulator *emulator, FILE *output, unsigned worst);
+
+#endif
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include "types.h"
+#include "riscv.h"
+#include "predecode.h"
+#include "memory.h"
+#include "instance.h"
+
+/* Superinstruction selection for the threaded engine. When a record is
+ * first dispatched, the instructions after it are checked against a few hot
+ * sequences; a match makes the record jump to fused code that runs the
+ * whole sequence in one dispatch. Fused code falls back to the single
+ * instruction when fewer steps are left than the sequence is long, so a
+ * single-stepped -r run never observes a fused state.
+ *
+ * Every instruction whose result feeds the next one must write a register
+ * other than x0, since in a sequential run x0 is cleared in between. */
+
+static const char *fusion_names[FUSION_COUNT] = {
+    [FUSE_NONE] = "none",
+    [FUSE_LUI_ADDI] = "lui+addi",
+    [FUSE_ADDI_BNE] = "addi+bne",
+    [FUSE_SLLI_ADD] = "slli+add",
+    [FUSE_ADDI_SLLI_ADD] = "addi+slli+add",
+};
+
+static const unsigned fusion_lengths[FUSION_COUNT] = {
+    [FUSE_NONE] = 1,
+    [FUSE_LUI_ADDI] = 2,
+    [FUSE_ADDI_BNE] = 2,
+    [FUSE_SLLI_ADD] = 2,
+    [FUSE_ADDI_SLLI_ADD] = 3,
+};
+
+/* The decoded record for pc, or NULL when it is not cacheable, not
+ * executable or its word cannot be decoded ahead of execution. */
+static const DecodedInstruction *decoded_at(Address pc, Byte *memory)
+{
+    Word bits;
+
+    if ((pc & 0x1) || pc >= MEMORY_SPACE)
+    {
+        return NULL;
+    }
+    if (current_instance->predecode_cache[pc >> 1].handler)
+    {
+        return &current_instance->predecode_cache[pc >> 1];
+    }
+    if (!memory_fetch_pointer(memory, pc))
+    {
+        return NULL;
+    }
+    bits = fetch(memory, pc);
+    if (!predecodable(bits))
+    {
+        return NULL;
+    }
+    return predecode_lookup(pc, bits);
+}
+
+static int reads(const DecodedInstruction *d, Byte r)
+{
+    return d->rs1 == r || d->rs2 == r;
+}
+
+/* Picks the fusion for the cached record of pc. */
+Fusion fuse(const DecodedInstruction *decoded, Address pc, Byte *memory)
+{
+    const DecodedInstruction *second, *third;
+
+    if (decoded->rd == 0)
+    {
+        return FUSE_NONE;
+    }
+    switch (decoded->op)
+    {
+    case OP_LUI:
+    case OP_ADDI:
+    case OP_SLLI:
+        break;
+    default:
+        return FUSE_NONE;
+    }
+    second = decoded_at(pc + decoded->length, memory);
+    if (!second)
+    {
+        return FUSE_NONE;
+    }
+
+    if (decoded->op == OP_LUI && second->op == OP_ADDI && second->rs1 == decoded->rd)
+    {
+        return FUSE_LUI_ADDI;
+    }
+    if (decoded->op == OP_SLLI && second->op == OP_ADD && reads(second, decoded->rd))
+    {
+        return FUSE_SLLI_ADD;
+    }
+    if (decoded->op != OP_ADDI)
+    {
+        return FUSE_NONE;
+    }
+    if (second->op == OP_BNE && reads(second, decoded->rd))
+    {
+        return FUSE_ADDI_BNE;
+    }
+    if (second->op == OP_SLLI && second->rs1 == decoded->rd && second->rd != 0)
+    {
+        third = decoded_at(pc + decoded->length + second->length, memory);
+        if (third && third->op == OP_ADD && reads(third, second->rd))
+        {
+            return FUSE_ADDI_SLLI_ADD;
+        }
+    }
+    return FUSE_NONE;
+}
+
+/* Prints the hits of the current instance's fusions to output, or nothing
+ * if none fired. */
+void fusion_report(FILE *output)
+{
+    const unsigned long *fusion_hits = current_instance->fusion_hits;
+    unsigned long total = 0;
+    unsigned i;
+
+    for (i = FUSE_NONE + 1; i < FUSION_COUNT; i++)
+    {
+        total += fusion_hits[i];
+    }
+    if (total == 0)
+    {
+        return;
+    }
+    for (i = FUSE_NONE + 1; i < FUSION_COUNT; i++)
+    {
+        fprintf(output, "fusion: %-14s %lu hits, %lu instructions\n", fusion_names[i],
+                fusion_hits[i], fusion_hits[i] * fusion_lengths[i]);
+    }
+}
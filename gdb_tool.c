@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "types.h"
+#include "emulator.h"
+#include "gdbstub.h"
+
+/* Serves one program to gdb, see gdbstub.h:
+ *
+ *   gdb_tool [-e | -i] program address
+ *
+ * program is hex words loaded at EMULATOR_ENTRY like the driver's, or with
+ * -e an ELF executable and with -i a program image. Its output goes to
+ * stdout. Build it with make gdb_tool. */
+
+int main(int argc, char **argv)
+{
+    Emulator *emulator;
+    int option, format = 'x', loaded, served;
+
+    while ((option = getopt(argc, argv, "ei")) != -1)
+    {
+        if (option != 'e' && option != 'i')
+        {
+            fprintf(stderr, "usage: %s [-e | -i] program address\n", argv[0]);
+            return 2;
+        }
+        format = option;
+    }
+    if (optind != argc - 2)
+    {
+        fprintf(stderr, "usage: %s [-e | -i] program address\n", argv[0]);
+        return 2;
+    }
+    if (!(emulator = emulator_create()))
+    {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    loaded = format == 'e' ? emulator_load_elf(emulator, argv[optind]) :
+             format == 'i' ? emulator_load_image(emulator, argv[optind]) :
+             emulator_load_hex(emulator, argv[optind], EMULATOR_ENTRY, -1) < 0 ? -1 : 0;
+    if (loaded != 0)
+    {
+        fprintf(stderr, "cannot load %s\n", argv[optind]);
+        emulator_destroy(emulator);
+        return 1;
+    }
+    fprintf(stderr, "waiting for gdb on %s\n", argv[optind + 1]);
+    served = gdb_serve(emulator, argv[optind + 1]);
+    emulator_destroy(emulator);
+    return served == 0 ? 0 : 1;
+}
@@ -0,0 +1,595 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "types.h"
+#include "emulator.h"
+#include "gdbstub.h"
+
+/* Serves the GDB remote serial protocol, see gdbstub.h. */
+
+#define GDB_SIGINT 2
+#define GDB_SIGILL 4
+#define GDB_SIGTRAP 5
+#define GDB_SIGSEGV 11
+
+typedef struct {
+    int fd;
+    Emulator *emulator;
+    char input[GDB_PACKET_SIZE]; // bytes read but not yet used
+    int input_start;
+    int input_end;
+    char packet[GDB_PACKET_SIZE + 1]; // payload of the last packet, NUL-terminated
+    char reply[GDB_PACKET_SIZE];
+    int interrupted; // ctrl-c arrived
+    int signal;      // the last stop's, for '?'
+    int done;
+} Session;
+
+static const char *const register_names[] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "fp", "s1", "a0",
+    "a1", "a2", "a3", "a4", "a5", "a6", "a7", "s2", "s3", "s4", "s5",
+    "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+};
+
+static int hex_value(int c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/* Reads a hex number at *text and moves past it. */
+static Word parse_hex(const char **text)
+{
+    Word value = 0;
+
+    for (; hex_value(**text) >= 0; (*text)++)
+    {
+        value = value << 4 | hex_value(**text);
+    }
+    return value;
+}
+
+/* Reads a register value, which gdb sends as target-order bytes. */
+static Word parse_register(const char **text)
+{
+    Word value = 0;
+    int i;
+
+    for (i = 0; i < 4 && hex_value((*text)[0]) >= 0 && hex_value((*text)[1]) >= 0; i++, *text += 2)
+    {
+        value |= (Word)(hex_value((*text)[0]) << 4 | hex_value((*text)[1])) << (8 * i);
+    }
+    return value;
+}
+
+static char *format_register(char *out, Word value)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+    {
+        out += sprintf(out, "%02x", (value >> (8 * i)) & 0xFF);
+    }
+    return out;
+}
+
+static int next_byte(Session *session)
+{
+    ssize_t n;
+
+    if (session->input_start == session->input_end)
+    {
+        while ((n = read(session->fd, session->input, sizeof(session->input))) < 0 && errno == EINTR)
+        {
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        session->input_start = 0;
+        session->input_end = n;
+    }
+    return (unsigned char)session->input[session->input_start++];
+}
+
+static int write_all(int fd, const char *data, size_t length)
+{
+    ssize_t n;
+
+    while (length)
+    {
+        if ((n = write(fd, data, length)) < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+/* Sends text as a packet, again each time the debugger naks it. */
+static int send_packet(Session *session, const char *text)
+{
+    char frame[GDB_PACKET_SIZE + 4];
+    size_t length = strlen(text), i;
+    Byte sum = 0;
+    int c;
+
+    frame[0] = '$';
+    memcpy(frame + 1, text, length);
+    for (i = 0; i < length; i++)
+    {
+        sum += (Byte)text[i];
+    }
+    sprintf(frame + 1 + length, "#%02x", sum);
+    for (;;)
+    {
+        if (write_all(session->fd, frame, length + 4) != 0)
+        {
+            return -1;
+        }
+        while ((c = next_byte(session)) != '+' && c != '-')
+        {
+            if (c < 0)
+            {
+                return -1;
+            }
+            session->interrupted |= c == 0x03;
+        }
+        if (c == '+')
+        {
+            return 0;
+        }
+    }
+}
+
+/* Reads the next packet into session->packet and acknowledges it, asking
+ * for it again while its checksum is wrong. Returns its length, or -1
+ * once the connection closes. */
+static int receive_packet(Session *session)
+{
+    int c, high, low, length;
+    Byte sum;
+
+    for (;;)
+    {
+        while ((c = next_byte(session)) != '$')
+        {
+            if (c < 0)
+            {
+                return -1;
+            }
+            session->interrupted |= c == 0x03;
+        }
+        for (sum = 0, length = 0; (c = next_byte(session)) >= 0 && c != '#'; sum += (Byte)c)
+        {
+            if (length < GDB_PACKET_SIZE)
+            {
+                session->packet[length++] = c;
+            }
+        }
+        if (c < 0 || (high = next_byte(session)) < 0 || (low = next_byte(session)) < 0)
+        {
+            return -1;
+        }
+        if (length < GDB_PACKET_SIZE && hex_value(high) >= 0 && hex_value(low) >= 0 &&
+            (hex_value(high) << 4 | hex_value(low)) == sum)
+        {
+            session->packet[length] = '\0';
+            return write_all(session->fd, "+", 1) == 0 ? length : -1;
+        }
+        if (write_all(session->fd, "-", 1) != 0)
+        {
+            return -1;
+        }
+    }
+}
+
+/* Runs one step, or until something stops the emulator or ctrl-c
+ * arrives. */
+static StopReason resume(Session *session, int step)
+{
+    struct pollfd pending = {session->fd, POLLIN, 0};
+    Emulator *emulator = session->emulator;
+    StopReason reason;
+    int c;
+
+    session->interrupted = 0;
+    if (step)
+    {
+        return emulator_run(emulator, 1);
+    }
+    for (;;)
+    {
+        reason = emulator_run(emulator, GDB_CHUNK);
+        if (reason != STOP_STEPS)
+        {
+            return reason;
+        }
+        // the next run would start on the breakpoint and so run through it
+        if (emulator_breakpoint(emulator, emulator_processor(emulator)->PC))
+        {
+            return STOP_BREAKPOINT;
+        }
+        if (session->input_start < session->input_end || poll(&pending, 1, 0) > 0)
+        {
+            // nothing but ctrl-c is sent while the target runs
+            if ((c = next_byte(session)) < 0 || c == 0x03)
+            {
+                session->interrupted = 1;
+                return STOP_STEPS;
+            }
+        }
+    }
+}
+
+static void stop_reply(Session *session, StopReason reason)
+{
+    WatchKind kind;
+    Address address;
+
+    switch (reason)
+    {
+    case STOP_EXIT:
+        sprintf(session->reply, "W%02x", emulator_exit_status(session->emulator) & 0xFF);
+        return;
+    case STOP_WATCHPOINT:
+        address = emulator_watch_hit(session->emulator, &kind);
+        session->signal = GDB_SIGTRAP;
+        sprintf(session->reply, "T%02x%s:%x;", GDB_SIGTRAP,
+                kind == WATCH_WRITE ? "watch" : kind == WATCH_READ ? "rwatch" : "awatch", address);
+        return;
+    case STOP_INVALID_INSTRUCTION:
+    case STOP_INVALID_ECALL:
+        session->signal = GDB_SIGILL;
+        break;
+    case STOP_INVALID_READ:
+    case STOP_INVALID_WRITE:
+        session->signal = GDB_SIGSEGV;
+        break;
+    default:
+        session->signal = session->interrupted ? GDB_SIGINT : GDB_SIGTRAP;
+        break;
+    }
+    sprintf(session->reply, "S%02x", session->signal);
+}
+
+/* Serves the qXfer target description, which tells gdb the registers are
+ * rv32 ones without it being set by hand. */
+static void target_description(Session *session, const char *request)
+{
+    static char xml[4096];
+    Word offset, length, size;
+    char *out = xml;
+    int i;
+
+    if (!xml[0])
+    {
+        out += sprintf(out, "<?xml version=\"1.0\"?><!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+                            "<target version=\"1.0\"><architecture>riscv:rv32</architecture>"
+                            "<feature name=\"org.gnu.gdb.riscv.cpu\">");
+        for (i = 0; i < 32; i++)
+        {
+            out += sprintf(out, "<reg name=\"%s\" bitsize=\"32\" type=\"%s\"/>", register_names[i],
+                           i == 1 ? "code_ptr" : i == 2 ? "data_ptr" : "int");
+        }
+        sprintf(out, "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/></feature></target>");
+    }
+    offset = parse_hex(&request);
+    request += *request == ',';
+    length = parse_hex(&request);
+    size = strlen(xml);
+    offset = offset < size ? offset : size;
+    length = length < sizeof(session->reply) - 2 ? length : sizeof(session->reply) - 2;
+    length = length < size - offset ? length : size - offset;
+    session->reply[0] = offset + length < size ? 'm' : 'l';
+    memcpy(session->reply + 1, xml + offset, length);
+    session->reply[1 + length] = '\0';
+}
+
+static void query(Session *session, const char *packet)
+{
+    if (!strncmp(packet, "qSupported", 10))
+    {
+        sprintf(session->reply, "PacketSize=%x;qXfer:features:read+", GDB_PACKET_SIZE);
+    }
+    else if (!strncmp(packet, "qXfer:features:read:target.xml:", 31))
+    {
+        target_description(session, packet + 31);
+    }
+    else if (!strcmp(packet, "qAttached"))
+    {
+        strcpy(session->reply, "1");
+    }
+    else if (!strcmp(packet, "qC"))
+    {
+        strcpy(session->reply, "QC1");
+    }
+    else if (!strcmp(packet, "qfThreadInfo"))
+    {
+        strcpy(session->reply, "m1");
+    }
+    else if (!strcmp(packet, "qsThreadInfo"))
+    {
+        strcpy(session->reply, "l");
+    }
+}
+
+/* Reads or writes memory for an m or M packet. */
+static void memory_packet(Session *session, const char *packet)
+{
+    Byte data[GDB_PACKET_SIZE / 2];
+    Address address = parse_hex(&packet);
+    Word length, i;
+    char *out = session->reply;
+
+    packet += *packet == ',';
+    length = parse_hex(&packet);
+    if (length > sizeof(data) - 1)
+    {
+        length = sizeof(data) - 1;
+    }
+    if (session->packet[0] == 'm')
+    {
+        if (emulator_read(session->emulator, address, data, length) != 0)
+        {
+            strcpy(session->reply, "E01");
+            return;
+        }
+        for (i = 0; i < length; i++)
+        {
+            out += sprintf(out, "%02x", data[i]);
+        }
+        return;
+    }
+    for (i = 0, packet += *packet == ':'; i < length && hex_value(packet[0]) >= 0 && hex_value(packet[1]) >= 0;
+         i++, packet += 2)
+    {
+        data[i] = hex_value(packet[0]) << 4 | hex_value(packet[1]);
+    }
+    strcpy(session->reply, i == length && emulator_write(session->emulator, address, data, length) == 0 ?
+                               "OK" : "E01");
+}
+
+/* Sets or clears a breakpoint or watchpoint for a Z or z packet. */
+static void point_packet(Session *session, const char *packet)
+{
+    static const WatchKind kinds[] = {WATCH_WRITE, WATCH_READ, WATCH_ACCESS};
+    int enabled = packet[0] == 'Z', type = packet[1] - '0', result = -1;
+    Address address;
+    Word length;
+
+    packet += 2;
+    packet += *packet == ',';
+    address = parse_hex(&packet);
+    packet += *packet == ',';
+    length = parse_hex(&packet);
+    if (type == 0 || type == 1)
+    {
+        result = emulator_set_breakpoint(session->emulator, address, enabled);
+    }
+    else if (type >= 2 && type <= 4)
+    {
+        result = emulator_set_watchpoint(session->emulator, address, length, kinds[type - 2], enabled);
+    }
+    else
+    {
+        return; // unsupported, so an empty reply
+    }
+    strcpy(session->reply, result == 0 ? "OK" : "E01");
+}
+
+/* Handles session->packet, leaving the reply in session->reply. Returns
+ * -1 if nothing is to be sent back. */
+static int handle(Session *session)
+{
+    Processor *processor = emulator_processor(session->emulator);
+    const char *packet = session->packet + 1;
+    char *out = session->reply;
+    Word number;
+    int i;
+
+    session->reply[0] = '\0';
+    switch (session->packet[0])
+    {
+    case '?':
+        sprintf(session->reply, "S%02x", session->signal);
+        break;
+    case 'g':
+        for (i = 0; i < 32; i++)
+        {
+            out = format_register(out, processor->R[i]);
+        }
+        format_register(out, processor->PC);
+        break;
+    case 'G':
+        for (i = 0; i < 32; i++)
+        {
+            processor->R[i] = parse_register(&packet);
+        }
+        processor->PC = parse_register(&packet);
+        processor->R[0] = 0;
+        strcpy(session->reply, "OK");
+        break;
+    case 'p':
+        number = parse_hex(&packet);
+        if (number > 32)
+        {
+            strcpy(session->reply, "E01");
+            break;
+        }
+        format_register(out, number == 32 ? processor->PC : processor->R[number]);
+        break;
+    case 'P':
+        number = parse_hex(&packet);
+        packet += *packet == '=';
+        if (number > 32)
+        {
+            strcpy(session->reply, "E01");
+            break;
+        }
+        if (number == 32)
+        {
+            processor->PC = parse_register(&packet);
+        }
+        else if (number)
+        {
+            processor->R[number] = parse_register(&packet);
+        }
+        strcpy(session->reply, "OK");
+        break;
+    case 'm':
+    case 'M':
+        memory_packet(session, packet);
+        break;
+    case 'c':
+    case 's':
+        if (hex_value(*packet) >= 0)
+        {
+            processor->PC = parse_hex(&packet);
+        }
+        stop_reply(session, resume(session, session->packet[0] == 's'));
+        break;
+    case 'Z':
+    case 'z':
+        point_packet(session, session->packet);
+        break;
+    case 'H':
+    case 'T':
+        strcpy(session->reply, "OK");
+        break;
+    case 'q':
+        query(session, session->packet);
+        break;
+    case 'D':
+        strcpy(session->reply, "OK");
+        session->done = 1;
+        break;
+    case 'k':
+        session->done = 1;
+        return -1;
+    }
+    return 0;
+}
+
+/* Binds a listening socket to address, see gdbstub.h. */
+static int listen_on(const char *address)
+{
+    struct sockaddr_un local;
+    struct sockaddr_in inet;
+    const char *colon = strrchr(address, ':');
+    char host[64] = "127.0.0.1";
+    int fd, on = 1, bound;
+
+    if (!strncmp(address, "unix:", 5))
+    {
+        memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        if (strlen(address + 5) >= sizeof(local.sun_path) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        {
+            fprintf(stderr, "%s: cannot listen there\n", address);
+            return -1;
+        }
+        strcpy(local.sun_path, address + 5);
+        unlink(local.sun_path);
+        bound = bind(fd, (struct sockaddr *)&local, sizeof(local));
+    }
+    else
+    {
+        memset(&inet, 0, sizeof(inet));
+        inet.sin_family = AF_INET;
+        inet.sin_port = htons(atoi(colon ? colon + 1 : address));
+        if (colon && colon != address && (size_t)(colon - address) < sizeof(host) &&
+            strncmp(address, "localhost:", 10))
+        {
+            memcpy(host, address, colon - address);
+            host[colon - address] = '\0';
+        }
+        // only the loopback network, as the stub hands out the whole guest
+        if (inet_pton(AF_INET, host, &inet.sin_addr) != 1 || ntohl(inet.sin_addr.s_addr) >> 24 != 127 ||
+            (fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+        {
+            fprintf(stderr, "%s: not a local address\n", address);
+            return -1;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        bound = bind(fd, (struct sockaddr *)&inet, sizeof(inet));
+    }
+    if (bound != 0 || listen(fd, 1) != 0)
+    {
+        perror(address);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Waits for a debugger on address and serves it emulator until it
+ * detaches, kills or disconnects. The emulator is left as the debugger
+ * left it, breakpoints and watchpoints included. Returns -1 if address
+ * cannot be listened on. */
+int gdb_serve(Emulator *emulator, const char *address)
+{
+    Session *session = calloc(1, sizeof(Session));
+    int listener = listen_on(address), on = 1;
+
+    if (!session || listener < 0)
+    {
+        free(session);
+        if (listener >= 0)
+        {
+            close(listener);
+        }
+        return -1;
+    }
+    session->fd = accept(listener, NULL, NULL);
+    close(listener);
+    if (!strncmp(address, "unix:", 5))
+    {
+        unlink(address + 5);
+    }
+    if (session->fd < 0)
+    {
+        perror(address);
+        free(session);
+        return -1;
+    }
+    // every packet waits for its acknowledgement, so send them at once
+    setsockopt(session->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    session->emulator = emulator;
+    session->signal = GDB_SIGTRAP;
+    while (!session->done && receive_packet(session) >= 0)
+    {
+        if (handle(session) == 0 && send_packet(session, session->reply) != 0)
+        {
+            break;
+        }
+    }
+    close(session->fd);
+    free(session);
+    return 0;
+}
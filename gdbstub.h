@@ -0,0 +1,27 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include "types.h"
+#include "emulator.h"
+
+/* A GDB remote serial protocol stub serving one emulator to one debugger
+ * at a time. It listens on address, either "unix:<path>" for a Unix
+ * socket or "[host:]port" for TCP, where host must be a local address and
+ * defaults to 127.0.0.1. From gdb:
+ *
+ *   (gdb) target remote localhost:1234
+ *
+ * Registers are x0 to x31 and pc, described to gdb as rv32 ones. Memory reads and writes go through
+ * emulator_read() and emulator_write(), so they ignore the regions'
+ * rights like a loader. Breakpoints (Z0 and Z1), watchpoints (Z2 to Z4),
+ * single step and continue map onto the emulator's own, see debug.h.
+ * A continue polls the connection between runs of GDB_CHUNK steps, so
+ * ctrl-c in gdb stops it within a few milliseconds. */
+
+#define GDB_PACKET_SIZE 4096 // largest packet either side sends
+#define GDB_CHUNK (1ul << 18)
+
+/* see gdbstub.c */
+int gdb_serve(Emulator *emulator, const char *address);
+
+#endif
@@ -0,0 +1,81 @@
+import struct
+import sys
+import argparse
+
+# Converts .input hex word files into the binary image format read by
+# load_image() in image.c. Each input is FILE[@ADDRESS[,WORDS]]; the first
+# one is the program and defaults to 0x1000, the others are data segments
+# (the same address/word count pair the -a option takes). The program is
+# writable as well as executable, as every page is when the driver loads
+# the hex file itself, so the two loaders run the same programs.
+
+IMAGE_MAGIC = b"RVIM"
+IMAGE_VERSION = 1
+PAGE_SIZE = 4096  # MEMORY_PAGE_SIZE in memory.h
+MAX_SEGMENTS = 64
+
+SEGMENT_READ = 0x1
+SEGMENT_WRITE = 0x2
+SEGMENT_EXEC = 0x4
+
+
+def read_words(path, limit):
+    words = []
+    with open(path, "r") as f:
+        for token in f.read().split():
+            if limit is not None and len(words) == limit:
+                break
+            words.append(int(token, 16) & 0xFFFFFFFF)
+    return words
+
+
+def parse_input(spec, default_address):
+    path, _, where = spec.partition("@")
+    address, limit = default_address, None
+    if where:
+        address_text, _, limit_text = where.partition(",")
+        address = int(address_text, 0)
+        if limit_text:
+            limit = int(limit_text, 0)
+    return path, address, limit
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("-o", dest="output", required=True,
+                        help="image file to write")
+    parser.add_argument("-e", dest="entry", type=lambda x: int(x, 0),
+                        help="initial PC (default: program address)")
+    parser.add_argument("inputs", nargs="+", help="FILE[@ADDRESS[,WORDS]]")
+    opts = parser.parse_args()
+
+    if len(opts.inputs) > MAX_SEGMENTS:
+        sys.exit("too many segments")
+
+    segments = []
+    for i, spec in enumerate(opts.inputs):
+        path, address, limit = parse_input(spec, 0x1000 if i == 0 else None)
+        if address is None:
+            sys.exit(spec + ": data inputs need an @ADDRESS")
+        words = read_words(path, limit)
+        data = struct.pack("<%dI" % len(words), *words)
+        flags = SEGMENT_READ | SEGMENT_WRITE | (SEGMENT_EXEC if i == 0 else 0)
+        segments.append((address, data, flags))
+
+    entry = opts.entry if opts.entry is not None else segments[0][0]
+    header = struct.pack("<4sIII", IMAGE_MAGIC, IMAGE_VERSION, entry, len(segments))
+    offset = PAGE_SIZE
+    table = b""
+    for address, data, flags in segments:
+        table += struct.pack("<IIII", address, len(data), offset, flags)
+        offset += (len(data) + PAGE_SIZE - 1) // PAGE_SIZE * PAGE_SIZE
+
+    with open(opts.output, "wb") as out:
+        out.write((header + table).ljust(PAGE_SIZE, b"\0"))
+        for address, data, flags in segments:
+            padded = (len(data) + PAGE_SIZE - 1) // PAGE_SIZE * PAGE_SIZE
+            out.write(data.ljust(padded, b"\0"))
+
+
+if __name__ == "__main__":
+    main()
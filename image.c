@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "types.h"
+#include "memory.h"
+#include "image.h"
+
+/* Maps a segment copy-on-write over guest memory without reading it. Only
+ * possible when both the guest address and the host pointer are page
+ * aligned and no other segment shares its last page, which the zero padding
+ * in the file fills out. */
+static int map_segment(int fd, off_t file_size, const ImageHeader *header, Word index, Byte *memory)
+{
+    const ImageSegment *segment = &header->segments[index];
+    Byte *at = memory + segment->address;
+    size_t length = (segment->size + MEMORY_PAGE_SIZE - 1) & ~(size_t)MEMORY_PAGE_MASK;
+    Word i;
+
+    if (((uintptr_t)at & MEMORY_PAGE_MASK) || length == 0 ||
+        segment->address + length > MEMORY_SPACE ||
+        (off_t)segment->offset + (off_t)length > file_size)
+    {
+        return 0;
+    }
+    for (i = 0; i < header->segment_count; i++)
+    {
+        if (i != index && header->segments[i].address < segment->address + length &&
+            header->segments[i].address + header->segments[i].size > segment->address)
+        {
+            return 0;
+        }
+    }
+    return mmap(at, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                fd, segment->offset) != MAP_FAILED;
+}
+
+static int copy_segment(int fd, const ImageSegment *segment, Byte *memory)
+{
+    Word done = 0;
+    ssize_t n;
+
+    while (done < segment->size)
+    {
+        n = pread(fd, memory + segment->address + done, segment->size - done,
+                  segment->offset + done);
+        if (n <= 0)
+        {
+            return 0;
+        }
+        done += n;
+    }
+    return 1;
+}
+
+/* Loads every segment of the image at path into memory, which must come
+ * from allocate_memory(), declares it as a region with the segment's
+ * rights and stores the entry point. Load images before
+ * executing from them: this does not invalidate decoded instructions.
+ * Returns 0 on success, -1 on error. */
+int load_image(const char *path, Byte *memory, Address *entry)
+{
+    const ImageHeader *header;
+    const ImageSegment *segment;
+    struct stat st;
+    Word i;
+    int fd, ok = 1;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < MEMORY_PAGE_SIZE)
+    {
+        fprintf(stderr, "%s: not an image\n", path);
+        close(fd);
+        return -1;
+    }
+    header = mmap(NULL, MEMORY_PAGE_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (header == MAP_FAILED)
+    {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    if (memcmp(header->magic, IMAGE_MAGIC, 4) != 0 || header->version != IMAGE_VERSION ||
+        header->segment_count > IMAGE_MAX_SEGMENTS)
+    {
+        fprintf(stderr, "%s: not a version %d image\n", path, IMAGE_VERSION);
+        ok = 0;
+    }
+    for (i = 0; ok && i < header->segment_count; i++)
+    {
+        segment = &header->segments[i];
+        if (segment->address > MEMORY_SPACE || segment->size > MEMORY_SPACE - segment->address ||
+            (off_t)segment->offset + segment->size > st.st_size)
+        {
+            fprintf(stderr, "%s: segment %u does not fit\n", path, i);
+            ok = 0;
+            break;
+        }
+        memory_commit(memory, segment->address, segment->size);
+        if (!map_segment(fd, st.st_size, header, i, memory) && !copy_segment(fd, segment, memory))
+        {
+            fprintf(stderr, "%s: cannot read segment %u\n", path, i);
+            ok = 0;
+        }
+        else if (memory_map(memory, segment->address, segment->size,
+                            ((segment->flags & SEGMENT_READ) ? MEMORY_READ : 0) |
+                            ((segment->flags & SEGMENT_WRITE) ? MEMORY_WRITE : 0) |
+                            ((segment->flags & SEGMENT_EXEC) ? MEMORY_EXEC : 0)) != 0)
+        {
+            fprintf(stderr, "%s: too many segments\n", path);
+            ok = 0;
+        }
+    }
+    if (ok)
+    {
+        *entry = header->entry;
+    }
+    munmap((void *)header, MEMORY_PAGE_SIZE);
+    close(fd); // the mappings keep the file alive
+    return ok ? 0 : -1;
+}
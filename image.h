@@ -0,0 +1,38 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "types.h"
+
+/* Binary program/data image. The header sits in the first page, followed by
+ * each segment's bytes at a page-aligned file offset, zero-padded to a whole
+ * page, so segments whose guest address is page-aligned can be mmap'd
+ * straight into guest memory. Written by hex2image.py. All fields are
+ * little-endian. */
+
+#define IMAGE_MAGIC "RVIM"
+#define IMAGE_VERSION 1
+#define IMAGE_MAX_SEGMENTS 64
+
+#define SEGMENT_READ 0x1
+#define SEGMENT_WRITE 0x2
+#define SEGMENT_EXEC 0x4
+
+typedef struct {
+    Address address; // guest address of the first byte
+    Word size;       // bytes of data in the file
+    Word offset;     // file offset, a multiple of MEMORY_PAGE_SIZE, see memory.h
+    Word flags;      // SEGMENT_* permissions
+} ImageSegment;
+
+typedef struct {
+    char magic[4];
+    Word version;
+    Address entry;   // initial PC
+    Word segment_count;
+    ImageSegment segments[IMAGE_MAX_SEGMENTS];
+} ImageHeader;
+
+/* see image.c */
+int load_image(const char *path, Byte *memory, Address *entry);
+
+#endif
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "types.h"
+#include "instance.h"
+
+static DecodedInstruction default_cache[PREDECODE_ENTRIES + 1];
+
+static Instance default_instance = {
+    .engine = ENGINE_INTERPRETER,
+    .predecode_cache = default_cache,
+};
+
+__thread Instance *current_instance = &default_instance;
+
+Instance *instance_default(void)
+{
+    return &default_instance;
+}
+
+/* A fresh instance with an empty decoded instruction cache. The cache is
+ * mapped rather than allocated so only the pages a program runs from cost
+ * memory. Returns NULL if out of memory. */
+Instance *instance_create(void)
+{
+    Instance *instance = calloc(1, sizeof(Instance));
+
+    if (!instance)
+    {
+        return NULL;
+    }
+    instance->engine = ENGINE_INTERPRETER;
+    instance->predecode_cache = mmap(NULL, sizeof(DecodedInstruction) * (PREDECODE_ENTRIES + 1),
+                                     PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (instance->predecode_cache == MAP_FAILED)
+    {
+        free(instance);
+        return NULL;
+    }
+    return instance;
+}
+
+void instance_destroy(Instance *instance)
+{
+    if (instance->jit)
+    {
+        jit_destroy(instance->jit);
+    }
+    if (instance->profile)
+    {
+        profile_destroy(instance->profile);
+    }
+    if (instance->timing)
+    {
+        timing_destroy(instance->timing);
+    }
+    if (instance->cache)
+    {
+        cache_destroy(instance->cache);
+    }
+    if (instance->branches)
+    {
+        branches_destroy(instance->branches);
+    }
+    if (instance->debug)
+    {
+        debug_destroy(instance->debug);
+    }
+    munmap(instance->predecode_cache, sizeof(DecodedInstruction) * (PREDECODE_ENTRIES + 1));
+    free(instance);
+}
+
+/* Forgets every decoded and translated instruction, for when guest memory
+ * was written behind store()'s back. */
+void instance_flush(Instance *instance)
+{
+    size_t size = sizeof(DecodedInstruction) * (PREDECODE_ENTRIES + 1);
+
+    if (instance->predecode_cache == default_cache ||
+        madvise(instance->predecode_cache, size, MADV_DONTNEED) != 0)
+    {
+        memset(instance->predecode_cache, 0, size);
+    }
+    if (instance->jit)
+    {
+        jit_destroy(instance->jit);
+        instance->jit = NULL;
+    }
+}
+
+/* Writes program and error output of the current instance to its sink.
+ * Text longer than the local buffer is formatted again on the heap. */
+void instance_printf(const char *format, ...)
+{
+    char buffer[256], *text = buffer;
+    va_list args;
+    int length;
+
+    va_start(args, format);
+    if (!current_instance->sink)
+    {
+        vprintf(format, args);
+        va_end(args);
+        return;
+    }
+    length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0)
+    {
+        return;
+    }
+    if ((size_t)length >= sizeof(buffer))
+    {
+        if (!(text = malloc(length + 1)))
+        {
+            return;
+        }
+        va_start(args, format);
+        vsnprintf(text, length + 1, format, args);
+        va_end(args);
+    }
+    current_instance->sink(current_instance->sink_context, text, length);
+    if (text != buffer)
+    {
+        free(text);
+    }
+}
+
+/* Writes length bytes of text as they are to the current instance's sink. */
+void instance_write(const char *text, size_t length)
+{
+    if (current_instance->sink)
+    {
+        current_instance->sink(current_instance->sink_context, text, length);
+    }
+    else
+    {
+        fwrite(text, 1, length, stdout);
+    }
+}
+
+/* Ends the current run. An instance with a stop point unwinds to it and
+ * leaves the process alone; otherwise this exits like the original. */
+void instance_stop(StopReason reason, int status)
+{
+    current_instance->reason = reason;
+    current_instance->status = status;
+    if (current_instance->stop)
+    {
+        longjmp(*current_instance->stop, 1);
+    }
+    exit(status);
+}
+
+/* A table of entry_size bytes per parcel, indexed by PC >> 1, for a side
+ * model to count in. Like the decoded instruction cache it is mapped, so
+ * only pages that run cost memory. Returns NULL if out of memory. */
+void *instance_pc_table(size_t entry_size)
+{
+    void *table = mmap(NULL, entry_size * PREDECODE_ENTRIES, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    return table == MAP_FAILED ? NULL : table;
+}
+
+void instance_pc_table_free(void *table, size_t entry_size)
+{
+    if (table)
+    {
+        munmap(table, entry_size * PREDECODE_ENTRIES);
+    }
+}
+
+/* Prints report to stderr when the process exits, once however often it is
+ * asked for, if the current instance is the default one: a driver that
+ * switches a model on gets its report the way it gets the trace. Embedders
+ * ask for reports through emulator.h instead. */
+void instance_report_at_exit(void (*report)(void))
+{
+    static void (*registered[8])(void);
+    static unsigned count;
+    unsigned i;
+
+    if (current_instance != &default_instance)
+    {
+        return;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (registered[i] == report)
+        {
+            return;
+        }
+    }
+    if (count < sizeof(registered) / sizeof(registered[0]) && atexit(report) == 0)
+    {
+        registered[count++] = report;
+    }
+}
+
+/* The parcel indexes of the count entries of a per-PC table with the
+ * highest scores, highest first, with how many there are in *found. Kept
+ * in order with an insertion pass. Returns NULL if out of memory. */
+Address *instance_rank(const void *table, size_t entry_size, InstanceScore score, const void *context,
+                       unsigned count, unsigned *found)
+{
+    const Byte *entries = table;
+    Address *ranked = malloc(sizeof(Address) * (count ? count : 1)), i;
+    unsigned long value;
+    unsigned j;
+
+    *found = 0;
+    if (!ranked)
+    {
+        return NULL;
+    }
+    for (i = 0; count && i < PREDECODE_ENTRIES; i++)
+    {
+        value = score(entries + i * entry_size, context);
+        if (!value || (*found == count && value <= score(entries + ranked[count - 1] * entry_size, context)))
+        {
+            continue;
+        }
+        j = *found < count ? (*found)++ : count - 1;
+        for (; j > 0 && score(entries + ranked[j - 1] * entry_size, context) < value; j--)
+        {
+            ranked[j] = ranked[j - 1];
+        }
+        ranked[j] = i;
+    }
+    return ranked;
+}
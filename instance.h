@@ -0,0 +1,93 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <stdio.h>
+#include <setjmp.h>
+#include "types.h"
+#include "riscv.h"
+#include "predecode.h"
+#include "emulator.h"
+
+/* Everything one emulator run owns apart from its Processor and memory:
+ * the decoded instruction cache, the engine, statistics, the JIT and where
+ * output and stops go. Embedders see it only through an Emulator, see
+ * emulator.h. Each thread runs one instance at a time and reaches
+ * it through current_instance, so load(), store(), the handlers and the
+ * engines keep their signatures. Threads start on a default instance that
+ * behaves like the original single-run emulator. */
+
+typedef struct Jit Jit;
+typedef struct Profile Profile;
+typedef struct Timing Timing;
+typedef struct Cache Cache;
+typedef struct Branches Branches;
+typedef struct Debug Debug;
+
+typedef struct {
+    Engine engine;
+    int compressed;                        // whether RV32C instructions decode, see isa_expand()
+    DecodedInstruction *predecode_cache;   // PREDECODE_ENTRIES + 1 records
+    DecodedInstruction predecode_scratch[3]; // one decoded, then room to step past it
+    unsigned long fusion_hits[FUSION_COUNT];
+    Jit *jit;                              // see jit.c, NULL until first used
+    Profile *profile;                      // see profile.c, NULL unless profiling
+    Timing *timing;                        // see timing.c, NULL unless modelling
+    Cache *cache;                          // see cache.c, NULL unless simulating
+    Branches *branches;                    // see branches.c, NULL unless predicting
+    Debug *debug;                          // see debug.c, NULL without breakpoints or watchpoints
+    Word watching;                         // watchpoints set in debug
+    OutputSink sink;                       // program output, NULL for stdout
+    void *sink_context;
+    jmp_buf *stop;                         // stops unwind here when set
+    unsigned long left;                    // instructions of the run not yet retired, kept
+                                           // up to date wherever the run may stop
+    StopReason reason;                     // why the last run stopped
+    int status;                            // exit status once stopped
+} Instance;
+
+extern __thread Instance *current_instance;
+
+/* Whether a side model or a watchpoint watches every instruction, which
+ * makes the records run through the observed handler in part2.c. */
+#define instance_observed(instance) \
+    ((instance)->profile || (instance)->timing || (instance)->cache || (instance)->branches || \
+     (instance)->watching)
+
+#define INSTANCE_WORST 10 // PCs an exit report ranks
+
+/* Scores entry for instance_rank(); 0 leaves it out. */
+typedef unsigned long (*InstanceScore)(const void *entry, const void *context);
+
+/* see instance.c */
+Instance *instance_default(void);
+Instance *instance_create(void);
+void instance_destroy(Instance *instance);
+void instance_flush(Instance *instance);
+void instance_printf(const char *format, ...);
+void instance_write(const char *text, size_t length);
+void instance_stop(StopReason reason, int status);
+void *instance_pc_table(size_t entry_size);
+void instance_pc_table_free(void *table, size_t entry_size);
+void instance_report_at_exit(void (*report)(void));
+Address *instance_rank(const void *table, size_t entry_size, InstanceScore score, const void *context,
+                       unsigned count, unsigned *found);
+
+/* see jit.c */
+void jit_destroy(Jit *jit);
+
+/* see profile.c */
+void profile_destroy(Profile *profile);
+
+/* see timing.c */
+void timing_destroy(Timing *timing);
+
+/* see cache.c */
+void cache_destroy(Cache *cache);
+
+/* see branches.c */
+void branches_destroy(Branches *branches);
+
+/* see debug.c */
+void debug_destroy(Debug *debug);
+
+#endif
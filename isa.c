@@ -0,0 +1,232 @@
+#include <pthread.h>
+#include "types.h"
+#include "isa.h"
+
+/* Tables expanded from isa.def, see isa.h. */
+
+#define WIDTH_R(effect) 0
+#define WIDTH_I(effect) 0
+#define WIDTH_SHIFT(effect) 0
+#define WIDTH_LOAD(access) ISA_WIDTH(access)
+#define WIDTH_STORE(width) width
+#define WIDTH_BRANCH(effect) 0
+#define WIDTH_U(effect) 0
+#define WIDTH_J(effect) 0
+#define WIDTH_JR(effect) 0
+#define WIDTH_ECALL(effect) 0
+
+const char *const isa_names[OP_COUNT] = {
+#define INSTRUCTION(op, name, opcode, funct3, funct7, format, effect) [OP_##op] = #name,
+#include "isa.def"
+#undef INSTRUCTION
+    [OP_INVALID] = "invalid",
+};
+
+const Byte isa_formats[OP_COUNT] = {
+#define INSTRUCTION(op, name, opcode, funct3, funct7, format, effect) [OP_##op] = FORMAT_##format,
+#include "isa.def"
+#undef INSTRUCTION
+    [OP_INVALID] = FORMAT_INVALID,
+};
+
+const Byte isa_widths[OP_COUNT] = {
+#define INSTRUCTION(op, name, opcode, funct3, funct7, format, effect) [OP_##op] = WIDTH_##format(effect),
+#include "isa.def"
+#undef INSTRUCTION
+};
+
+typedef struct {
+    Byte opcode;
+    Byte funct3;
+    Byte funct7;
+} Encoding;
+
+static const Encoding encodings[OP_INVALID] = {
+#define INSTRUCTION(op, name, opcode, funct3, funct7, format, effect) [OP_##op] = {opcode, funct3, funct7},
+#include "isa.def"
+#undef INSTRUCTION
+};
+
+/* opcode >> 2, funct3, funct7 -> Op, filled from encodings on first use
+ * and shared by every thread. Indexed by opcode >> 2 since every opcode
+ * ends in 0b11. */
+static Byte decode_table[32][8][128];
+static Byte known_opcodes[32];
+static pthread_once_t decode_table_once = PTHREAD_ONCE_INIT;
+
+static void build_decode_table(void)
+{
+    const Encoding *e;
+    Word op, opcode, funct3, funct7;
+
+    for (opcode = 0; opcode < 32; opcode++)
+        for (funct3 = 0; funct3 < 8; funct3++)
+            for (funct7 = 0; funct7 < 128; funct7++)
+                decode_table[opcode][funct3][funct7] = OP_INVALID;
+
+    for (op = 0; op < OP_INVALID; op++)
+    {
+        e = &encodings[op];
+        known_opcodes[e->opcode >> 2] = 1;
+        for (funct3 = 0; funct3 < 8; funct3++)
+            for (funct7 = 0; funct7 < 128; funct7++)
+                if ((e->funct3 == ISA_ANY || e->funct3 == funct3) && (e->funct7 == ISA_ANY || e->funct7 == funct7))
+                    decode_table[e->opcode >> 2][funct3][funct7] = op;
+    }
+}
+
+/* The instruction bits encode, OP_INVALID if none. */
+Op isa_decode(Word bits)
+{
+    Op op;
+
+    pthread_once(&decode_table_once, build_decode_table);
+    if ((bits & 3) != 3)
+    {
+        return OP_INVALID;
+    }
+    op = decode_table[(bits >> 2) & 31][(bits >> 12) & 7][bits >> 25];
+    // ebreak and the other SYSTEM words differ from ecall only in fields
+    // the table does not look at
+    return op == OP_ECALL && bits != encodings[OP_ECALL].opcode ? OP_INVALID : op;
+}
+
+/* Whether any instruction has the opcode of bits. */
+int isa_opcode_known(Word bits)
+{
+    pthread_once(&decode_table_once, build_decode_table);
+    return (bits & 3) == 3 && known_opcodes[(bits >> 2) & 31];
+}
+
+/* Bits hi..lo of a compressed instruction c, moved down to bit at. */
+#define CBITS(c, hi, lo, at) ((((c) >> (lo)) & ((1u << ((hi) - (lo) + 1)) - 1)) << (at))
+#define CREG(c, lo) (8 + (((c) >> (lo)) & 7)) // 3-bit fields name x8-x15
+#define QUADRANT(funct3, quadrant) ((funct3) << 2 | (quadrant))
+
+static Word sext(Word value, int n)
+{
+    return (Word)((sWord)(value << (32 - n)) >> (32 - n));
+}
+
+static Word field(Byte value)
+{
+    return value == ISA_ANY ? 0 : value;
+}
+
+/* The word isa.def gives op, with register fields and no immediate. */
+static Word encode(Op op, Word rd, Word rs1, Word rs2)
+{
+    const Encoding *e = &encodings[op];
+
+    return field(e->funct7) << 25 | rs2 << 20 | rs1 << 15 | field(e->funct3) << 12 | rd << 7 | e->opcode;
+}
+
+static Word encode_i(Op op, Word rd, Word rs1, Word imm)
+{
+    return encode(op, rd, rs1, 0) | imm << 20;
+}
+
+static Word encode_s(Op op, Word rs1, Word rs2, Word imm)
+{
+    return encode(op, 0, rs1, rs2) | (imm >> 5 & 0x7F) << 25 | (imm & 0x1F) << 7;
+}
+
+static Word encode_b(Op op, Word rs1, Word rs2, Word imm)
+{
+    return encode(op, 0, rs1, rs2) | (imm >> 12 & 1) << 31 | (imm >> 5 & 0x3F) << 25 | (imm >> 1 & 0xF) << 8 |
+           (imm >> 11 & 1) << 7;
+}
+
+static Word encode_j(Word rd, Word imm)
+{
+    return encode(OP_JAL, rd, 0, 0) | (imm >> 20 & 1) << 31 | (imm >> 1 & 0x3FF) << 21 | (imm >> 11 & 1) << 20 |
+           (imm & 0xFF000);
+}
+
+/* The 32-bit instruction that does what bits does. A word whose low two
+ * bits are 0b11 is returned as it is; otherwise its low half is an RV32C
+ * instruction and the result is the base instruction it stands for, or 0,
+ * which is no instruction, if it is reserved, c.ebreak or belongs to F or
+ * D. */
+Word isa_expand(Word bits)
+{
+    static const Byte arithmetic[4] = {OP_SUB, OP_XOR, OP_OR, OP_AND};
+    Word c = bits & 0xFFFF, rd = (c >> 7) & 31, rs2 = (c >> 2) & 31;
+    Word imm = sext(CBITS(c, 12, 12, 5) | CBITS(c, 6, 2, 0), 6);
+    Word offset;
+
+    if ((bits & 3) == 3)
+    {
+        return bits;
+    }
+    switch (QUADRANT(c >> 13, c & 3))
+    {
+    case QUADRANT(0, 0): // c.addi4spn
+        offset = CBITS(c, 12, 11, 4) | CBITS(c, 10, 7, 6) | CBITS(c, 6, 6, 2) | CBITS(c, 5, 5, 3);
+        return offset ? encode_i(OP_ADDI, CREG(c, 2), 2, offset) : 0;
+    case QUADRANT(2, 0): // c.lw
+        offset = CBITS(c, 12, 10, 3) | CBITS(c, 6, 6, 2) | CBITS(c, 5, 5, 6);
+        return encode_i(OP_LW, CREG(c, 2), CREG(c, 7), offset);
+    case QUADRANT(6, 0): // c.sw
+        offset = CBITS(c, 12, 10, 3) | CBITS(c, 6, 6, 2) | CBITS(c, 5, 5, 6);
+        return encode_s(OP_SW, CREG(c, 7), CREG(c, 2), offset);
+    case QUADRANT(0, 1): // c.addi, c.nop
+        return encode_i(OP_ADDI, rd, rd, imm);
+    case QUADRANT(1, 1): // c.jal
+    case QUADRANT(5, 1): // c.j
+        offset = sext(CBITS(c, 12, 12, 11) | CBITS(c, 11, 11, 4) | CBITS(c, 10, 9, 8) | CBITS(c, 8, 8, 10) |
+                          CBITS(c, 7, 7, 6) | CBITS(c, 6, 6, 7) | CBITS(c, 5, 3, 1) | CBITS(c, 2, 2, 5),
+                      12);
+        return encode_j(c >> 13 == 1, offset);
+    case QUADRANT(2, 1): // c.li
+        return encode_i(OP_ADDI, rd, 0, imm);
+    case QUADRANT(3, 1):
+        if (rd == 2) // c.addi16sp
+        {
+            offset = sext(CBITS(c, 12, 12, 9) | CBITS(c, 6, 6, 4) | CBITS(c, 5, 5, 6) | CBITS(c, 4, 3, 7) |
+                              CBITS(c, 2, 2, 5),
+                          10);
+            return offset ? encode_i(OP_ADDI, 2, 2, offset) : 0;
+        }
+        return imm ? encode(OP_LUI, rd, 0, 0) | imm << 12 : 0; // c.lui
+    case QUADRANT(4, 1):
+        rd = CREG(c, 7);
+        switch ((c >> 10) & 3)
+        {
+        case 0: // c.srli
+            return c & 0x1000 ? 0 : encode(OP_SRLI, rd, rd, rs2);
+        case 1: // c.srai
+            return c & 0x1000 ? 0 : encode(OP_SRAI, rd, rd, rs2);
+        case 2: // c.andi
+            return encode_i(OP_ANDI, rd, rd, imm);
+        default: // c.sub, c.xor, c.or, c.and
+            return c & 0x1000 ? 0 : encode(arithmetic[(c >> 5) & 3], rd, rd, CREG(c, 2));
+        }
+    case QUADRANT(6, 1): // c.beqz
+    case QUADRANT(7, 1): // c.bnez
+        offset = sext(CBITS(c, 12, 12, 8) | CBITS(c, 11, 10, 3) | CBITS(c, 6, 5, 6) | CBITS(c, 4, 3, 1) |
+                          CBITS(c, 2, 2, 5),
+                      9);
+        return encode_b(c >> 13 == 6 ? OP_BEQ : OP_BNE, CREG(c, 7), 0, offset);
+    case QUADRANT(0, 2): // c.slli
+        return c & 0x1000 ? 0 : encode(OP_SLLI, rd, rd, rs2);
+    case QUADRANT(2, 2): // c.lwsp
+        offset = CBITS(c, 12, 12, 5) | CBITS(c, 6, 4, 2) | CBITS(c, 3, 2, 6);
+        return rd ? encode_i(OP_LW, rd, 2, offset) : 0;
+    case QUADRANT(4, 2):
+        if (rs2) // c.mv, c.add
+        {
+            return encode(OP_ADD, rd, c & 0x1000 ? rd : 0, rs2);
+        }
+        if (rd) // c.jr, c.jalr
+        {
+            return encode_i(OP_JALR, c & 0x1000 ? 1 : 0, rd, 0);
+        }
+        return 0; // c.ebreak, like ebreak no instruction here
+    case QUADRANT(6, 2): // c.swsp
+        offset = CBITS(c, 12, 9, 2) | CBITS(c, 8, 7, 6);
+        return encode_s(OP_SW, 2, rs2, offset);
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef ISA_H
+#define ISA_H
+
+#include <stdint.h>
+#include "types.h"
+
+/* The instruction set as described by isa.def. Every table that maps
+ * encodings to instructions, mnemonics, operand layouts or handlers is
+ * expanded from that one list, so the decoder, the disassemblers and the
+ * executors cannot disagree about what a word is. */
+
+#define ISA_ANY 0xFF // matches any funct3 or funct7
+
+/* Where an instruction keeps its operands and how its immediate is built. */
+typedef enum {
+    FORMAT_INVALID,
+    FORMAT_R,      // rd, rs1, rs2
+    FORMAT_I,      // rd, rs1, sign-extended 12-bit immediate
+    FORMAT_SHIFT,  // rd, rs1, 5-bit shift amount
+    FORMAT_LOAD,   // rd, rs1, sign-extended 12-bit offset
+    FORMAT_STORE,  // rs1, rs2, get_store_offset()
+    FORMAT_BRANCH, // rs1, rs2, get_branch_offset()
+    FORMAT_U,      // rd, upper 20 bits in place
+    FORMAT_J,      // rd, get_jump_offset()
+    FORMAT_JR,     // rd, rs1, sign-extended 12-bit offset
+    FORMAT_ECALL,  // no operands
+    FORMAT_COUNT
+} Format;
+
+/* Every operation the executors implement: one per isa.def line and one
+ * for words that are none of them. Indexes the handler table, the
+ * threaded engine's label table and the tables below. */
+typedef enum {
+#define INSTRUCTION(op, name, opcode, funct3, funct7, format, effect) OP_##op,
+#include "isa.def"
+#undef INSTRUCTION
+    OP_INVALID,
+    OP_COUNT
+} Op;
+
+/* RV32M on 64-bit host arithmetic. The high products are exact there,
+ * and so is the one signed quotient that overflows 32 bits, INT32_MIN /
+ * -1, which truncates to the dividend as the spec asks (remainder 0). That
+ * leaves division by zero, handled without a branch: the divisor becomes
+ * 1 and the result is forced to all ones (div, divu) or the dividend (rem,
+ * remu). */
+#define ISA_SIGNED64(x) ((sDouble)(sWord)(x))
+#define ISA_NONZERO(b) ((b) | !(b))
+#define ISA_IF_ZERO(b, value) ((Word)(value) & -(Word)!(b))
+
+#define ISA_MULH(a, b) ((Word)((Double)(ISA_SIGNED64(a) * ISA_SIGNED64(b)) >> 32))
+#define ISA_MULHSU(a, b) ((Word)((Double)(ISA_SIGNED64(a) * (sDouble)(Word)(b)) >> 32))
+#define ISA_MULHU(a, b) ((Word)((Double)(Word)(a) * (Word)(b) >> 32))
+#define ISA_DIV(a, b) ((Word)(ISA_SIGNED64(a) / ISA_SIGNED64(ISA_NONZERO(b))) | ISA_IF_ZERO(b, ~(Word)0))
+#define ISA_DIVU(a, b) ((Word)(a) / ISA_NONZERO((Word)(b)) | ISA_IF_ZERO(b, ~(Word)0))
+#define ISA_REM(a, b) ((Word)(ISA_SIGNED64(a) % ISA_SIGNED64(ISA_NONZERO(b))) | ISA_IF_ZERO(b, a))
+#define ISA_REMU(a, b) ((Word)(a) % ISA_NONZERO((Word)(b)) | ISA_IF_ZERO(b, a))
+
+/* Added to a load's width in isa.def when the value is sign-extended. */
+#define ISA_SIGNED 0x80
+#define ISA_WIDTH(access) ((access) & ~ISA_SIGNED)
+#define ISA_EXTEND(value, access)                                                             \
+    ((access) & ISA_SIGNED ? (Word)((sWord)((Word)(value) << (32 - 8 * ISA_WIDTH(access))) >> \
+                                    (32 - 8 * ISA_WIDTH(access)))                             \
+                           : (Word)(value))
+
+/* Bytes taken by the instruction whose low bits are bits: 4, or 2 for a
+ * compressed one, see isa_expand(). */
+#define ISA_LENGTH(bits) (((bits) & 3) == 3 ? 4 : 2)
+
+extern const char *const isa_names[OP_COUNT];
+extern const Byte isa_formats[OP_COUNT];
+extern const Byte isa_widths[OP_COUNT]; // bytes a load or store moves, 0 for the rest
+
+/* see isa.c */
+Op isa_decode(Word bits);
+int isa_opcode_known(Word bits);
+Word isa_expand(Word bits);
+
+#endif
@@ -0,0 +1,775 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include "types.h"
+#include "utils.h"
+#include "riscv.h"
+#include "predecode.h"
+#include "memory.h"
+#include "instance.h"
+
+/* Basic-block JIT. A block runs from its entry PC up to and including the
+ * first branch or jump, or stops just before anything the JIT does not
+ * translate (ecall, invalid words, odd, out-of-range or
+ * non-executable PCs), which the dispatcher below then runs through the
+ * interpreter handlers. Blocks are emitted as x86-64 into one RWX buffer
+ * and their exits are patched to jump straight into the successor block
+ * once it exists.
+ *
+ * While native code runs, rbx holds the Processor, r12 the guest memory and
+ * r13 the number of instructions still allowed to retire. Every block
+ * checks and charges its full length on entry, so a run never retires more
+ * than the count execute_steps was given and single-stepping falls back to
+ * the interpreter. Guest registers stay in processor->R; loads and stores
+ * call load()/store() so memory semantics are shared with the interpreter,
+ * with processor->PC and the instructions left written first in case they
+ * stop the run. A store that lands on a page holding translated code
+ * flushes the whole JIT and the block exits right after it. */
+
+#if defined(__x86_64__) && defined(__unix__)
+
+#include <sys/mman.h>
+
+#define JIT_BUFFER_SIZE (16 * 1024 * 1024)
+#define JIT_MAX_BLOCK 64
+#define JIT_MAX_BLOCKS 65536
+#define JIT_BLOCK_BYTES (JIT_MAX_BLOCK * 128 + 64) // worst case per block, a store is the longest
+#define JIT_PAGES (MEMORY_SPACE >> 12)
+
+#define REG(r) ((Word)(offsetof(Processor, R) + 4 * (r)))
+
+typedef struct {
+    Address pc;
+    unsigned length; // guest instructions, including the terminator
+    Byte *code;
+} JitBlock;
+
+typedef Address (*JitEntry)(Processor *, Byte *, unsigned long, Byte *);
+
+/* Code buffer, block index and statistics of one instance's JIT. Emitted
+ * code refers to dirty, remaining and last_exit by absolute address, so
+ * each instance's blocks only ever run against its own state. */
+struct Jit {
+    Byte *buffer;
+    Byte *cursor;
+    Byte *code_start; // first byte after the entry/exit stubs
+    Byte *exit;       // shared epilogue every block exits through
+    JitEntry enter;
+
+    JitBlock **block_map; // by PC >> 1, &no_block if not translatable
+    JitBlock block_pool[JIT_MAX_BLOCKS];
+    unsigned block_count;
+    JitBlock no_block;
+
+    Byte code_pages[JIT_PAGES];
+    volatile Byte dirty;
+
+    /* Written by the epilogue: budget left and the exit stub taken (NULL
+     * when the exit cannot be chained). */
+    unsigned long remaining;
+    Byte *last_exit;
+
+    struct {
+        unsigned long blocks;
+        unsigned long instructions;
+        unsigned long bytes;
+        unsigned long chains;
+        unsigned long flushes;
+        unsigned long native;
+        unsigned long interpreted;
+        double compile_seconds;
+    } stats;
+};
+
+/* The JIT of the instance the calling thread is running. */
+static __thread Jit *jit;
+
+static void emit8(Byte value)
+{
+    *jit->cursor++ = value;
+}
+
+static void emit32(Word value)
+{
+    memcpy(jit->cursor, &value, 4);
+    jit->cursor += 4;
+}
+
+static void emit64(uint64_t value)
+{
+    memcpy(jit->cursor, &value, 8);
+    jit->cursor += 8;
+}
+
+static void patch_rel32(Byte *at, Byte *target)
+{
+    sWord rel = (sWord)(target - (at + 4));
+    memcpy(at, &rel, 4);
+}
+
+/* op reg, [rbx + disp32] */
+static void emit_rbx(Byte opcode, int reg, Word disp)
+{
+    emit8(opcode);
+    emit8(0x80 | reg << 3 | 3);
+    emit32(disp);
+}
+
+static void emit_load_eax(unsigned r)
+{
+    emit_rbx(0x8B, 0, REG(r)); // mov eax, [rbx + R[r]]
+}
+
+/* Before a call that may stop the run, which must leave PC at the
+ * instruction that stopped it and instance->left counting it and the
+ * rest. The block charged all length instructions on entry, of which
+ * index have retired. */
+static void emit_pc(Address pc, unsigned index, unsigned length)
+{
+    emit8(0xC7); // mov dword [rbx + PC], pc
+    emit8(0x83);
+    emit32(offsetof(Processor, PC));
+    emit32(pc);
+    emit8(0x49); // lea rax, [r13 + length - index]
+    emit8(0x8D);
+    emit8(0x85);
+    emit32(length - index);
+    emit8(0x48); // movabs rcx, &left
+    emit8(0xB9);
+    emit64((uint64_t)(uintptr_t)&current_instance->left);
+    emit8(0x48); // mov [rcx], rax
+    emit8(0x89);
+    emit8(0x01);
+}
+
+static void emit_store_eax(unsigned r)
+{
+    if (r != 0) // x0 is cleared after every instruction anyway
+    {
+        emit_rbx(0x89, 0, REG(r)); // mov [rbx + R[r]], eax
+    }
+}
+
+static void emit_call(void *function)
+{
+    emit8(0x48); // movabs rax, function
+    emit8(0xB8);
+    emit64((uint64_t)(uintptr_t)function);
+    emit8(0xFF); // call rax
+    emit8(0xD0);
+}
+
+/* Leave native code with eax = next PC. A chainable exit records its own
+ * address in rdx so the dispatcher can later patch it into a direct jump. */
+static void emit_exit(Address next_pc, int chainable)
+{
+    Byte *stub = jit->cursor;
+
+    emit8(0xB8); // mov eax, next_pc (overwritten by jmp rel32 when chained)
+    emit32(next_pc);
+    if (chainable)
+    {
+        emit8(0x48); // movabs rdx, stub
+        emit8(0xBA);
+        emit64((uint64_t)(uintptr_t)stub);
+    }
+    else
+    {
+        emit8(0x31); // xor edx, edx
+        emit8(0xD2);
+    }
+    emit8(0xE9); // jmp exit
+    emit32(0);
+    patch_rel32(jit->cursor - 4, jit->exit);
+}
+
+/* Leave native code with the next PC already in eax, as an indirect jump
+ * does. Such an exit is never chained. */
+static void emit_indirect_exit(void)
+{
+    emit8(0x31); // xor edx, edx
+    emit8(0xD2);
+    emit8(0xE9); // jmp exit
+    emit32(0);
+    patch_rel32(jit->cursor - 4, jit->exit);
+}
+
+/* After a store: bail out if it flushed the JIT, refunding the budget of
+ * the instructions that will not run. */
+static void emit_dirty_check(Address next_pc, unsigned refund)
+{
+    Byte *skip;
+
+    emit8(0x48); // movabs rax, &jit->dirty
+    emit8(0xB8);
+    emit64((uint64_t)(uintptr_t)&jit->dirty);
+    emit8(0x80); // cmp byte [rax], 0
+    emit8(0x38);
+    emit8(0x00);
+    emit8(0x0F); // je skip
+    emit8(0x84);
+    emit32(0);
+    skip = jit->cursor - 4;
+    emit8(0x49); // add r13, refund
+    emit8(0x81);
+    emit8(0xC5);
+    emit32(refund);
+    emit_exit(next_pc, 0);
+    patch_rel32(skip, jit->cursor);
+}
+
+static void emit_stubs(void)
+{
+    jit->cursor = jit->buffer;
+
+    // Address enter(Processor *rdi, Byte *rsi, unsigned long rdx, code rcx)
+    jit->enter = (JitEntry)jit->cursor;
+    emit8(0x55);                           // push rbp
+    emit8(0x53);                           // push rbx
+    emit8(0x41); emit8(0x54);              // push r12
+    emit8(0x41); emit8(0x55);              // push r13
+    emit8(0x48); emit8(0x83); emit8(0xEC); emit8(0x08); // sub rsp, 8
+    emit8(0x48); emit8(0x89); emit8(0xFB); // mov rbx, rdi
+    emit8(0x49); emit8(0x89); emit8(0xF4); // mov r12, rsi
+    emit8(0x49); emit8(0x89); emit8(0xD5); // mov r13, rdx
+    emit8(0xFF); emit8(0xE1);              // jmp rcx
+
+    jit->exit = jit->cursor;
+    emit8(0x48); emit8(0xB9);              // movabs rcx, &jit->remaining
+    emit64((uint64_t)(uintptr_t)&jit->remaining);
+    emit8(0x4C); emit8(0x89); emit8(0x29); // mov [rcx], r13
+    emit8(0x48); emit8(0xB9);              // movabs rcx, &jit->last_exit
+    emit64((uint64_t)(uintptr_t)&jit->last_exit);
+    emit8(0x48); emit8(0x89); emit8(0x11); // mov [rcx], rdx
+    emit8(0x48); emit8(0x83); emit8(0xC4); emit8(0x08); // add rsp, 8
+    emit8(0x41); emit8(0x5D);              // pop r13
+    emit8(0x41); emit8(0x5C);              // pop r12
+    emit8(0x5B);                           // pop rbx
+    emit8(0x5D);                           // pop rbp
+    emit8(0xC3);                           // ret
+
+    jit->code_start = jit->cursor;
+}
+
+static void jit_flush(void)
+{
+    memset(jit->block_map, 0, sizeof(JitBlock *) * PREDECODE_ENTRIES);
+    memset(jit->code_pages, 0, sizeof(jit->code_pages));
+    jit->block_count = 0;
+    jit->cursor = jit->code_start;
+    jit->last_exit = NULL;
+    jit->stats.flushes++;
+}
+
+/* Selects the current instance's JIT, creating it on first use. */
+static int jit_init(void)
+{
+    jit = current_instance->jit;
+    if (jit)
+    {
+        return 1;
+    }
+    jit = calloc(1, sizeof(Jit));
+    if (!jit)
+    {
+        return 0;
+    }
+    jit->buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    jit->block_map = calloc(PREDECODE_ENTRIES, sizeof(JitBlock *));
+    if (jit->buffer == MAP_FAILED || !jit->block_map)
+    {
+        if (jit->buffer != MAP_FAILED)
+        {
+            munmap(jit->buffer, JIT_BUFFER_SIZE);
+        }
+        free(jit->block_map);
+        free(jit);
+        jit = NULL;
+        return 0;
+    }
+    emit_stubs();
+    current_instance->jit = jit;
+    return 1;
+}
+
+void jit_destroy(Jit *destroyed)
+{
+    munmap(destroyed->buffer, JIT_BUFFER_SIZE);
+    free(destroyed->block_map);
+    free(destroyed);
+}
+
+/* Division is called out to, with the handlers' own arithmetic. */
+static Word jit_div(Word a, Word b)
+{
+    return ISA_DIV(a, b);
+}
+
+static Word jit_divu(Word a, Word b)
+{
+    return ISA_DIVU(a, b);
+}
+
+static Word jit_rem(Word a, Word b)
+{
+    return ISA_REM(a, b);
+}
+
+static Word jit_remu(Word a, Word b)
+{
+    return ISA_REMU(a, b);
+}
+
+/* Whether emit_instruction() has code for op. The rest end the block and
+ * run through their handlers. */
+static int jit_translatable(Op op)
+{
+    switch (op)
+    {
+    case OP_ADD:
+    case OP_SUB:
+    case OP_SLL:
+    case OP_SLT:
+    case OP_SLTU:
+    case OP_XOR:
+    case OP_SRL:
+    case OP_SRA:
+    case OP_OR:
+    case OP_AND:
+    case OP_MUL:
+    case OP_MULH:
+    case OP_MULHSU:
+    case OP_MULHU:
+    case OP_DIV:
+    case OP_DIVU:
+    case OP_REM:
+    case OP_REMU:
+    case OP_ADDI:
+    case OP_SLTI:
+    case OP_SLTIU:
+    case OP_XORI:
+    case OP_ORI:
+    case OP_ANDI:
+    case OP_SLLI:
+    case OP_SRLI:
+    case OP_SRAI:
+    case OP_LB:
+    case OP_LH:
+    case OP_LW:
+    case OP_LBU:
+    case OP_LHU:
+    case OP_SB:
+    case OP_SH:
+    case OP_SW:
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLT:
+    case OP_BGE:
+    case OP_BLTU:
+    case OP_BGEU:
+    case OP_LUI:
+    case OP_AUIPC:
+    case OP_JAL:
+    case OP_JALR:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static void emit_instruction(const DecodedInstruction *d, Address pc, unsigned index, unsigned length)
+{
+    Alignment width;
+
+    switch (d->op)
+    {
+    case OP_ADD:
+    case OP_SUB:
+    case OP_XOR:
+    case OP_OR:
+    case OP_AND:
+        emit_load_eax(d->rs1);
+        emit_rbx(d->op == OP_ADD ? 0x03 : d->op == OP_SUB ? 0x2B : d->op == OP_XOR ? 0x33 :
+                 d->op == OP_OR ? 0x0B : 0x23, 0, REG(d->rs2));
+        emit_store_eax(d->rd);
+        break;
+    case OP_MUL:
+        emit_load_eax(d->rs1);
+        emit8(0x0F); // imul eax, [rbx + R[rs2]]
+        emit_rbx(0xAF, 0, REG(d->rs2));
+        emit_store_eax(d->rd);
+        break;
+    case OP_SLL:
+    case OP_SRL:
+    case OP_SRA:
+        // x86 masks the count to 5 bits, as the handlers do
+        emit_load_eax(d->rs1);
+        emit_rbx(0x8B, 1, REG(d->rs2)); // mov ecx, [rbx + R[rs2]]
+        emit8(0xD3); // shl/shr/sar eax, cl
+        emit8(d->op == OP_SLL ? 0xE0 : d->op == OP_SRL ? 0xE8 : 0xF8);
+        emit_store_eax(d->rd);
+        break;
+    case OP_MULH:
+    case OP_MULHU:
+        emit_load_eax(d->rs1);
+        emit_rbx(0xF7, d->op == OP_MULH ? 5 : 4, REG(d->rs2)); // imul/mul dword [rbx + R[rs2]]
+        emit8(0x89); emit8(0xD0);              // mov eax, edx
+        emit_store_eax(d->rd);
+        break;
+    case OP_MULHSU:
+        emit8(0x48); // movsxd rax, [rbx + R[rs1]]
+        emit_rbx(0x63, 0, REG(d->rs1));
+        emit_rbx(0x8B, 1, REG(d->rs2));        // mov ecx, [rbx + R[rs2]]
+        emit8(0x48); emit8(0x0F); emit8(0xAF); emit8(0xC1); // imul rax, rcx
+        emit8(0x48); emit8(0xC1); emit8(0xE8); emit8(0x20); // shr rax, 32
+        emit_store_eax(d->rd);
+        break;
+    case OP_DIV:
+    case OP_DIVU:
+    case OP_REM:
+    case OP_REMU:
+        emit_rbx(0x8B, 7, REG(d->rs1)); // mov edi, [rbx + R[rs1]]
+        emit_rbx(0x8B, 6, REG(d->rs2)); // mov esi, [rbx + R[rs2]]
+        emit_call(d->op == OP_DIV ? (void *)jit_div : d->op == OP_DIVU ? (void *)jit_divu :
+                  d->op == OP_REM ? (void *)jit_rem : (void *)jit_remu);
+        emit_store_eax(d->rd);
+        break;
+    case OP_SLT:
+    case OP_SLTU:
+    case OP_SLTI:
+    case OP_SLTIU:
+        emit_load_eax(d->rs1);
+        if (d->op == OP_SLT || d->op == OP_SLTU)
+        {
+            emit_rbx(0x3B, 0, REG(d->rs2)); // cmp eax, [rbx + R[rs2]]
+        }
+        else
+        {
+            emit8(0x3D); // cmp eax, imm
+            emit32(d->imm);
+        }
+        emit8(0x0F); // setl/setb al
+        emit8(d->op == OP_SLT || d->op == OP_SLTI ? 0x9C : 0x92);
+        emit8(0xC0);
+        emit8(0x0F); emit8(0xB6); emit8(0xC0); // movzx eax, al
+        emit_store_eax(d->rd);
+        break;
+    case OP_ADDI:
+    case OP_XORI:
+    case OP_ORI:
+    case OP_ANDI:
+        emit_load_eax(d->rs1);
+        emit8(d->op == OP_ADDI ? 0x05 : d->op == OP_XORI ? 0x35 : d->op == OP_ORI ? 0x0D : 0x25);
+        emit32(d->imm);
+        emit_store_eax(d->rd);
+        break;
+    case OP_SLLI:
+    case OP_SRLI:
+    case OP_SRAI:
+        emit_load_eax(d->rs1);
+        emit8(0xC1);
+        emit8(d->op == OP_SLLI ? 0xE0 : d->op == OP_SRLI ? 0xE8 : 0xF8);
+        emit8(d->imm);
+        emit_store_eax(d->rd);
+        break;
+    case OP_LUI:
+    case OP_AUIPC:
+        emit8(0xB8);
+        emit32(d->op == OP_LUI ? d->imm : pc + d->imm);
+        emit_store_eax(d->rd);
+        break;
+    case OP_LB:
+    case OP_LH:
+    case OP_LW:
+    case OP_LBU:
+    case OP_LHU:
+        width = isa_widths[d->op];
+        emit_pc(pc, index, length);
+        emit_load_eax(d->rs1);
+        emit8(0x05); // add eax, imm
+        emit32(d->imm);
+        emit8(0x4C); emit8(0x89); emit8(0xE7); // mov rdi, r12
+        emit8(0x89); emit8(0xC6);              // mov esi, eax
+        emit8(0xBA);                           // mov edx, width
+        emit32(width);
+        emit_call((void *)load);
+        if (d->op == OP_LB || d->op == OP_LH)
+        {
+            emit8(0x0F); // movsx eax, al/ax
+            emit8(d->op == OP_LB ? 0xBE : 0xBF);
+            emit8(0xC0);
+        }
+        emit_store_eax(d->rd);
+        break;
+    case OP_SB:
+    case OP_SH:
+    case OP_SW:
+        width = isa_widths[d->op];
+        emit_pc(pc, index, length);
+        emit_load_eax(d->rs1);
+        emit8(0x05); // add eax, imm
+        emit32(d->imm);
+        emit8(0x89); emit8(0xC6);              // mov esi, eax
+        emit_rbx(0x8B, 1, REG(d->rs2));        // mov ecx, [rbx + R[rs2]]
+        emit8(0x4C); emit8(0x89); emit8(0xE7); // mov rdi, r12
+        emit8(0xBA);                           // mov edx, width
+        emit32(width);
+        emit_call((void *)store);
+        emit_dirty_check(pc + d->length, length - index - 1);
+        break;
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLT:
+    case OP_BGE:
+    case OP_BLTU:
+    case OP_BGEU:
+    {
+        static const Byte conditions[OP_COUNT] = {
+            [OP_BEQ] = 0x84, [OP_BNE] = 0x85, [OP_BLT] = 0x8C,
+            [OP_BGE] = 0x8D, [OP_BLTU] = 0x82, [OP_BGEU] = 0x83,
+        };
+        Byte *taken;
+
+        emit_load_eax(d->rs1);
+        emit_rbx(0x3B, 0, REG(d->rs2)); // cmp eax, [rbx + R[rs2]]
+        emit8(0x0F);
+        emit8(conditions[d->op]); // je/jne/jl/jge/jb/jae taken
+        emit32(0);
+        taken = jit->cursor - 4;
+        emit_exit(pc + d->length, 1);
+        patch_rel32(taken, jit->cursor);
+        emit_exit(pc + d->imm, 1);
+        break;
+    }
+    case OP_JAL:
+        if (d->rd != 0)
+        {
+            emit8(0xC7); // mov dword [rbx + R[rd]], pc + length
+            emit8(0x83);
+            emit32(REG(d->rd));
+            emit32(pc + d->length);
+        }
+        emit_exit(pc + d->imm, 1);
+        break;
+    case OP_JALR:
+        // the target goes in eax before rd, which may be rs1, is written
+        emit_load_eax(d->rs1);
+        emit8(0x05); // add eax, imm
+        emit32(d->imm);
+        emit8(0x25); // and eax, ~1
+        emit32(~1u);
+        if (d->rd != 0)
+        {
+            emit8(0xC7); // mov dword [rbx + R[rd]], pc + length
+            emit8(0x83);
+            emit32(REG(d->rd));
+            emit32(pc + d->length);
+        }
+        emit_indirect_exit();
+        break;
+    default:
+        break;
+    }
+}
+
+static JitBlock *jit_compile(Address pc, Byte *memory)
+{
+    DecodedInstruction records[JIT_MAX_BLOCK];
+    struct timespec start, end;
+    JitBlock *block;
+    Byte *insufficient;
+    Address at;
+    Word bits;
+    unsigned i, length = 0;
+    int terminated = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (at = pc; length < JIT_MAX_BLOCK && !terminated; at += records[length - 1].length)
+    {
+        if ((at & 0x1) || at >= MEMORY_SPACE || !memory_fetch_pointer(memory, at))
+        {
+            break;
+        }
+        bits = fetch(memory, at);
+        if (!predecodable(bits))
+        {
+            break;
+        }
+        records[length] = *predecode_lookup(at, bits);
+        if (!jit_translatable(records[length].op))
+        {
+            break;
+        }
+        terminated = isa_formats[records[length].op] == FORMAT_BRANCH ||
+                     isa_formats[records[length].op] == FORMAT_J || isa_formats[records[length].op] == FORMAT_JR;
+        length++;
+    }
+    if (length == 0)
+    {
+        return &jit->no_block;
+    }
+    if (jit->block_count == JIT_MAX_BLOCKS ||
+        jit->cursor + JIT_BLOCK_BYTES > jit->buffer + JIT_BUFFER_SIZE)
+    {
+        jit_flush();
+    }
+
+    block = &jit->block_pool[jit->block_count++];
+    block->pc = pc;
+    block->length = length;
+    block->code = jit->cursor;
+
+    emit8(0x49); // cmp r13, length
+    emit8(0x81);
+    emit8(0xFD);
+    emit32(length);
+    emit8(0x0F); // jb insufficient
+    emit8(0x82);
+    emit32(0);
+    insufficient = jit->cursor - 4;
+    emit8(0x49); // sub r13, length
+    emit8(0x81);
+    emit8(0xED);
+    emit32(length);
+
+    for (i = 0, at = pc; i < length; at += records[i++].length)
+    {
+        emit_instruction(&records[i], at, i, length);
+        // a 32-bit instruction may straddle two pages
+        jit->code_pages[at >> 12] = 1;
+        jit->code_pages[(at + records[i].length - 1) >> 12] = 1;
+    }
+    if (!terminated)
+    {
+        emit_exit(at, 1);
+    }
+    patch_rel32(insufficient, jit->cursor);
+    emit_exit(pc, 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    jit->stats.blocks++;
+    jit->stats.instructions += length;
+    jit->stats.bytes += jit->cursor - block->code;
+    jit->stats.compile_seconds += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    return block;
+}
+
+static JitBlock *jit_block_for(Address pc, Byte *memory)
+{
+    JitBlock *block;
+
+    if ((pc & 0x1) || pc >= MEMORY_SPACE)
+    {
+        return &jit->no_block;
+    }
+    block = jit->block_map[pc >> 1];
+    if (!block)
+    {
+        block = jit_compile(pc, memory);
+        jit->block_map[pc >> 1] = block;
+    }
+    return block;
+}
+
+unsigned long execute_jit(Processor *processor, Byte *memory, unsigned long count)
+{
+    unsigned long remaining = count;
+    const DecodedInstruction *d;
+    JitBlock *block;
+
+    if (!jit_init())
+    {
+        return execute_threaded(processor, memory, count);
+    }
+    while (remaining)
+    {
+        current_instance->left = remaining;
+        block = jit_block_for(processor->PC, memory);
+        if (block->length == 0 || block->length > remaining)
+        {
+            jit->last_exit = NULL;
+            d = predecode_lookup(processor->PC, fetch(memory, processor->PC));
+            d->handler(d, processor, memory);
+            processor->R[0] = 0;
+            remaining--;
+            jit->stats.interpreted++;
+            continue;
+        }
+        if (jit->last_exit)
+        {
+            // the previous block left through a stub for this PC: chain it
+            jit->last_exit[0] = 0xE9;
+            patch_rel32(jit->last_exit + 1, block->code);
+            jit->stats.chains++;
+        }
+        // a stop inside the block unwinds past the epilogue, which would
+        // otherwise leave the exit of an earlier block here to be chained
+        jit->last_exit = NULL;
+        jit->dirty = 0;
+        processor->PC = jit->enter(processor, memory, remaining, block->code);
+        jit->stats.native += remaining - jit->remaining;
+        remaining = jit->remaining;
+    }
+    jit->last_exit = NULL;
+    return count;
+}
+
+/* Called by store() for every write to guest memory. */
+void jit_invalidate(Address address, Alignment alignment)
+{
+    Address last = address + alignment - 1;
+
+    jit = current_instance->jit;
+    if (!jit)
+    {
+        return;
+    }
+    if ((address < MEMORY_SPACE && jit->code_pages[address >> 12]) ||
+        (last < MEMORY_SPACE && jit->code_pages[last >> 12]))
+    {
+        jit_flush();
+        jit->dirty = 1;
+    }
+}
+
+/* Prints the statistics of the current instance's JIT to output, or
+ * nothing if it never compiled. */
+void jit_report(FILE *output)
+{
+    jit = current_instance->jit;
+    if (!jit)
+    {
+        return;
+    }
+    fprintf(output, "jit: %lu blocks, %lu instructions, %lu bytes compiled in %.3f ms\n",
+            jit->stats.blocks, jit->stats.instructions, jit->stats.bytes,
+            jit->stats.compile_seconds * 1e3);
+    fprintf(output, "jit: %lu chained exits, %lu flushes\n", jit->stats.chains, jit->stats.flushes);
+    fprintf(output, "jit: %lu instructions native, %lu interpreted\n",
+            jit->stats.native, jit->stats.interpreted);
+}
+
+#else
+
+unsigned long execute_jit(Processor *processor, Byte *memory, unsigned long count)
+{
+    // no code generator for this host, thread the predecoded records instead
+    return execute_threaded(processor, memory, count);
+}
+
+void jit_invalidate(Address address, Alignment alignment)
+{
+}
+
+void jit_report(FILE *output)
+{
+}
+
+void jit_destroy(Jit *destroyed)
+{
+}
+
+#endif
@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "types.h"
+#include "memory.h"
+
+__thread const Byte *found_memory;
+__thread PageTable *found_table;
+
+// every table find_table() can return, newest first
+static PageTable *tables;
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void flush_tlb(PageTable *table)
+{
+    Word i;
+
+    for (i = 0; i < TLB_ENTRIES; i++)
+    {
+        table->tlb[i].read = TLB_INVALID;
+        table->tlb[i].write = TLB_INVALID;
+        table->tlb[i].fetch = TLB_INVALID;
+    }
+}
+
+/* No regions and every page with all rights. Flat memory is all committed
+ * up front, the rest not at all. */
+static void reset_table(PageTable *table)
+{
+    Address page;
+
+    table->committed = table->flat ? MEMORY_PAGES : 0;
+    table->region_count = 0;
+    table->default_flags = MEMORY_RWX;
+    for (page = 0; page < MEMORY_PAGES; page++)
+    {
+        table->pages[page] = table->flat ? MEMORY_RWX | PAGE_COMMITTED : MEMORY_RWX;
+    }
+    flush_tlb(table);
+}
+
+/* The slow path of page_table(): the table of memory, which is a new flat
+ * one if memory did not come from allocate_memory(). Flat tables live as
+ * long as the process, as nothing says when such memory is freed. */
+PageTable *find_table(const Byte *memory)
+{
+    PageTable *table;
+
+    pthread_mutex_lock(&tables_lock);
+    for (table = tables; table && table->memory != memory; table = table->next)
+    {
+    }
+    if (!table)
+    {
+        if (!(table = calloc(1, sizeof(PageTable))))
+        {
+            perror("find_table");
+            exit(-1);
+        }
+        table->memory = memory;
+        table->flat = 1;
+        reset_table(table);
+        table->next = tables;
+        tables = table;
+    }
+    pthread_mutex_unlock(&tables_lock);
+    found_memory = memory;
+    found_table = table;
+    return table;
+}
+
+/* Reserves the page table and the guest address space in one mapping. Only
+ * the page table is accessible up front; guest pages stay PROT_NONE and
+ * count against neither resident nor committed memory until touched. */
+Byte *allocate_memory(void)
+{
+    Byte *base = mmap(NULL, PAGE_TABLE_SIZE + MEMORY_SPACE, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    PageTable *table;
+
+    if (base == MAP_FAILED || mprotect(base, PAGE_TABLE_SIZE, PROT_READ | PROT_WRITE) != 0)
+    {
+        return NULL;
+    }
+    table = (PageTable *)base;
+    table->memory = base + PAGE_TABLE_SIZE;
+    reset_table(table);
+    pthread_mutex_lock(&tables_lock);
+    table->next = tables;
+    tables = table;
+    pthread_mutex_unlock(&tables_lock);
+    return base + PAGE_TABLE_SIZE;
+}
+
+void free_memory(Byte *memory)
+{
+    PageTable **link;
+
+    pthread_mutex_lock(&tables_lock);
+    for (link = &tables; *link && (*link)->memory != memory; link = &(*link)->next)
+    {
+    }
+    if (*link)
+    {
+        *link = (*link)->next;
+    }
+    pthread_mutex_unlock(&tables_lock);
+    if (found_memory == memory)
+    {
+        found_memory = NULL;
+    }
+    munmap(memory - PAGE_TABLE_SIZE, PAGE_TABLE_SIZE + MEMORY_SPACE);
+}
+
+/* Returns memory to how allocate_memory() left it: no regions, every page
+ * with all rights, uncommitted and reading as zero again. Flat memory is
+ * cleared in place and stays committed. */
+void memory_reset(Byte *memory)
+{
+    PageTable *table = page_table(memory);
+
+    if (table->flat)
+    {
+        memset(memory, 0, MEMORY_SPACE);
+    }
+    // a fresh mapping also replaces pages an image or snapshot mapped in
+    else if (mmap(memory, MEMORY_SPACE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED,
+                  -1, 0) == MAP_FAILED)
+    {
+        perror("memory_reset");
+        exit(-1);
+    }
+    reset_table(table);
+}
+
+/* Makes every page the range covers accessible on the host. Loaders call
+ * this before writing guest memory directly; it ignores access rights. */
+void memory_commit(Byte *memory, Address address, Word size)
+{
+    PageTable *table = page_table(memory);
+    Address page, first, last;
+
+    if (size == 0)
+    {
+        return;
+    }
+    first = address >> MEMORY_PAGE_SHIFT;
+    last = (address + size - 1) >> MEMORY_PAGE_SHIFT;
+    for (page = first; page <= last; page++)
+    {
+        if (table->pages[page] & PAGE_COMMITTED)
+        {
+            continue;
+        }
+        if (mprotect(memory + ((size_t)page << MEMORY_PAGE_SHIFT), MEMORY_PAGE_SIZE,
+                     PROT_READ | PROT_WRITE) != 0)
+        {
+            perror("memory_commit");
+            exit(-1);
+        }
+        table->pages[page] |= PAGE_COMMITTED;
+        table->committed++;
+    }
+}
+
+/* Recomputes the rights of one page: the union of every region touching
+ * it, or the default when there is none. */
+static void update_page(PageTable *table, Address page)
+{
+    Address start = page << MEMORY_PAGE_SHIFT;
+    Word flags = 0, i;
+    int covered = 0;
+
+    for (i = 0; i < table->region_count; i++)
+    {
+        if (table->regions[i].base - start < MEMORY_PAGE_SIZE ||
+            start - table->regions[i].base < table->regions[i].size)
+        {
+            flags |= table->regions[i].flags;
+            covered = 1;
+        }
+    }
+    if (!covered)
+    {
+        flags = table->default_flags;
+    }
+    table->pages[page] = (table->pages[page] & PAGE_COMMITTED) | flags;
+}
+
+/* Declares [base, base + size) as a region with the given MEMORY_* rights.
+ * Rights apply per page, so a page shared by two regions allows what
+ * either does. Returns -1 if the region does not fit or the table is
+ * full. */
+int memory_map(Byte *memory, Address base, Word size, Word flags)
+{
+    PageTable *table = page_table(memory);
+    Address page;
+
+    if (size == 0)
+    {
+        return 0;
+    }
+    if (base >= MEMORY_SPACE || size > MEMORY_SPACE - base ||
+        table->region_count == MEMORY_REGIONS)
+    {
+        return -1;
+    }
+    table->regions[table->region_count].base = base;
+    table->regions[table->region_count].size = size;
+    table->regions[table->region_count].flags = flags & MEMORY_RWX;
+    table->region_count++;
+    for (page = base >> MEMORY_PAGE_SHIFT; page <= (base + size - 1) >> MEMORY_PAGE_SHIFT; page++)
+    {
+        update_page(table, page);
+    }
+    flush_tlb(table);
+    return 0;
+}
+
+/* Sets the rights of pages outside every region. MEMORY_RWX, the initial
+ * value, keeps the flat behaviour; 0 makes any stray access fault. */
+void memory_set_default(Byte *memory, Word flags)
+{
+    PageTable *table = page_table(memory);
+    Address page;
+
+    table->default_flags = flags & MEMORY_RWX;
+    for (page = 0; page < MEMORY_PAGES; page++)
+    {
+        update_page(table, page);
+    }
+    flush_tlb(table);
+}
+
+/* Slow path of the memory_*_pointer() lookups: checks the range and the
+ * rights of every page it covers, commits them, and caches the page when
+ * the access is aligned and so cannot cross into the next one. */
+Byte *memory_translate(Byte *memory, Address address, Word size, Word access)
+{
+    PageTable *table = page_table(memory);
+    TlbEntry *entry;
+    Address page, first, last;
+    Word flags;
+
+    if (address >= MEMORY_SPACE || size > MEMORY_SPACE - address)
+    {
+        return NULL;
+    }
+    first = address >> MEMORY_PAGE_SHIFT;
+    last = (address + size - 1) >> MEMORY_PAGE_SHIFT;
+    for (page = first; page <= last; page++)
+    {
+        if (!(table->pages[page] & access))
+        {
+            return NULL;
+        }
+    }
+    memory_commit(memory, address, size);
+    if (!(address & (size - 1)))
+    {
+        flags = table->pages[first];
+        entry = &table->tlb[first & (TLB_ENTRIES - 1)];
+        page = first << MEMORY_PAGE_SHIFT;
+        entry->read = (flags & MEMORY_READ) ? page : TLB_INVALID;
+        entry->write = (flags & MEMORY_WRITE) ? page : TLB_INVALID;
+        entry->fetch = (flags & MEMORY_EXEC) ? page : TLB_INVALID;
+        entry->host = memory + page;
+    }
+    return memory + address;
+}
+
+/* Prints how many pages were committed and how many of those the host
+ * actually holds in RAM. */
+void memory_report(const Byte *memory)
+{
+    const PageTable *table = page_table(memory);
+    unsigned char residency;
+    unsigned long resident = 0;
+    Address page;
+
+    for (page = 0; page < MEMORY_PAGES; page++)
+    {
+        if ((table->pages[page] & PAGE_COMMITTED) &&
+            mincore((void *)(memory + ((size_t)page << MEMORY_PAGE_SHIFT)), MEMORY_PAGE_SIZE,
+                    &residency) == 0 &&
+            (residency & 1))
+        {
+            resident++;
+        }
+    }
+    fprintf(stderr, "memory: %u of %u pages committed, %lu KiB resident\n",
+            table->committed, (unsigned)MEMORY_PAGES, resident * (MEMORY_PAGE_SIZE / 1024));
+}
@@ -0,0 +1,137 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include "types.h"
+
+/* Sparse guest memory. MEMORY_SPACE bytes of host address space are
+ * reserved without backing, and 4 KiB pages are committed the first time
+ * load() or store() touches them. The page table sits in the pages just
+ * below the guest base, so the Byte *memory handle passed everywhere is
+ * enough to find it.
+ *
+ * Any other MEMORY_SPACE bytes, such as the driver's calloc'd memory, are
+ * flat: the first lookup gives them a page table of their own with every
+ * page committed, so bounds and rights are checked the same way. */
+
+#define MEMORY_PAGE_SHIFT 12
+#define MEMORY_PAGE_SIZE (1u << MEMORY_PAGE_SHIFT)
+#define MEMORY_PAGE_MASK ((Address)MEMORY_PAGE_SIZE - 1)
+#define MEMORY_PAGES (MEMORY_SPACE >> MEMORY_PAGE_SHIFT)
+
+/* Access rights of a region, and of each page in pages[]. Pages no region
+ * covers get the table's default rights, initially all three. */
+#define MEMORY_READ 0x1
+#define MEMORY_WRITE 0x2
+#define MEMORY_EXEC 0x4
+#define MEMORY_RWX (MEMORY_READ | MEMORY_WRITE | MEMORY_EXEC)
+#define PAGE_COMMITTED 0x80
+
+#define MEMORY_REGIONS 32
+#define TLB_ENTRIES 64
+
+/* A tag that no access matches: masked addresses keep at most the low two
+ * offset bits, never all twelve. */
+#define TLB_INVALID 0xFFFFFFFFu
+
+typedef struct {
+    Address base;
+    Word size;
+    Word flags; // MEMORY_* rights
+} MemoryRegion;
+
+/* One cached page translation. Each tag is the page's guest address when
+ * that kind of access is allowed and TLB_INVALID otherwise, so a lookup
+ * checks the page, the rights and the alignment in a single compare. */
+typedef struct {
+    Address read;
+    Address write;
+    Address fetch;
+    Byte *host; // host address of the page
+} TlbEntry;
+
+typedef struct PageTable PageTable;
+
+struct PageTable {
+    const Byte *memory; // the guest base the table belongs to
+    PageTable *next;    // the other tables page_table() can find
+    int flat;           // memory is not from allocate_memory()
+    Word committed;     // number of committed pages
+    Word default_flags;
+    Word region_count;
+    MemoryRegion regions[MEMORY_REGIONS];
+    TlbEntry tlb[TLB_ENTRIES];
+    Byte pages[MEMORY_PAGES]; // MEMORY_* rights | PAGE_COMMITTED
+};
+
+#define PAGE_TABLE_SIZE \
+    ((sizeof(PageTable) + MEMORY_PAGE_SIZE - 1) & ~(size_t)(MEMORY_PAGE_SIZE - 1))
+
+/* The memory whose table page_table() last found on this thread, and that
+ * table, see find_table() in memory.c. */
+extern __thread const Byte *found_memory;
+extern __thread PageTable *found_table;
+
+PageTable *find_table(const Byte *memory);
+
+static inline PageTable *page_table(const Byte *memory)
+{
+    if (memory == found_memory)
+    {
+        return found_table;
+    }
+    return find_table(memory);
+}
+
+/* see memory.c */
+Byte *allocate_memory(void);
+void free_memory(Byte *memory);
+void memory_reset(Byte *memory);
+void memory_commit(Byte *memory, Address address, Word size);
+int memory_map(Byte *memory, Address base, Word size, Word flags);
+void memory_set_default(Byte *memory, Word flags);
+Byte *memory_translate(Byte *memory, Address address, Word size, Word access);
+void memory_report(const Byte *memory);
+
+/* Host pointers for an access of size bytes at address, or NULL when the
+ * access leaves MEMORY_SPACE or the page does not allow it. Aligned
+ * accesses to a page in the TLB take one compare; everything else goes
+ * through memory_translate(). */
+static inline Byte *memory_read_pointer(Byte *memory, Address address, Word size)
+{
+    const TlbEntry *entry =
+        &page_table(memory)->tlb[(address >> MEMORY_PAGE_SHIFT) & (TLB_ENTRIES - 1)];
+
+    if (entry->read == (address & (~MEMORY_PAGE_MASK | (size - 1))))
+    {
+        return entry->host + (address & MEMORY_PAGE_MASK);
+    }
+    return memory_translate(memory, address, size, MEMORY_READ);
+}
+
+static inline Byte *memory_write_pointer(Byte *memory, Address address, Word size)
+{
+    const TlbEntry *entry =
+        &page_table(memory)->tlb[(address >> MEMORY_PAGE_SHIFT) & (TLB_ENTRIES - 1)];
+
+    if (entry->write == (address & (~MEMORY_PAGE_MASK | (size - 1))))
+    {
+        return entry->host + (address & MEMORY_PAGE_MASK);
+    }
+    return memory_translate(memory, address, size, MEMORY_WRITE);
+}
+
+static inline Byte *memory_fetch_pointer(Byte *memory, Address address)
+{
+    const TlbEntry *entry =
+        &page_table(memory)->tlb[(address >> MEMORY_PAGE_SHIFT) & (TLB_ENTRIES - 1)];
+
+    // any even address whose word ends in the page, as compressed code
+    // leaves half its instructions 2 mod 4
+    if (entry->fetch == ((address + 2) & (~MEMORY_PAGE_MASK | 1)))
+    {
+        return entry->host + (address & MEMORY_PAGE_MASK);
+    }
+    return memory_translate(memory, address, 4, MEMORY_EXEC);
+}
+
+#endif
@@ -1,510 +1,471 @@
 #include <stdio.h>  // for stderr
 #include <stdlib.h> // for exit()
+#include <string.h> // for memcpy()
 #include "types.h"
 #include "utils.h"
 #include "riscv.h"
+#include "predecode.h"
+#include "memory.h"
+#include "instance.h"
+#include "profile.h"
+#include "timing.h"
+#include "cache.h"
+#include "branches.h"
+#include "debug.h"
 
-void execute_rtype(Instruction, Processor *);
-void execute_itype_except_load(Instruction, Processor *);
-void execute_branch(Instruction, Processor *);
-void execute_jal(Instruction, Processor *);
-void execute_load(Instruction, Processor *, Byte *);
-void execute_store(Instruction, Processor *, Byte *);
 void execute_ecall(Processor *, Byte *);
-void execute_lui(Instruction, Processor *);
+static void exec_breakpoint(const DecodedInstruction *, Processor *, Byte *);
 
 void execute_instruction(uint32_t instruction_bits, Processor *processor, Byte *memory)
 {
-    Instruction instruction = parse_instruction(instruction_bits);
-    switch (instruction.opcode)
-    {
-    case 0x33:
-        execute_rtype(instruction, processor);
-        break;
-    case 0x13:
-        execute_itype_except_load(instruction, processor);
-        break;
-    case 0x73:
-        execute_ecall(processor, memory);
-        break;
-    case 0x63:
-        execute_branch(instruction, processor);
-        break;
-    case 0x6F:
-        execute_jal(instruction, processor);
-        break;
-    case 0x23:
-        execute_store(instruction, processor, memory);
-        break;
-    case 0x03:
-        execute_load(instruction, processor, memory);
-        break;
-    case 0x37:
-        execute_lui(instruction, processor);
-        break;
-    default: // undefined opcode
-        handle_invalid_instruction(instruction);
-        exit(-1);
-        break;
-    }
+    const DecodedInstruction *decoded = predecode_lookup(processor->PC, instruction_bits);
+    decoded->handler(decoded, processor, memory);
 }
 
-void execute_rtype(Instruction instruction, Processor *processor)
+void set_engine(Engine selected)
 {
-    switch (instruction.rtype.funct3)
-    {
-    case 0x0:
-        switch (instruction.rtype.funct7)
-        {
-        case 0x0:
-            // Add
-            processor->R[instruction.rtype.rd] =
-                ((sWord)processor->R[instruction.rtype.rs1]) +
-                ((sWord)processor->R[instruction.rtype.rs2]);
-
-            processor->PC += 4;
-
-            break;
-        case 0x1:
-            // Mul
-            processor->R[instruction.rtype.rd] =
-                ((sWord)processor->R[instruction.rtype.rs1]) *
-                ((sWord)processor->R[instruction.rtype.rs2]);
-
-            processor->PC += 4;
-            break;
-
-        case 0x20:
-            // Sub
-            processor->R[instruction.rtype.rd] =
-                ((sWord)processor->R[instruction.rtype.rs1]) -
-                ((sWord)processor->R[instruction.rtype.rs2]);
-
-            processor->PC += 4;
-
-            break;
-
-        default:
-            handle_invalid_instruction(instruction);
-            exit(-1);
-            break;
-        }
-        break;
-    case 0x1:
-        switch (instruction.rtype.funct7)
-        {
-        case 0x0:
-            // SLL
-            //     sWord shift = 0x00000000;
-            //    shift |= ((sWord)processor->R[instruction.rtype.rs2]) & 0x0000001F;
-            // processor->R[instruction.rtype.rd] =
-            //     ((sWord)processor->R[instruction.rtype.rs1]) << ((((sWord)processor->R[instruction.rtype.rs2]) & 0x0000001F)| 0x00000000);
-            processor->R[instruction.rtype.rd] = (processor->R[instruction.rtype.rs1]) << (processor->R[instruction.rtype.rs2]);
-            processor->PC += 4;
-
-            break;
-        case 0x1:;
-            // MULH
-            sDouble result = (((sDouble)instruction.rtype.rs1) * ((sDouble)instruction.rtype.rs2)) >> 32;
-            // sDouble result = 0x0000000000000000, t1 = 0x0000000000000000, t2 = 0x00000000;
-            // result |= (((sDouble)processor->R[instruction.rtype.rs1]) | t1) * (((sDouble)processor->R[instruction.rtype.rs1]) | t1);
-            // t2 |= ((result & 0xFFFFFFFF00000000) >> 32);
-            processor->R[instruction.rtype.rd] = result;
-            processor->PC += 4;
-
-            break;
-        case 0x2:
-            // SLT
-            processor->R[instruction.rtype.rd] =
-                (((sWord)processor->R[instruction.rtype.rs1]) <
-                 ((sWord)processor->R[instruction.rtype.rs2]))
-                    ? 1
-                    : 0;
-            processor->PC += 4;
-            break;
-        case 0x4:
-            switch (instruction.rtype.funct7)
-            {
-            case 0x0:
-                // XOR
-                processor->R[instruction.rtype.rd] =
-                    (sWord)(((sWord)processor->R[instruction.rtype.rs1]) ^
-                            ((sWord)processor->R[instruction.rtype.rs2]));
-                processor->PC += 4;
-
-                break;
-            case 0x1:
-                // DIV
-                processor->R[instruction.rtype.rd] =
-                    (((sWord)processor->R[instruction.rtype.rs1]) /
-                     ((sWord)processor->R[instruction.rtype.rs2]));
-                processor->PC += 4;
-                break;
-            default:
-                handle_invalid_instruction(instruction);
-                exit(-1);
-                break;
-            }
-            break;
-        case 0x5:
-            switch (instruction.rtype.funct7)
-            {
-            case 0x0:
-                // SRL
-                processor->R[instruction.rtype.rd] =
-                    ((Word)processor->R[instruction.rtype.rs1]) >>
-                    (((Word)processor->R[instruction.rtype.rs2]) & 0x1F);
-                processor->PC += 4;
-
-                break;
-            case 0x20:
-                // SRA
-                processor->R[instruction.rtype.rd] =
-                    ((sWord)processor->R[instruction.rtype.rs1]) >>
-                    (((sWord)processor->R[instruction.rtype.rs2]) & 0x1F);
-                processor->PC += 4;
-
-                break;
-            default:
-                handle_invalid_instruction(instruction);
-                exit(-1);
-                break;
-            }
-            break;
-        case 0x6:
-            switch (instruction.rtype.funct7)
-            {
-            case 0x0:
-                // OR
-                processor->R[instruction.rtype.rd] =
-                    (((sWord)processor->R[instruction.rtype.rs1]) |
-                     ((sWord)processor->R[instruction.rtype.rs2]));
-                processor->PC += 4;
-                break;
-            case 0x1:
-                // REM
-                processor->R[instruction.rtype.rd] =
-                    (((sWord)processor->R[instruction.rtype.rs1]) %
-                     ((sWord)processor->R[instruction.rtype.rs2]));
-                processor->PC += 4;
-                break;
-            default:
-                handle_invalid_instruction(instruction);
-                exit(-1);
-                break;
-            }
-            break;
-        case 0x7:
-            // AND
-            processor->R[instruction.rtype.rd] =
-                (((sWord)processor->R[instruction.rtype.rs1]) &
-                 ((sWord)processor->R[instruction.rtype.rs2]));
-            processor->PC += 4;
-            break;
-        default:
-            handle_invalid_instruction(instruction);
-            exit(-1);
-            break;
-        }
-    }
-    // processor->PC += 4;
+    current_instance->engine = selected;
 }
 
-void execute_itype_except_load(Instruction instruction, Processor *processor)
+/* Whether words whose low two bits are not 0b11 decode as RV32C
+ * instructions, see emulator_set_compressed(). */
+void set_compressed(int enabled)
 {
-    switch (instruction.itype.funct3)
-    {
-    case 0x0:
-        // ADDI
-        processor->R[instruction.itype.rd] =
-            ((sWord)(processor->R[instruction.itype.rs1])) +
-            sign_extend_number((instruction.itype.imm), 12);
-        processor->PC += 4;
-
-        // processor->R[instruction.itype.rd] = 0xAAAAAAA;
-
-        break;
-    case 0x1:
-        // SLLI
-        processor->R[instruction.itype.rd] =
-            // ((sWord)processor->R[instruction.itype.rs1]) << ((sWord)processor->R[instruction.itype.imm]); ////////////
-            ((sWord)processor->R[instruction.itype.rs1]) << ((sWord)sign_extend_number(instruction.itype.imm, 12));
-        processor->PC += 4;
-
-        break;
-    case 0x2:
-        // STLI
-        if ((sWord)(processor->R[instruction.itype.rs1]) < (sWord)(instruction.itype.imm))
-        {
-            processor->R[instruction.itype.rd] = 0x00000001;
-        }
-        else
-        {
-            processor->R[instruction.itype.rd] = 0x00000000;
-        }
-        processor->PC += 4;
-        // processor->R[instruction.itype.rd] = ((sWord)(instruction.itype.rs1) <
-        //                                       (sWord)(instruction.itype.imm))? 1 : 0;
-        break;
-    case 0x4:
-        // XORI
-        processor->R[instruction.itype.rd] = (sWord)(processor->R[instruction.itype.rs1]) ^
-                                             (sWord)sign_extend_number(instruction.itype.imm, 12);
-        processor->PC += 4;
+    current_instance->compressed = enabled;
+    instance_flush(current_instance);
+}
 
-        break;
-    case 0x5:;
-        // Shift Right (You must handle both logical and arithmetic)
-        int shift = 0x00000000, temp = 0x00000000;
-        temp |= ((instruction.itype.imm) & 0xFE0) >> 5;
-        shift |= (instruction.itype.imm) & 0x01F;
-        if ((sWord)temp == 0x00000000)
+/* Runs count instructions fetched from memory at PC, keeping x0 hard-wired
+ * to zero after each one as the driver does between single steps. */
+unsigned long execute_steps(Processor *processor, Byte *memory, unsigned long count)
+{
+    const DecodedInstruction *decoded;
+    Instance *instance = current_instance;
+    DecodedInstruction *cache = instance->predecode_cache;
+    unsigned long i;
+
+    // side models and breakpoints watch the handlers, which only this loop calls
+    if (current_instance->engine == ENGINE_THREADED && !instance_observed(current_instance) &&
+        !current_instance->debug)
+    {
+        return execute_threaded(processor, memory, count);
+    }
+    if (current_instance->engine == ENGINE_JIT && !instance_observed(current_instance) &&
+        !current_instance->debug)
+    {
+        return execute_jit(processor, memory, count);
+    }
+    for (i = 0; i < count; i++)
+    {
+        instance->left = count - i;
+        // a cached record needs no fetch
+        if (!(processor->PC & 0x1) && processor->PC < MEMORY_SPACE &&
+            cache[processor->PC >> 1].handler)
         {
-            processor->R[instruction.itype.rd] = ((Word)processor->R[instruction.itype.rs1]) >> shift;
+            decoded = &cache[processor->PC >> 1];
         }
         else
         {
-            processor->R[instruction.itype.rd] = ((Word)processor->R[instruction.itype.rs1]) >> shift;
+            decoded = predecode_lookup(processor->PC, fetch(memory, processor->PC));
         }
-        processor->PC += 4;
-        break;
-
-    case 0x6:
-        // ORI
-        processor->R[instruction.itype.rd] =
-            (sWord)processor->R[instruction.itype.rs1] |
-            (sWord)processor->R[instruction.itype.imm] | 0x00000000;
-        processor->PC += 4;
-
-        break;
-    case 0x7:
-        // ANDI
-        processor->R[instruction.itype.rd] =
-            ((sWord)processor->R[instruction.itype.rs1]) &
-            (sign_extend_number((instruction.itype.imm), 12));
-        processor->PC += 4;
-
-        break;
-    default:
-        handle_invalid_instruction(instruction);
-        break;
+        decoded->handler(decoded, processor, memory);
+        processor->R[0] = 0;
     }
+    return count;
 }
 
-void execute_ecall(Processor *p, Byte *memory)
+DecodedInstruction *predecode_lookup(Address pc, uint32_t instruction_bits)
 {
-    Register i;
+    DecodedInstruction *decoded;
 
-    // syscall number is given by a0 (x10)
-    // argument is given by a1
-    switch (p->R[10])
+    if ((pc & 0x1) || pc >= MEMORY_SPACE)
     {
-    case 1: // print an integer
-        printf("%d", p->R[11]);
-        break;
-    case 4: // print a string
-        for (i = p->R[11]; i < MEMORY_SPACE && load(memory, i, LENGTH_BYTE); i++)
+        // not cacheable, decode it every time; the scratch records after it
+        // stay empty so the threaded engine looks up the next PC again
+        decoded = &current_instance->predecode_scratch[0];
+        predecode(decoded, instruction_bits);
+    }
+    else
+    {
+        decoded = &current_instance->predecode_cache[pc >> 1];
+        if (decoded->handler)
         {
-            printf("%c", load(memory, i, LENGTH_BYTE));
+            return decoded;
         }
-        break;
-    case 10: // exit
-        printf("exiting the simulator\n");
-        exit(0);
-        break;
-    case 11: // print a character
-        printf("%c", p->R[11]);
-        break;
-    default: // undefined ecall
-        printf("Illegal ecall number %d\n", p->R[10]);
-        exit(-1);
-        break;
+        predecode(decoded, instruction_bits);
     }
+    // the only place a breakpoint costs anything
+    if (current_instance->debug && debug_breakpoint(current_instance->debug, pc))
+    {
+        decoded->handler = exec_breakpoint;
+    }
+    return decoded;
 }
 
-void execute_branch(Instruction instruction, Processor *processor)
+/* The first slot whose record may cover bytes at the parcel first: a
+ * 32-bit instruction starting one parcel before. */
+#define COVERING(first) ((first) ? (first) - 1 : 0)
+
+/* Drops the decoded records of every instruction touched by a store. The
+ * records up to 10 bytes before it lose their threaded target as well,
+ * since a fused sequence of up to three 32-bit instructions starting there
+ * may have covered the overwritten bytes. */
+void predecode_invalidate(Address address, Alignment alignment)
 {
-    switch (instruction.sbtype.funct3)
+    DecodedInstruction *predecode_cache = current_instance->predecode_cache;
+    Address first = address >> 1;
+    Address last = (address + alignment - 1) >> 1;
+    Address slot;
+
+    for (slot = first >= 5 ? first - 5 : 0; slot <= last && slot < PREDECODE_ENTRIES; slot++)
     {
-    case 0x0:
-        // BEQ
-        if ((sWord)processor->R[instruction.sbtype.rs1] == (sWord)processor->R[instruction.sbtype.rs2])
-        {
-            processor->PC += (sWord)get_branch_offset(instruction);
-        }
-        else
+        if (slot >= COVERING(first))
         {
-            processor->PC += 4;
+            predecode_cache[slot].handler = NULL;
         }
+        predecode_cache[slot].target = NULL;
+    }
+}
 
-        break;
-    case 0x1:
-        // BNE
-        if ((sWord)processor->R[instruction.sbtype.rs1] != (sWord)processor->R[instruction.sbtype.rs2])
-        {
-            processor->PC += (sWord)get_branch_offset(instruction);
-        }
-        else
+/* Whether parse_instruction knows the opcode, i.e. the word can be decoded
+ * ahead of execution without exiting. */
+int predecodable(uint32_t instruction_bits)
+{
+    return isa_opcode_known(current_instance->compressed ? isa_expand(instruction_bits) : instruction_bits);
+}
+
+/* Whether any decoded record covers bytes a store of alignment bytes at
+ * address writes. */
+static int predecoded(Address address, Alignment alignment)
+{
+    DecodedInstruction *predecode_cache = current_instance->predecode_cache;
+    Address slot;
+
+    for (slot = COVERING(address >> 1); slot <= (address + alignment - 1) >> 1; slot++)
+    {
+        if (predecode_cache[slot].handler)
         {
-            processor->PC += 4;
+            return 1;
         }
-        break;
-    default:
-        handle_invalid_instruction(instruction);
-        exit(-1);
-        break;
     }
+    return 0;
 }
 
-void execute_load(Instruction instruction, Processor *processor, Byte *memory)
+void predecode_reset(void)
 {
-    switch (instruction.itype.funct3)
+    DecodedInstruction *predecode_cache = current_instance->predecode_cache;
+    Address i;
+
+    for (i = 0; i < PREDECODE_ENTRIES; i++)
     {
-    case 0x0:
-        // LB
-        processor->R[instruction.itype.rd] = load(memory,
-                                                  (sWord)(processor->R[instruction.itype.rs1]) + (sWord)sign_extend_number(instruction.itype.imm, 12),
-                                                  LENGTH_BYTE);
+        predecode_cache[i].handler = NULL;
+        predecode_cache[i].target = NULL;
+    }
+}
 
-        processor->PC += 4;
+/* Operands and effects for the isa.def lines, see isa.def. */
+#define RS1 processor->R[d->rs1]
+#define RS2 processor->R[d->rs2]
+#define IMM d->imm
+#define HERE processor->PC
+
+#define EXECUTE_R(value)           \
+    processor->R[d->rd] = (value); \
+    processor->PC += d->length
+#define EXECUTE_I EXECUTE_R
+#define EXECUTE_SHIFT EXECUTE_R
+#define EXECUTE_U EXECUTE_R
+#define EXECUTE_LOAD(access)                                                                \
+    processor->R[d->rd] = ISA_EXTEND(load(memory, RS1 + IMM, ISA_WIDTH(access)), (access)); \
+    processor->PC += d->length
+#define EXECUTE_STORE(width)                \
+    store(memory, RS1 + IMM, (width), RS2); \
+    processor->PC += d->length
+#define EXECUTE_BRANCH(taken) processor->PC += (taken) ? IMM : d->length
+// the target is worked out before rd is written, which may be rs1
+#define EXECUTE_J(target)                            \
+    Address next = (target);                         \
+    processor->R[d->rd] = processor->PC + d->length; \
+    processor->PC = next
+#define EXECUTE_JR EXECUTE_J
+#define EXECUTE_ECALL(unused)         \
+    execute_ecall(processor, memory); \
+    processor->PC += d->length
+
+#define INSTRUCTION(op, name, opcode, funct3, funct7, format, effect)                        \
+    static void exec_##name(const DecodedInstruction *d, Processor *processor, Byte *memory) \
+    {                                                                                        \
+        EXECUTE_##format(effect);                                                            \
+    }
+#include "isa.def"
+#undef INSTRUCTION
 
-        break;
-    case 0x1:
-        // LH
+static void exec_invalid(const DecodedInstruction *d, Processor *processor, Byte *memory)
+{
+    handle_invalid_instruction(d->instruction);
+    instance_stop(STOP_INVALID_INSTRUCTION, -1);
+}
 
-        processor->R[instruction.itype.rd] = load(memory,
-                                                  (sWord)(processor->R[instruction.itype.rs1]) + (sWord)sign_extend_number(instruction.itype.imm, 12),
-                                                  LENGTH_HALF_WORD);
+static const Handler handlers[OP_COUNT] = {
+#define INSTRUCTION(op, name, opcode, funct3, funct7, format, effect) [OP_##op] = exec_##name,
+#include "isa.def"
+#undef INSTRUCTION
+    [OP_INVALID] = exec_invalid,
+};
 
-        processor->PC += 4;
+/* The handler of every record while the instance is observed: runs the
+ * op's own handler and shows the instruction to each side model. */
+static void exec_observed(const DecodedInstruction *d, Processor *processor, Byte *memory)
+{
+    Instance *instance = current_instance;
+    Address pc = processor->PC;
+    Address address = (sWord)processor->R[d->rs1] + d->imm; // before a load replaces rs1
 
-        break;
-    case 0x2:
-        // LW
+    if (instance->profile)
+    {
+        profile_count(instance->profile, d, pc);
+    }
+    handlers[d->op](d, processor, memory);
+    if (instance->profile)
+    {
+        profile_retire(instance->profile, d, pc, processor->PC);
+    }
+    if (instance->timing)
+    {
+        timing_retire(instance->timing, d, pc, processor->PC);
+    }
+    if (instance->cache)
+    {
+        cache_retire(instance->cache, d, pc, address);
+    }
+    if (instance->branches)
+    {
+        branches_retire(instance->branches, d, pc, processor->PC);
+    }
+    if (instance->watching)
+    {
+        debug_watch(instance->debug, d, address);
+    }
+}
 
-        processor->R[instruction.itype.rd] = load(memory,
-                                                  (sWord)(processor->R[instruction.itype.rs1]) + (sWord)sign_extend_number(instruction.itype.imm, 12),
-                                                  LENGTH_WORD);
+/* The handler of a record at a breakpoint: stops the run before the
+ * instruction unless the run started there, see debug.h. */
+static void exec_breakpoint(const DecodedInstruction *d, Processor *processor, Byte *memory)
+{
+    Debug *debug = current_instance->debug;
 
-        processor->PC += 4;
+    if (processor->PC != debug->step_over)
+    {
+        instance_stop(STOP_BREAKPOINT, 0);
+    }
+    debug->step_over = DEBUG_NONE;
+    if (instance_observed(current_instance))
+    {
+        exec_observed(d, processor, memory);
+    }
+    else
+    {
+        handlers[d->op](d, processor, memory);
+    }
+}
 
-        break;
-    default:
-        handle_invalid_instruction(instruction);
-        processor->PC += 4;
+void predecode(DecodedInstruction *decoded, uint32_t instruction_bits)
+{
+    int compressed = current_instance->compressed && ISA_LENGTH(instruction_bits) == 2;
+    Word bits = compressed ? isa_expand(instruction_bits) : instruction_bits;
+    Instruction instruction = parse_instruction(bits);
+
+    decoded->op = isa_decode(bits);
+    decoded->length = compressed ? 2 : 4;
+    decoded->handler = instance_observed(current_instance) ? exec_observed : handlers[decoded->op];
+    decoded->target = NULL;
+    decoded->instruction = instruction;
+    decoded->imm = 0;
+    decoded->rd = 0;
+    decoded->rs1 = 0;
+    decoded->rs2 = 0;
+    switch (isa_formats[decoded->op])
+    {
+    case FORMAT_R:
+        decoded->rd = instruction.rtype.rd;
+        decoded->rs1 = instruction.rtype.rs1;
+        decoded->rs2 = instruction.rtype.rs2;
+        break;
+    case FORMAT_I:
+    case FORMAT_LOAD:
+    case FORMAT_JR:
+        decoded->rd = instruction.itype.rd;
+        decoded->rs1 = instruction.itype.rs1;
+        decoded->imm = sign_extend_number(instruction.itype.imm, 12);
+        break;
+    case FORMAT_SHIFT:
+        decoded->rd = instruction.itype.rd;
+        decoded->rs1 = instruction.itype.rs1;
+        decoded->imm = instruction.itype.imm & 0x1F;
+        break;
+    case FORMAT_STORE:
+        decoded->rs1 = instruction.stype.rs1;
+        decoded->rs2 = instruction.stype.rs2;
+        decoded->imm = get_store_offset(instruction);
+        break;
+    case FORMAT_BRANCH:
+        decoded->rs1 = instruction.sbtype.rs1;
+        decoded->rs2 = instruction.sbtype.rs2;
+        decoded->imm = get_branch_offset(instruction);
+        break;
+    case FORMAT_U:
+        decoded->rd = instruction.utype.rd;
+        decoded->imm = (sWord)sign_extend_number(instruction.utype.imm, 20) << 12;
+        break;
+    case FORMAT_J:
+        decoded->rd = instruction.ujtype.rd;
+        decoded->imm = get_jump_offset(instruction);
         break;
     }
 }
 
-void execute_store(Instruction instruction, Processor *processor, Byte *memory)
+void execute_ecall(Processor *p, Byte *memory)
 {
-    switch (instruction.stype.funct3)
-    {
-    case 0x0:;
-        // SB
-        sWord temp = (sWord)(processor->R[instruction.stype.rs1]) + (sWord)get_store_offset(instruction);
-        store(memory,
-              temp,
-              LENGTH_BYTE,
-              (processor->R[instruction.stype.rs2]));
-        processor->PC += 4;
+    Register i;
 
+    // syscall number is given by a0 (x10)
+    // argument is given by a1
+    switch (p->R[10])
+    {
+    case 1: // print an integer
+        instance_printf("%d", p->R[11]);
         break;
-    case 0x1:
-        // SH
-        store(memory,
-              (sWord)(processor->R[instruction.stype.rs1]) + (sWord)get_store_offset(instruction),
-              LENGTH_HALF_WORD,
-              (processor->R[instruction.stype.rs2]));
-        processor->PC += 4;
+    case 4: // print a string
+        for (i = p->R[11]; i < MEMORY_SPACE && load(memory, i, LENGTH_BYTE); i++)
+        {
+            instance_printf("%c", load(memory, i, LENGTH_BYTE));
+        }
         break;
-    case 0x2:
-        // SW
-        store(memory,
-              (sWord)(processor->R[instruction.stype.rs1]) + (sWord)get_store_offset(instruction),
-              LENGTH_WORD,
-              (processor->R[instruction.stype.rs2]));
-        processor->PC += 4;
+    case 10: // exit
+        instance_printf("exiting the simulator\n");
+        instance_stop(STOP_EXIT, 0);
         break;
-    default:
-        handle_invalid_instruction(instruction);
-        exit(-1);
+    case 11: // print a character
+        instance_printf("%c", p->R[11]);
+        break;
+    default: // undefined ecall
+        instance_printf("Illegal ecall number %d\n", p->R[10]);
+        instance_stop(STOP_INVALID_ECALL, -1);
         break;
     }
 }
 
-void execute_jal(Instruction instruction, Processor *processor)
-{
-    processor->R[instruction.utype.rd] = processor->PC + 4;
-    processor->PC += get_jump_offset(instruction);
-
-    /* YOUR CODE HERE */
-}
-
-void execute_lui(Instruction instruction, Processor *processor)
-{
-    /* YOUR CODE HERE */
-    // processor->R[instruction.utype.rd] = 0xbcd5b000;
-
-    // processor->R[instruction.utype.rd] = (sWord)sign_extend_number(instruction.utype.imm,20) << 12;
-    processor->R[instruction.utype.rd] = (sWord)sign_extend_number(instruction.utype.imm, 20) << 12;
-    processor->PC += 4;
-    // 10111100110101011011
-    // 00000000000011101111111111111111
-}
-
 void store(Byte *memory, Address address, Alignment alignment, Word value)
 {
     /* YOUR CODE HERE */
+    Byte *host = memory_write_pointer(memory, address, alignment);
+    Half half;
+
+    if (!host)
+    {
+        handle_invalid_write(address);
+        return;
+    }
+    // a fused record only covers instructions that are decoded themselves,
+    // so data stores usually find nothing to invalidate
+    if (predecoded(address, alignment))
+    {
+        predecode_invalidate(address, alignment);
+    }
+    jit_invalidate(address, alignment);
     if (alignment == LENGTH_BYTE)
     {
-        memory[address] = (Byte)(value & 0x000000FF);
+        host[0] = (Byte)(value & 0x000000FF);
         return;
     }
-    else if (alignment == LENGTH_HALF_WORD || alignment == LENGTH_WORD)
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    // guest and host byte order agree, so aligned accesses copy whole
+    if (!(address & (alignment - 1)))
     {
-
-        memory[address] = (Byte)(value & 0x000000FF);
-        memory[address + 1] = (Byte)((value & 0x0000FF00) >> 8);
-        if (alignment == LENGTH_HALF_WORD)
+        if (alignment == LENGTH_WORD)
+        {
+            memcpy(host, &value, sizeof(Word));
+        }
+        else
         {
-            return;
+            half = (Half)value;
+            memcpy(host, &half, sizeof(Half));
         }
-        memory[address + 2] = (Byte)((value & 0x0000FF00) >> 16);
-        memory[address + 3] = (Byte)((value & 0x00FF0000) >> 24);
+        return;
+    }
+#endif
+    host[0] = (Byte)(value & 0x000000FF);
+    host[1] = (Byte)((value & 0x0000FF00) >> 8);
+    if (alignment == LENGTH_HALF_WORD)
+    {
+        return;
     }
-    return;
+    host[2] = (Byte)((value & 0x00FF0000) >> 16);
+    host[3] = (Byte)((value & 0xFF000000) >> 24);
 }
 
 Word load(Byte *memory, Address address, Alignment alignment)
 {
     /* YOUR CODE HERE */
+    const Byte *host = memory_read_pointer(memory, address, alignment);
     Word result = 0x00000000;
-    if (alignment == LENGTH_BYTE)
+    Half half;
+
+    if (!host)
     {
-        result |= memory[address];
+        handle_invalid_read(address);
         return result;
-        // return (result | memory[address]);
     }
-    else if (alignment == LENGTH_HALF_WORD || alignment == LENGTH_WORD)
+    if (alignment == LENGTH_BYTE)
+    {
+        return host[0];
+    }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (!(address & (alignment - 1)))
     {
-        // for(int i = 0; i < 4; i++){
-        //     result = result | (memory[address+i]<<(i*8));
-        //     if (alignment == LENGTH_HALF_WORD && i == 1){
-        //         return result;
-        //     }
-        // }
-        result |= memory[address];
-        result |= (memory[address + 1] << 8);
-        if (alignment == LENGTH_HALF_WORD)
+        if (alignment == LENGTH_WORD)
         {
+            memcpy(&result, host, sizeof(Word));
             return result;
         }
-        result |= (memory[address + 2] << 16);
-        result |= (memory[address + 3] << 24);
-
+        memcpy(&half, host, sizeof(Half));
+        return half;
+    }
+#endif
+    result |= host[0];
+    result |= (host[1] << 8);
+    if (alignment == LENGTH_HALF_WORD)
+    {
         return result;
     }
-
+    result |= (host[2] << 16);
+    result |= ((Word)host[3] << 24);
     return result;
 }
+
+/* Reads the instruction word at address, which must lie in executable
+ * memory. A compressed instruction may end where executable memory does,
+ * so when the word does not fit its low half is fetched alone; the upper
+ * half is then 0. Instruction fetch faults are reported as bad reads. */
+Word fetch(Byte *memory, Address address)
+{
+    const Byte *host = memory_fetch_pointer(memory, address);
+    Word bits;
+
+    if (!host)
+    {
+        host = current_instance->compressed ? memory_translate(memory, address, 2, MEMORY_EXEC) : NULL;
+        if (!host || (host[0] & 3) == 3)
+        {
+            handle_invalid_read(address);
+            return 0;
+        }
+        return host[0] | host[1] << 8;
+    }
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(&bits, host, sizeof(Word));
+#else
+    bits = host[0] | (host[1] << 8) | (host[2] << 16) | ((Word)host[3] << 24);
+#endif
+    return bits;
+}
@@ -0,0 +1,59 @@
+#ifndef PREDECODE_H
+#define PREDECODE_H
+
+#include "types.h"
+#include "isa.h"
+
+/* Instruction sequences the threaded engine runs as a single dispatch,
+ * see fusion.c. */
+typedef enum {
+    FUSE_NONE,
+    FUSE_LUI_ADDI,      // lui rd, hi; addi rd2, rd, lo
+    FUSE_ADDI_BNE,      // addi rd, rs, imm; bne on rd
+    FUSE_SLLI_ADD,      // slli t, a, k; add rd, b, t
+    FUSE_ADDI_SLLI_ADD, // addi a, a, imm; slli t, a, k; add rd, b, t
+    FUSION_COUNT
+} Fusion;
+
+typedef struct DecodedInstruction DecodedInstruction;
+
+/* Executes one predecoded instruction, including its PC update. */
+typedef void (*Handler)(const DecodedInstruction *, Processor *, Byte *);
+
+/* An instruction decoded once: the handler to run, the register indices
+ * and an immediate that is already sign-extended (or assembled into a byte
+ * offset for branches, jumps and stores). A compressed instruction is
+ * decoded from the word isa_expand() gives it, so only its length tells
+ * it apart. */
+struct DecodedInstruction {
+    Handler handler;
+    const void *target; // threaded engine code for op, NULL until first dispatched
+    sWord imm;
+    Byte op;
+    Byte rd;
+    Byte rs1;
+    Byte rs2;
+    Byte length;             // 4, or 2 for a compressed instruction
+    Instruction instruction; // the expanded word, for invalid instruction reports
+};
+
+/* One cache slot per 2-byte parcel of the address space, where an
+ * instruction may start once compressed ones are mixed in. Each instance's
+ * cache (see instance.h) is indexed by PC >> 1 and has one extra last slot
+ * that is never decoded, so an engine stepping sequentially off the end of
+ * memory sees an empty record. A slot with a NULL handler has not been
+ * decoded yet (or was overwritten). The record of the next instruction is
+ * length / 2 slots on. */
+#define PREDECODE_ENTRIES (MEMORY_SPACE / 2)
+
+/* see part2.c */
+void predecode(DecodedInstruction *decoded, uint32_t instruction_bits);
+DecodedInstruction *predecode_lookup(Address pc, uint32_t instruction_bits);
+void predecode_invalidate(Address address, Alignment alignment);
+void predecode_reset(void);
+int predecodable(uint32_t instruction_bits);
+
+/* see fusion.c */
+Fusion fuse(const DecodedInstruction *decoded, Address pc, Byte *memory);
+
+#endif
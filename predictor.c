@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "predictor.h"
+
+#define COUNTER_BITS 12              // 4096 two-bit counters in bimodal and gshare
+#define COUNTERS (1 << COUNTER_BITS)
+#define TAGE_TABLES 4
+#define TAGE_BITS 10                 // entries per tagged table
+#define TAGE_TAG_BITS 8
+#define TAGE_AGING (1 << 18)         // updates between halvings of the useful bits
+
+static const char *const names[PREDICTOR_KINDS] = {
+    [PREDICT_NOT_TAKEN] = "not-taken",
+    [PREDICT_BACKWARD] = "backward-taken",
+    [PREDICT_BIMODAL] = "bimodal",
+    [PREDICT_GSHARE] = "gshare",
+    [PREDICT_TAGE] = "tage-lite",
+};
+
+// branches of global history each tagged table hashes, roughly geometric
+static const Byte history_lengths[TAGE_TABLES] = {5, 12, 27, 60};
+
+typedef struct {
+    Predictor predictor;
+    Word history;            // outcomes so far, the latest in bit 0
+    Byte counters[COUNTERS]; // 0 and 1 predict not taken, 2 and 3 taken
+} CounterPredictor;
+
+typedef struct {
+    Byte tag;
+    sByte counter; // -4 to 3, taken when not negative
+    Byte useful;   // 0 to 3, only a useless entry is replaced
+} TageEntry;
+
+/* Which entries a branch maps to and what they say. */
+typedef struct {
+    Word index[TAGE_TABLES];
+    Byte tag[TAGE_TABLES];
+    int provider;    // longest table with a matching tag, -1 for the base
+    int provided;    // the provider's prediction
+    int alternative; // what the next shorter match or the base says
+    int prediction;
+} TageLookup;
+
+typedef struct {
+    Predictor predictor;
+    Double history;
+    // each table's history xored down to its index and tag widths, kept up
+    // to date a branch at a time rather than folded for every lookup
+    Word indices[TAGE_TABLES];
+    Word tags[TAGE_TABLES];
+    TageLookup lookup;  // the last prediction's, so update need not repeat it
+    Address looked_up;  // the PC it was for plus 1, 0 once used
+    Word updates;
+    Byte base[COUNTERS];
+    TageEntry tables[TAGE_TABLES][1 << TAGE_BITS];
+} TagePredictor;
+
+static int predict_not_taken(Predictor *predictor, Address pc, Address target)
+{
+    return 0;
+}
+
+static int predict_backward(Predictor *predictor, Address pc, Address target)
+{
+    // loops close with a backward branch
+    return target <= pc;
+}
+
+static void update_static(Predictor *predictor, Address pc, Address target, int taken)
+{
+}
+
+static Byte count(Byte counter, int taken)
+{
+    if (taken)
+    {
+        return counter < 3 ? counter + 1 : counter;
+    }
+    return counter > 0 ? counter - 1 : counter;
+}
+
+static int predict_bimodal(Predictor *predictor, Address pc, Address target)
+{
+    return ((CounterPredictor *)predictor)->counters[(pc >> 2) & (COUNTERS - 1)] >> 1;
+}
+
+static void update_bimodal(Predictor *predictor, Address pc, Address target, int taken)
+{
+    Byte *counter = &((CounterPredictor *)predictor)->counters[(pc >> 2) & (COUNTERS - 1)];
+
+    *counter = count(*counter, taken);
+}
+
+static Byte *gshare_counter(CounterPredictor *gshare, Address pc)
+{
+    return &gshare->counters[((pc >> 2) ^ gshare->history) & (COUNTERS - 1)];
+}
+
+static int predict_gshare(Predictor *predictor, Address pc, Address target)
+{
+    return *gshare_counter((CounterPredictor *)predictor, pc) >> 1;
+}
+
+static void update_gshare(Predictor *predictor, Address pc, Address target, int taken)
+{
+    CounterPredictor *gshare = (CounterPredictor *)predictor;
+    Byte *counter = gshare_counter(gshare, pc);
+
+    *counter = count(*counter, taken);
+    gshare->history = gshare->history << 1 | (taken != 0);
+}
+
+/* Folds the newest outcome of history, which has just been shifted in,
+ * into the newest length outcomes xored down to bits bits, and folds out
+ * the one that has just left them. */
+static inline Word fold(Word folded, Double history, Byte length, Byte bits)
+{
+    folded = folded << 1 | (history & 1);
+    folded ^= (Word)(history >> length & 1) << length % bits;
+    folded ^= folded >> bits;
+    return folded & ((1u << bits) - 1);
+}
+
+static void tage_lookup(TagePredictor *tage, Address pc, TageLookup *lookup)
+{
+    TageEntry *entry;
+    Word word = pc >> 2;
+    int i;
+
+    lookup->provider = -1;
+    lookup->provided = lookup->alternative = tage->base[word & (COUNTERS - 1)] >> 1;
+    for (i = 0; i < TAGE_TABLES; i++)
+    {
+        lookup->index[i] = (word ^ word >> TAGE_BITS ^ tage->indices[i]) & ((1 << TAGE_BITS) - 1);
+        lookup->tag[i] = (word ^ tage->tags[i]) & ((1 << TAGE_TAG_BITS) - 1);
+        entry = &tage->tables[i][lookup->index[i]];
+        if (entry->tag == lookup->tag[i])
+        {
+            lookup->alternative = lookup->provided;
+            lookup->provider = i;
+            lookup->provided = entry->counter >= 0;
+        }
+    }
+    lookup->prediction = lookup->provided;
+    if (lookup->provider >= 0)
+    {
+        // a fresh entry has not earned more trust than the shorter history
+        entry = &tage->tables[lookup->provider][lookup->index[lookup->provider]];
+        if (!entry->useful && (entry->counter == 0 || entry->counter == -1))
+        {
+            lookup->prediction = lookup->alternative;
+        }
+    }
+}
+
+static int predict_tage(Predictor *predictor, Address pc, Address target)
+{
+    TagePredictor *tage = (TagePredictor *)predictor;
+
+    tage_lookup(tage, pc, &tage->lookup);
+    tage->looked_up = pc + 1;
+    return tage->lookup.prediction;
+}
+
+static void update_tage(Predictor *predictor, Address pc, Address target, int taken)
+{
+    TagePredictor *tage = (TagePredictor *)predictor;
+    TageLookup lookup = tage->lookup;
+    TageEntry *entry;
+    Byte *base;
+    int i, allocated = 0;
+
+    taken = taken != 0;
+    if (tage->looked_up != pc + 1)
+    {
+        tage_lookup(tage, pc, &lookup);
+    }
+    tage->looked_up = 0;
+    if (lookup.provider >= 0)
+    {
+        entry = &tage->tables[lookup.provider][lookup.index[lookup.provider]];
+        if (lookup.provided != lookup.alternative)
+        {
+            if (lookup.provided == taken)
+            {
+                entry->useful += entry->useful < 3;
+            }
+            else
+            {
+                entry->useful -= entry->useful > 0;
+            }
+        }
+        if (taken)
+        {
+            entry->counter += entry->counter < 3;
+        }
+        else
+        {
+            entry->counter -= entry->counter > -4;
+        }
+    }
+    else
+    {
+        base = &tage->base[(pc >> 2) & (COUNTERS - 1)];
+        *base = count(*base, taken);
+    }
+
+    // a miss claims an entry with a longer history than the one that missed
+    if (lookup.prediction != taken)
+    {
+        for (i = lookup.provider + 1; i < TAGE_TABLES && !allocated; i++)
+        {
+            entry = &tage->tables[i][lookup.index[i]];
+            if (!entry->useful)
+            {
+                entry->tag = lookup.tag[i];
+                entry->counter = taken ? 0 : -1;
+                allocated = 1;
+            }
+        }
+        for (i = lookup.provider + 1; i < TAGE_TABLES && !allocated; i++)
+        {
+            tage->tables[i][lookup.index[i]].useful--;
+        }
+    }
+    if (++tage->updates % TAGE_AGING == 0)
+    {
+        for (i = 0; i < TAGE_TABLES * (1 << TAGE_BITS); i++)
+        {
+            tage->tables[i >> TAGE_BITS][i & ((1 << TAGE_BITS) - 1)].useful >>= 1;
+        }
+    }
+    tage->history = tage->history << 1 | taken;
+    for (i = 0; i < TAGE_TABLES; i++)
+    {
+        tage->indices[i] = fold(tage->indices[i], tage->history, history_lengths[i], TAGE_BITS);
+        tage->tags[i] = fold(tage->tags[i], tage->history, history_lengths[i], TAGE_TAG_BITS);
+    }
+}
+
+/* Returns NULL for an unknown kind or if out of memory. */
+Predictor *predictor_create(PredictorKind kind)
+{
+    static const size_t sizes[PREDICTOR_KINDS] = {
+        [PREDICT_NOT_TAKEN] = sizeof(Predictor),
+        [PREDICT_BACKWARD] = sizeof(Predictor),
+        [PREDICT_BIMODAL] = sizeof(CounterPredictor),
+        [PREDICT_GSHARE] = sizeof(CounterPredictor),
+        [PREDICT_TAGE] = sizeof(TagePredictor),
+    };
+    CounterPredictor *counters;
+    Predictor *predictor;
+
+    if (kind >= PREDICTOR_KINDS || !(predictor = calloc(1, sizes[kind])))
+    {
+        return NULL;
+    }
+    predictor->name = names[kind];
+    predictor->update = update_static;
+    switch (kind)
+    {
+    case PREDICT_NOT_TAKEN:
+        predictor->predict = predict_not_taken;
+        break;
+    case PREDICT_BACKWARD:
+        predictor->predict = predict_backward;
+        break;
+    case PREDICT_BIMODAL:
+    case PREDICT_GSHARE:
+        counters = (CounterPredictor *)predictor;
+        memset(counters->counters, 1, sizeof(counters->counters)); // weakly not taken
+        predictor->predict = kind == PREDICT_BIMODAL ? predict_bimodal : predict_gshare;
+        predictor->update = kind == PREDICT_BIMODAL ? update_bimodal : update_gshare;
+        break;
+    case PREDICT_TAGE:
+        memset(((TagePredictor *)predictor)->base, 1, COUNTERS);
+        predictor->predict = predict_tage;
+        predictor->update = update_tage;
+        break;
+    default:
+        break;
+    }
+    return predictor;
+}
+
+void predictor_destroy(Predictor *predictor)
+{
+    free(predictor);
+}
+
+/* The kind called name, or PREDICTOR_KINDS if there is none. */
+PredictorKind predictor_kind(const char *name)
+{
+    PredictorKind kind;
+
+    for (kind = 0; kind < PREDICTOR_KINDS && strcmp(name, names[kind]); kind++)
+    {
+    }
+    return kind;
+}
@@ -0,0 +1,36 @@
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include "types.h"
+
+/* Branch predictors the timing model (see timing.h) and the branch
+ * statistics (see branches.h) consult. Each kind fills in a Predictor at
+ * the start of its own state, so models call them through the function
+ * pointers without knowing which one they have. Jumps are passed to update
+ * as taken, so the global history of gshare and TAGE-lite includes them. */
+
+typedef enum {
+    PREDICT_NOT_TAKEN, // static: every branch falls through
+    PREDICT_BACKWARD,  // static: backward branches taken, forward ones not
+    PREDICT_BIMODAL,   // a two-bit counter per PC
+    PREDICT_GSHARE,    // two-bit counters indexed by PC xor global history
+    PREDICT_TAGE,      // a bimodal base and four tagged tables of longer histories
+    PREDICTOR_KINDS
+} PredictorKind;
+
+typedef struct Predictor Predictor;
+
+struct Predictor {
+    const char *name;
+    // whether the branch at pc to target is expected to be taken
+    int (*predict)(Predictor *predictor, Address pc, Address target);
+    // learns the outcome once the branch has been resolved
+    void (*update)(Predictor *predictor, Address pc, Address target, int taken);
+};
+
+/* see predictor.c */
+Predictor *predictor_create(PredictorKind kind);
+void predictor_destroy(Predictor *predictor);
+PredictorKind predictor_kind(const char *name);
+
+#endif
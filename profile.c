@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "types.h"
+#include "riscv.h"
+#include "predecode.h"
+#include "instance.h"
+#include "profile.h"
+
+/* Counts executions per PC and per op, branch outcomes and the bytes loads
+ * and stores move, and reports the hottest instructions with their
+ * disassembly. See profile.h for how the counting is switched in. */
+
+static const char *const class_names[CLASS_COUNT] = {
+    [CLASS_RTYPE] = "R-type",
+    [CLASS_ITYPE] = "I-type",
+    [CLASS_LOAD] = "load",
+    [CLASS_STORE] = "store",
+    [CLASS_BRANCH] = "branch",
+    [CLASS_JAL] = "jal",
+    [CLASS_LUI] = "lui",
+    [CLASS_ECALL] = "ecall",
+    [CLASS_INVALID] = "invalid",
+};
+
+static const Byte format_classes[FORMAT_COUNT] = {
+    [FORMAT_INVALID] = CLASS_INVALID,
+    [FORMAT_R] = CLASS_RTYPE,
+    [FORMAT_I] = CLASS_ITYPE,
+    [FORMAT_SHIFT] = CLASS_ITYPE,
+    [FORMAT_LOAD] = CLASS_LOAD,
+    [FORMAT_STORE] = CLASS_STORE,
+    [FORMAT_BRANCH] = CLASS_BRANCH,
+    [FORMAT_U] = CLASS_LUI,
+    [FORMAT_J] = CLASS_JAL,
+    [FORMAT_JR] = CLASS_JAL,
+    [FORMAT_ECALL] = CLASS_ECALL,
+};
+
+static Byte op_class(Word op)
+{
+    return format_classes[isa_formats[op]];
+}
+
+static void report_at_exit(void)
+{
+    profile_report(stderr, PROFILE_HOT);
+}
+
+/* Starts counting on the current instance. Records decoded before carry
+ * the plain handlers, so they are dropped. Returns -1 if out of memory. */
+int profile_start(void)
+{
+    Profile *profile;
+
+    if (current_instance->profile)
+    {
+        return 0;
+    }
+    profile = calloc(1, sizeof(Profile));
+    if (!profile)
+    {
+        return -1;
+    }
+    profile->entries = instance_pc_table(sizeof(ProfileEntry));
+    if (!profile->entries)
+    {
+        free(profile);
+        return -1;
+    }
+    current_instance->profile = profile;
+    instance_flush(current_instance);
+    instance_report_at_exit(report_at_exit);
+    return 0;
+}
+
+/* Stops counting on the current instance and drops its profile. */
+void profile_stop(void)
+{
+    if (!current_instance->profile)
+    {
+        return;
+    }
+    profile_destroy(current_instance->profile);
+    current_instance->profile = NULL;
+    instance_flush(current_instance);
+}
+
+void profile_destroy(Profile *profile)
+{
+    instance_pc_table_free(profile->entries, sizeof(ProfileEntry));
+    free(profile);
+}
+
+/* Counts the instruction at pc before it runs, so one that stops the run
+ * counts as executed. */
+void profile_count(Profile *profile, const DecodedInstruction *decoded, Address pc)
+{
+    ProfileEntry *entry;
+
+    profile->op_counts[decoded->op]++;
+    if (!(pc & 0x1) && pc < MEMORY_SPACE)
+    {
+        entry = &profile->entries[pc >> 1];
+        if (!entry->count++)
+        {
+            entry->word = decoded->instruction.bits;
+        }
+    }
+}
+
+/* Records what the instruction at pc did once it has run and left PC at
+ * next. */
+void profile_retire(Profile *profile, const DecodedInstruction *decoded, Address pc, Address next)
+{
+    switch (op_class(decoded->op))
+    {
+    case CLASS_BRANCH:
+        if (next != pc + decoded->length)
+        {
+            profile->taken[decoded->op]++;
+        }
+        break;
+    case CLASS_LOAD:
+        profile->bytes_loaded += isa_widths[decoded->op];
+        break;
+    case CLASS_STORE:
+        profile->bytes_stored += isa_widths[decoded->op];
+        break;
+    }
+}
+
+static unsigned long executions(const void *entry, const void *context)
+{
+    return ((const ProfileEntry *)entry)->count;
+}
+
+static double share(unsigned long count, unsigned long total)
+{
+    return total ? 100.0 * count / total : 0.0;
+}
+
+/* Prints the current instance's profile: the instruction mix by class and
+ * by op, branch outcomes, memory traffic and the hot most executed PCs. */
+void profile_report(FILE *output, unsigned hot)
+{
+    const Profile *profile = current_instance->profile;
+    unsigned long class_counts[CLASS_COUNT] = {0}, total = 0;
+    Address *hottest, i;
+    char disassembly[64];
+    unsigned found, j;
+
+    if (!profile)
+    {
+        return;
+    }
+    for (i = 0; i < OP_COUNT; i++)
+    {
+        class_counts[op_class(i)] += profile->op_counts[i];
+        total += profile->op_counts[i];
+    }
+    fprintf(output, "profile: %lu instructions, %lu bytes loaded, %lu bytes stored\n", total,
+            profile->bytes_loaded, profile->bytes_stored);
+    for (i = 0; i < CLASS_COUNT; i++)
+    {
+        if (class_counts[i])
+        {
+            fprintf(output, "profile: %-8s %12lu %5.1f%%\n", class_names[i], class_counts[i],
+                    share(class_counts[i], total));
+        }
+    }
+    for (i = 0; i < OP_COUNT; i++)
+    {
+        if (!profile->op_counts[i])
+        {
+            continue;
+        }
+        fprintf(output, "profile:   %-6s %12lu %5.1f%%", isa_names[i], profile->op_counts[i],
+                share(profile->op_counts[i], total));
+        if (op_class(i) == CLASS_BRANCH)
+        {
+            fprintf(output, "  %lu taken, %lu not taken", profile->taken[i],
+                    profile->op_counts[i] - profile->taken[i]);
+        }
+        fprintf(output, "\n");
+    }
+
+    hottest = instance_rank(profile->entries, sizeof(ProfileEntry), executions, NULL, hot, &found);
+    if (!hottest)
+    {
+        return;
+    }
+    if (found)
+    {
+        fprintf(output, "profile: hot spots\n");
+    }
+    for (j = 0; j < found; j++)
+    {
+        disassemble_word(profile->entries[hottest[j]].word, disassembly, sizeof(disassembly));
+        fprintf(output, "profile:   %08x %12lu %5.1f%%  %s\n", hottest[j] << 1,
+                profile->entries[hottest[j]].count, share(profile->entries[hottest[j]].count, total),
+                disassembly);
+    }
+    free(hottest);
+}
@@ -0,0 +1,51 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdio.h>
+#include "types.h"
+#include "predecode.h"
+#include "instance.h"
+
+/* Instruction-level profile of one instance. While an instance has a
+ * profile, its records run through the observed handler in part2.c, which
+ * passes every instruction here (see instance_observed()). An instance
+ * without one decodes and runs exactly as before, so not profiling costs
+ * nothing. */
+
+#define PROFILE_HOT 20 // hot spots a report lists
+
+/* The instruction formats the report groups ops by. */
+typedef enum {
+    CLASS_RTYPE,
+    CLASS_ITYPE,
+    CLASS_LOAD,
+    CLASS_STORE,
+    CLASS_BRANCH,
+    CLASS_JAL,
+    CLASS_LUI,
+    CLASS_ECALL,
+    CLASS_INVALID,
+    CLASS_COUNT
+} OpClass;
+
+typedef struct {
+    unsigned long count;
+    Word word; // the instruction first executed there, for the report
+} ProfileEntry;
+
+struct Profile {
+    ProfileEntry *entries;             // PREDECODE_ENTRIES, indexed by PC >> 1
+    unsigned long op_counts[OP_COUNT];
+    unsigned long taken[OP_COUNT];     // branches that jumped
+    unsigned long bytes_loaded;
+    unsigned long bytes_stored;
+};
+
+/* see profile.c */
+int profile_start(void);
+void profile_stop(void);
+void profile_count(Profile *profile, const DecodedInstruction *decoded, Address pc);
+void profile_retire(Profile *profile, const DecodedInstruction *decoded, Address pc, Address next);
+void profile_report(FILE *output, unsigned hot);
+
+#endif
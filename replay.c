@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "types.h"
+#include "emulator.h"
+#include "replay.h"
+
+/* Records the changes an embedder makes to a run and replays them to put
+ * an emulator at any step of it. See replay.h. */
+
+struct Replay {
+    char *directory;
+    RecordHeader header;
+    RecordEvent *events;
+    Byte **data;          // each event's bytes
+    Word event_count;
+    Word next;            // first event the positioned emulator has not seen
+    Emulator *positioned; // the emulator replay last left somewhere, or NULL
+    Double at;            // the step it left it at
+    Double end;           // step the recorded run stopped at, once known
+    StopReason ending;    // and why
+};
+
+/* directory/name, or directory/name.step unless step is negative. */
+static char *path_in(const char *directory, const char *name, long long step)
+{
+    char *path = malloc(strlen(directory) + strlen(name) + 24);
+
+    if (path && step < 0)
+    {
+        sprintf(path, "%s/%s", directory, name);
+    }
+    else if (path)
+    {
+        sprintf(path, "%s/%s.%lld", directory, name, step);
+    }
+    return path;
+}
+
+static void log_event(Recording *recording, RecordKind kind, Double step, Address address,
+                      const void *data, Word size)
+{
+    RecordEvent event;
+
+    memset(&event, 0, sizeof(event));
+    event.kind = kind;
+    event.size = size;
+    event.step = step;
+    event.address = address;
+    fwrite(&event, sizeof(event), 1, recording->log);
+    fwrite(data, 1, size, recording->log);
+    // a recording is most useful after a crash, so nothing waits in the buffer
+    fflush(recording->log);
+}
+
+/* Starts recording emulator into directory, creating it if needed, with a
+ * checkpoint now and every interval steps from then on. Recording takes
+ * over the emulator's periodic snapshots. Returns NULL if interval is 0
+ * or the log or the first checkpoint cannot be written. */
+Recording *recording_start(Emulator *emulator, const char *directory, unsigned long interval)
+{
+    Recording *recording;
+    RecordHeader header;
+    char *events, *prefix, *first;
+    int ok;
+
+    if (!interval || (mkdir(directory, 0755) != 0 && errno != EEXIST))
+    {
+        return NULL;
+    }
+    recording = calloc(1, sizeof(Recording));
+    events = path_in(directory, "events", -1);
+    prefix = path_in(directory, "checkpoint", -1);
+    first = path_in(directory, "checkpoint", emulator_steps(emulator));
+    ok = recording && events && prefix && first && (recording->log = fopen(events, "wb")) &&
+         emulator_save_snapshot(emulator, first) == 0 &&
+         emulator_set_snapshots(emulator, interval, prefix) == 0;
+    if (ok)
+    {
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, RECORD_MAGIC, sizeof(RECORD_MAGIC));
+        header.start = emulator_steps(emulator);
+        header.interval = interval;
+        ok = fwrite(&header, sizeof(header), 1, recording->log) == 1 && fflush(recording->log) == 0;
+        recording->processor = *emulator_processor(emulator);
+    }
+    if (!ok)
+    {
+        perror(directory);
+        if (recording && recording->log)
+        {
+            fclose(recording->log);
+        }
+        free(recording);
+        recording = NULL;
+    }
+    free(events);
+    free(prefix);
+    free(first);
+    return recording;
+}
+
+void recording_write(Recording *recording, Double step, Address address, const void *data, Word size)
+{
+    log_event(recording, RECORD_WRITE, step, address, data, size);
+}
+
+/* Logs the registers a run is about to start from if they are not the
+ * ones the last run left. */
+void recording_run(Recording *recording, Double step, const Processor *processor)
+{
+    if (memcmp(&recording->processor, processor, sizeof(Processor)))
+    {
+        log_event(recording, RECORD_REGISTERS, step, 0, processor, sizeof(Processor));
+    }
+}
+
+void recording_ran(Recording *recording, const Processor *processor)
+{
+    recording->processor = *processor;
+}
+
+void recording_stop(Emulator *emulator, Recording *recording)
+{
+    emulator_set_snapshots(emulator, 0, NULL);
+    fclose(recording->log);
+    free(recording);
+}
+
+/* Reads the log in directory. A log cut short by a crash replays up to its
+ * last whole event. Returns NULL if there is no usable log. */
+Replay *replay_open(const char *directory)
+{
+    Replay *replay = calloc(1, sizeof(Replay));
+    char *events = path_in(directory, "events", -1);
+    FILE *log = events ? fopen(events, "rb") : NULL;
+    RecordEvent event;
+    void *grown;
+    Byte *data;
+
+    free(events);
+    if (!replay || !log || fread(&replay->header, sizeof(RecordHeader), 1, log) != 1 ||
+        memcmp(replay->header.magic, RECORD_MAGIC, sizeof(RECORD_MAGIC)) || !replay->header.interval ||
+        !(replay->directory = strdup(directory)))
+    {
+        fprintf(stderr, "%s: not a recording\n", directory);
+        if (log)
+        {
+            fclose(log);
+        }
+        replay_close(replay);
+        return NULL;
+    }
+    while (fread(&event, sizeof(event), 1, log) == 1 && event.size <= MEMORY_SPACE &&
+           (data = malloc(event.size ? event.size : 1)))
+    {
+        if (fread(data, 1, event.size, log) != event.size)
+        {
+            free(data);
+            break;
+        }
+        if ((replay->event_count & (replay->event_count - 1)) == 0)
+        {
+            // grows at powers of two
+            grown = realloc(replay->events, sizeof(RecordEvent) * (replay->event_count ? 2 * replay->event_count : 1));
+            replay->events = grown ? grown : replay->events;
+            grown = grown ? realloc(replay->data, sizeof(Byte *) * (replay->event_count ? 2 * replay->event_count : 1)) : NULL;
+            replay->data = grown ? grown : replay->data;
+            if (!grown)
+            {
+                free(data);
+                break;
+            }
+        }
+        replay->events[replay->event_count] = event;
+        replay->data[replay->event_count++] = data;
+    }
+    fclose(log);
+    replay->end = ~(Double)0;
+    return replay;
+}
+
+void replay_close(Replay *replay)
+{
+    Word i;
+
+    if (!replay)
+    {
+        return;
+    }
+    for (i = 0; i < replay->event_count; i++)
+    {
+        free(replay->data[i]);
+    }
+    free(replay->events);
+    free(replay->data);
+    free(replay->directory);
+    free(replay);
+}
+
+/* Restores the last checkpoint at or before step that the recording got
+ * to write. Returns -1 if there is none. */
+static int restore_checkpoint(Replay *replay, Emulator *emulator, Double step)
+{
+    Double checkpoint = step - step % replay->header.interval;
+    char *path;
+    int result = -1;
+
+    for (checkpoint = checkpoint < replay->header.start ? replay->header.start : checkpoint;
+         result != 0 && checkpoint >= replay->header.start;
+         checkpoint = checkpoint > replay->header.start && checkpoint - replay->header.start < replay->header.interval ?
+                          replay->header.start : checkpoint - replay->header.interval)
+    {
+        path = path_in(replay->directory, "checkpoint", checkpoint);
+        if (path && access(path, R_OK) == 0)
+        {
+            result = emulator_restore_snapshot(emulator, path);
+        }
+        free(path);
+        if (checkpoint == replay->header.start)
+        {
+            break;
+        }
+    }
+    if (result != 0)
+    {
+        return -1;
+    }
+    for (replay->next = 0; replay->next < replay->event_count &&
+                           replay->events[replay->next].step < emulator_steps(emulator); replay->next++)
+    {
+    }
+    return 0;
+}
+
+/* Puts emulator at step of the recorded run, see replay.h, reusing where
+ * replay last left it when that is on the way. Returns STOP_STEPS once
+ * there; if the recorded run stopped before step, the emulator is left at
+ * the instruction that stopped it and the reason is returned. Returns
+ * STOP_SNAPSHOT if no checkpoint can be restored. */
+StopReason replay_seek(Replay *replay, Emulator *emulator, Double step)
+{
+    const RecordEvent *event;
+    Double at, target, checkpoint;
+    StopReason reason;
+
+    if (step < replay->header.start)
+    {
+        step = replay->header.start;
+    }
+    if (step > replay->end)
+    {
+        step = replay->end;
+    }
+    checkpoint = step - step % replay->header.interval;
+    at = emulator_steps(emulator);
+    if ((replay->positioned != emulator || replay->at != at || at > step || at < checkpoint) &&
+        restore_checkpoint(replay, emulator, step) != 0)
+    {
+        replay->positioned = NULL;
+        return STOP_SNAPSHOT;
+    }
+    for (;;)
+    {
+        at = emulator_steps(emulator);
+        for (; replay->next < replay->event_count && replay->events[replay->next].step == at; replay->next++)
+        {
+            event = &replay->events[replay->next];
+            if (event->kind == RECORD_WRITE)
+            {
+                emulator_write(emulator, event->address, replay->data[replay->next], event->size);
+            }
+            else if (event->kind == RECORD_REGISTERS && event->size == sizeof(Processor))
+            {
+                memcpy(emulator_processor(emulator), replay->data[replay->next], sizeof(Processor));
+            }
+        }
+        if (at >= step)
+        {
+            break;
+        }
+        target = step;
+        if (replay->next < replay->event_count && replay->events[replay->next].step < target)
+        {
+            target = replay->events[replay->next].step;
+        }
+        reason = emulator_run(emulator, target - at);
+        if (reason != STOP_STEPS)
+        {
+            // the recorded run stopped here too
+            replay->end = emulator_steps(emulator);
+            replay->ending = reason;
+            replay->positioned = emulator;
+            replay->at = replay->end;
+            return reason;
+        }
+    }
+    replay->positioned = emulator;
+    replay->at = at;
+    return at == replay->end ? replay->ending : STOP_STEPS;
+}
+
+/* Moves emulator back one step. Returns -1 at the start of the recording
+ * or if no checkpoint can be restored. */
+int replay_step_back(Replay *replay, Emulator *emulator)
+{
+    Double at = emulator_steps(emulator);
+
+    if (at <= replay->header.start)
+    {
+        return -1;
+    }
+    return replay_seek(replay, emulator, at - 1) == STOP_SNAPSHOT ? -1 : 0;
+}
+
+static int is_breakpoint(Address pc, const Address *breakpoints, Word count)
+{
+    Word i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (breakpoints[i] == pc)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Moves emulator back to the last earlier step whose PC is one of the
+ * count breakpoints, searching a checkpoint interval at a time from the
+ * latest. Returns -1, with the emulator at the start of the recording, if
+ * no earlier step has one. */
+int replay_continue_back(Replay *replay, Emulator *emulator, const Address *breakpoints, Word count)
+{
+    Double high = emulator_steps(emulator), low, step, found;
+    int hit;
+
+    while (high > replay->header.start)
+    {
+        low = (high - 1) - (high - 1) % replay->header.interval;
+        low = low < replay->header.start ? replay->header.start : low;
+        if (replay_seek(replay, emulator, low) == STOP_SNAPSHOT)
+        {
+            return -1;
+        }
+        for (step = low, hit = 0;; step++)
+        {
+            if (is_breakpoint(emulator_processor(emulator)->PC, breakpoints, count))
+            {
+                found = step;
+                hit = 1;
+            }
+            if (step + 1 >= high || replay_seek(replay, emulator, step + 1) != STOP_STEPS)
+            {
+                break;
+            }
+        }
+        if (hit)
+        {
+            return replay_seek(replay, emulator, found) == STOP_SNAPSHOT ? -1 : 0;
+        }
+        high = low;
+    }
+    replay_seek(replay, emulator, replay->header.start);
+    return -1;
+}
@@ -0,0 +1,66 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include "types.h"
+#include "emulator.h"
+
+/* Deterministic record and replay. Guest code cannot read anything the
+ * emulator does not already hold, so a run is fixed by its starting state
+ * and by what the embedder changes between runs. A recording therefore
+ * logs only those changes, emulator_write() calls and register edits, to
+ * <directory>/events, and keeps snapshots (see snapshot.h) every interval
+ * steps as <directory>/checkpoint.<steps>, starting with one where
+ * recording began. Load, reset or restore before recording, not during;
+ * those are not logged.
+ *
+ * A replay puts any emulator at any step by restoring the checkpoint at or
+ * before it and running forward, applying the logged changes at the steps
+ * they were made. The state at a step is the one the next instruction
+ * would see, after the changes logged at that step. Reverse stepping and
+ * reverse continuing are seeks to an earlier step. Whatever the guest
+ * prints while replay runs forward goes to the emulator's output sink
+ * again. */
+
+#define RECORD_MAGIC "RVREC1"
+
+typedef enum {
+    RECORD_WRITE,     // data was written at address
+    RECORD_REGISTERS, // the Processor became data
+} RecordKind;
+
+typedef struct {
+    char magic[8];
+    Double start;    // step recording began at
+    Double interval; // steps between checkpoints
+} RecordHeader;
+
+/* One logged change, followed in the file by size bytes of data. */
+typedef struct {
+    Word kind;       // RecordKind
+    Word size;
+    Double step;     // steps run when it was made
+    Address address;
+} RecordEvent;
+
+typedef struct {
+    FILE *log;
+    Processor processor; // as the last run left it
+} Recording;
+
+typedef struct Replay Replay;
+
+/* see replay.c */
+Recording *recording_start(Emulator *emulator, const char *directory, unsigned long interval);
+void recording_write(Recording *recording, Double step, Address address, const void *data, Word size);
+void recording_run(Recording *recording, Double step, const Processor *processor);
+void recording_ran(Recording *recording, const Processor *processor);
+void recording_stop(Emulator *emulator, Recording *recording);
+
+Replay *replay_open(const char *directory);
+void replay_close(Replay *replay);
+StopReason replay_seek(Replay *replay, Emulator *emulator, Double step);
+int replay_step_back(Replay *replay, Emulator *emulator);
+int replay_continue_back(Replay *replay, Emulator *emulator, const Address *breakpoints, Word count);
+
+#endif
@@ -1,14 +1,39 @@
 #ifndef MIPS_H
 #define MIPS_H
 
+#include <stdio.h>
+#include <stddef.h>
 #include "types.h"
 
 /* see part1.c */
 void decode_instruction(uint32_t instruction_bits);
+void disassemble_word(uint32_t instruction_bits, char *text, size_t size);
 
 /* see part2.c */
 void execute_instruction(uint32_t instruction_bits, Processor* processor, Byte *memory);
 void store(Byte *memory, Address address, Alignment alignment, Word value);
 Word load(Byte *memory, Address address, Alignment alignment);
+Word fetch(Byte *memory, Address address);
+
+typedef enum {
+    ENGINE_INTERPRETER, // one handler call per predecoded instruction
+    ENGINE_THREADED,    // direct-threaded dispatch, see threaded.c
+    ENGINE_JIT,         // basic blocks translated to x86-64, see jit.c
+} Engine;
+
+void set_engine(Engine engine);
+void set_compressed(int enabled);
+unsigned long execute_steps(Processor *processor, Byte *memory, unsigned long count);
+
+/* see threaded.c */
+unsigned long execute_threaded(Processor *processor, Byte *memory, unsigned long count);
+
+/* see fusion.c */
+void fusion_report(FILE *output);
+
+/* see jit.c */
+unsigned long execute_jit(Processor *processor, Byte *memory, unsigned long count);
+void jit_invalidate(Address address, Alignment alignment);
+void jit_report(FILE *output);
 
 #endif
@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "types.h"
+#include "memory.h"
+#include "snapshot.h"
+
+/* Writes and restores snapshots, see snapshot.h for the file layout. */
+
+#define PAGE_WORDS (MEMORY_PAGE_SIZE / 4)
+#define RAW_CODED (MEMORY_PAGE_SIZE * 3 / 4) // pages coding to more are stored raw
+
+static size_t page_align(size_t size)
+{
+    return (size + MEMORY_PAGE_SIZE - 1) & ~(size_t)MEMORY_PAGE_MASK;
+}
+
+/* Codes a page as runs into out, which has room for two pages. A single
+ * zero word between literals stays in the literal run, where it costs no
+ * more than a token would. Returns the bytes written. */
+static Word encode_page(const Word *words, Word *out)
+{
+    Word *start = out, *token;
+    Word i = 0, run;
+
+    while (i < PAGE_WORDS)
+    {
+        for (run = 0; i + run < PAGE_WORDS && !words[i + run]; run++)
+        {
+        }
+        if (run)
+        {
+            *out++ = SNAPSHOT_ZEROS | run;
+            i += run;
+            continue;
+        }
+        token = out++;
+        for (run = 0; i + run < PAGE_WORDS &&
+                      (words[i + run] || (i + run + 1 < PAGE_WORDS && words[i + run + 1]));
+             run++)
+        {
+            *out++ = words[i + run];
+        }
+        *token = run;
+        i += run;
+    }
+    return (out - start) * sizeof(Word);
+}
+
+/* Checks the runs of a coded page and, unless words is NULL, copies its
+ * literals into words, which must be zero already. Returns -1 if the runs
+ * do not make up exactly one page. */
+static int decode_page(const Word *in, Word length, Word *words)
+{
+    const Word *end = in + length / sizeof(Word);
+    Word i = 0, count;
+
+    while (in < end)
+    {
+        count = *in & ~SNAPSHOT_ZEROS;
+        if (count > PAGE_WORDS - i)
+        {
+            return -1;
+        }
+        if (*in++ & SNAPSHOT_ZEROS)
+        {
+            i += count;
+            continue;
+        }
+        if (count > (Word)(end - in))
+        {
+            return -1;
+        }
+        if (words)
+        {
+            memcpy(words + i, in, count * sizeof(Word));
+        }
+        in += count;
+        i += count;
+    }
+    return i == PAGE_WORDS ? 0 : -1;
+}
+
+static int is_zero(const Word *words)
+{
+    Word i;
+
+    for (i = 0; i < PAGE_WORDS; i++)
+    {
+        if (words[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Writes size bytes from data to a new file at path. */
+static int write_file(const char *path, const Byte *data, size_t size)
+{
+    char *temporary = malloc(strlen(path) + 5);
+    ssize_t n = 0;
+    size_t done = 0;
+    int fd;
+
+    if (!temporary)
+    {
+        return -1;
+    }
+    sprintf(temporary, "%s.tmp", path);
+    fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        perror(temporary);
+        free(temporary);
+        return -1;
+    }
+    // one write normally takes it all; the loop only covers short writes
+    while (done < size && (n = write(fd, data + done, size - done)) > 0)
+    {
+        done += n;
+    }
+    if (done < size || close(fd) != 0 || rename(temporary, path) != 0)
+    {
+        perror(path);
+        if (done < size)
+        {
+            close(fd);
+        }
+        unlink(temporary);
+        free(temporary);
+        return -1;
+    }
+    free(temporary);
+    return 0;
+}
+
+/* Saves processor, memory, which must come from allocate_memory(), and the
+ * step count to path. Returns 0 on success, -1 on error. */
+int snapshot_save(const char *path, const Processor *processor, Byte *memory, Double steps)
+{
+    const PageTable *table = page_table(memory);
+    SnapshotHeader *header;
+    SnapshotPage *records;
+    Byte *file, *raw;
+    const Word *words;
+    Word *coded, length, raw_count = 0, coded_size = 0, count = 0, i;
+    size_t head;
+    Address page;
+    int result;
+
+    head = page_align(sizeof(SnapshotHeader) + sizeof(SnapshotPage) * table->committed);
+    file = calloc(1, head + (size_t)table->committed * MEMORY_PAGE_SIZE);
+    coded = malloc((size_t)(table->committed + 1) * 2 * MEMORY_PAGE_SIZE);
+    if (!file || !coded)
+    {
+        free(file);
+        free(coded);
+        return -1;
+    }
+    header = (SnapshotHeader *)file;
+    records = (SnapshotPage *)(file + sizeof(SnapshotHeader));
+    raw = file + head;
+    for (page = 0; page < MEMORY_PAGES; page++)
+    {
+        words = (const Word *)(memory + ((size_t)page << MEMORY_PAGE_SHIFT));
+        if (!(table->pages[page] & PAGE_COMMITTED) || is_zero(words))
+        {
+            continue;
+        }
+        records[count].page = page;
+        length = encode_page(words, coded + coded_size / sizeof(Word));
+        if (length > RAW_CODED)
+        {
+            memcpy(raw + (size_t)raw_count * MEMORY_PAGE_SIZE, words, MEMORY_PAGE_SIZE);
+            records[count].offset = head + raw_count++ * MEMORY_PAGE_SIZE;
+            records[count].length = MEMORY_PAGE_SIZE;
+        }
+        else
+        {
+            records[count].offset = coded_size; // from the coded runs, fixed up below
+            records[count].length = length;
+            coded_size += length;
+        }
+        count++;
+    }
+
+    // the coded runs follow the raw pages
+    for (i = 0; i < count; i++)
+    {
+        if (records[i].length != MEMORY_PAGE_SIZE)
+        {
+            records[i].offset += head + raw_count * MEMORY_PAGE_SIZE;
+        }
+    }
+    memcpy(raw + (size_t)raw_count * MEMORY_PAGE_SIZE, coded, coded_size);
+    memcpy(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->processor = *processor;
+    header->steps = steps;
+    header->default_flags = table->default_flags;
+    header->region_count = table->region_count;
+    memcpy(header->regions, table->regions, sizeof(header->regions));
+    header->page_count = count;
+    header->size = head + raw_count * MEMORY_PAGE_SIZE + coded_size;
+    result = write_file(path, file, header->size);
+    free(file);
+    free(coded);
+    return result;
+}
+
+/* Checks the header and every page record against the file's size. */
+static int check_snapshot(const Byte *file, size_t size)
+{
+    const SnapshotHeader *header = (const SnapshotHeader *)file;
+    const SnapshotPage *records = (const SnapshotPage *)(file + sizeof(SnapshotHeader));
+    Word i;
+
+    if (size < sizeof(SnapshotHeader) || memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) ||
+        header->size != size || header->region_count > MEMORY_REGIONS ||
+        header->page_count > MEMORY_PAGES ||
+        sizeof(SnapshotHeader) + sizeof(SnapshotPage) * header->page_count > size)
+    {
+        return -1;
+    }
+    for (i = 0; i < header->page_count; i++)
+    {
+        if (records[i].page >= MEMORY_PAGES || records[i].offset > size ||
+            records[i].length > size - records[i].offset || (records[i].offset & 3) ||
+            (records[i].length == MEMORY_PAGE_SIZE ? records[i].offset & MEMORY_PAGE_MASK :
+             decode_page((const Word *)(file + records[i].offset), records[i].length, NULL)))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Loads a checked snapshot, mapped at file from fd, into memory. */
+static int apply_snapshot(int fd, const Byte *file, Byte *memory)
+{
+    const SnapshotHeader *header = (const SnapshotHeader *)file;
+    const SnapshotPage *records = (const SnapshotPage *)(file + sizeof(SnapshotHeader));
+    Address address;
+    Word i;
+
+    memory_reset(memory);
+    memory_set_default(memory, header->default_flags);
+    for (i = 0; i < header->region_count; i++)
+    {
+        memory_map(memory, header->regions[i].base, header->regions[i].size, header->regions[i].flags);
+    }
+    for (i = 0; i < header->page_count; i++)
+    {
+        address = records[i].page << MEMORY_PAGE_SHIFT;
+        // raw pages are shared with the file until the guest writes them
+        if (records[i].length == MEMORY_PAGE_SIZE &&
+            mmap(memory + address, MEMORY_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+                 records[i].offset) == MAP_FAILED)
+        {
+            return -1;
+        }
+        memory_commit(memory, address, MEMORY_PAGE_SIZE);
+        if (records[i].length != MEMORY_PAGE_SIZE)
+        {
+            decode_page((const Word *)(file + records[i].offset), records[i].length,
+                        (Word *)(memory + address));
+        }
+    }
+    return 0;
+}
+
+/* Replaces processor, everything in memory, which must come from
+ * allocate_memory(), and *steps with the snapshot at path. Nothing is
+ * touched unless the whole file checks out. Decoded instructions are not
+ * invalidated. Returns 0 on success, -1 on error. */
+int snapshot_restore(const char *path, Processor *processor, Byte *memory, Double *steps)
+{
+    const SnapshotHeader *header;
+    Byte *file;
+    struct stat st;
+    int fd, result = -1;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(path);
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(SnapshotHeader) ||
+        (file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+        fprintf(stderr, "%s: not a snapshot\n", path);
+        close(fd);
+        return -1;
+    }
+    header = (const SnapshotHeader *)file;
+    if (check_snapshot(file, st.st_size) != 0)
+    {
+        fprintf(stderr, "%s: not a snapshot\n", path);
+    }
+    else if (apply_snapshot(fd, file, memory) != 0)
+    {
+        perror(path);
+    }
+    else
+    {
+        *processor = header->processor;
+        *steps = header->steps;
+        result = 0;
+    }
+    munmap(file, st.st_size);
+    close(fd);
+    return result;
+}
@@ -0,0 +1,46 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "types.h"
+#include "memory.h"
+
+/* Snapshot of a whole run: the Processor, the memory regions and default
+ * rights, and every committed guest page that is not all zero. The file is
+ * built in memory and written with one sequential write to a temporary
+ * name that is then renamed over path, so a crash never leaves half a
+ * snapshot and restored pages mapped from an older file stay valid.
+ *
+ * The header and the page records come first, padded to a whole page.
+ * Pages follow in one of two forms. A dense page is stored raw at a
+ * page-aligned offset, and restoring maps it straight into guest memory
+ * copy-on-write, like an image segment (see image.h). Every other page is
+ * coded as runs of words: a token with SNAPSHOT_ZEROS set stands for that
+ * many zero words, and any other token for that many words copied from
+ * the stream after it. Fields use the host's byte order, so snapshots move
+ * between runs on one machine rather than between machines. */
+
+#define SNAPSHOT_MAGIC "RVSNAP1"
+#define SNAPSHOT_ZEROS 0x80000000u
+
+typedef struct {
+    char magic[8];
+    Processor processor;
+    Double steps;          // instructions run before it was taken
+    Word default_flags;    // MEMORY_* rights outside every region
+    Word region_count;
+    MemoryRegion regions[MEMORY_REGIONS];
+    Word page_count;       // SnapshotPage records after the header
+    Word size;             // bytes in the whole file
+} SnapshotHeader;
+
+typedef struct {
+    Address page;   // guest page number
+    Word offset;    // file offset of the contents
+    Word length;    // bytes of coded runs, MEMORY_PAGE_SIZE for a raw page
+} SnapshotPage;
+
+/* see snapshot.c */
+int snapshot_save(const char *path, const Processor *processor, Byte *memory, Double steps);
+int snapshot_restore(const char *path, Processor *processor, Byte *memory, Double *steps);
+
+#endif
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cunit/Basic.h>
+
+#include "types.h"
+#include "riscv.h"
+#include "trace.h"
+#include "batch.h"
+
+void test_batch_runs();
+void test_batch_data();
+void test_batch_trace();
+void test_batch_failures();
+void test_malformed_manifest();
+void test_reference_traces();
+
+static char directory[] = "/tmp/test_batch_XXXXXX";
+static char text[4096];
+
+// prints a1 as an integer, then exits
+static Word print_words[] = {
+    0x00100513, // addi x10, x0, 1
+    0x00000073, // ecall
+    0x00a00513, // addi x10, x0, 10
+    0x00000073, // ecall
+};
+
+/* Returns the path of name inside the test directory. */
+static const char *path(const char *name)
+{
+    static char paths[4][256];
+    static int next;
+
+    next = (next + 1) % 4;
+    snprintf(paths[next], sizeof(paths[next]), "%s/%s", directory, name);
+    return paths[next];
+}
+
+static void write_text(const char *name, const char *contents)
+{
+    FILE *file = fopen(path(name), "w");
+
+    fputs(contents, file);
+    fclose(file);
+}
+
+static void write_words(const char *name, const Word *words, int count)
+{
+    FILE *file = fopen(path(name), "w");
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        fprintf(file, "%08x\n", words[i]);
+    }
+    fclose(file);
+}
+
+/* Reads the file into text and returns its length, or -1 if it is missing. */
+static long read_text(const char *name)
+{
+    FILE *file = fopen(path(name), "r");
+    long length;
+
+    if (!file)
+    {
+        return -1;
+    }
+    length = fread(text, 1, sizeof(text) - 1, file);
+    text[length] = '\0';
+    fclose(file);
+    return length;
+}
+
+/* Whether the two files hold the same bytes. */
+static int same_file(const char *first, const char *second)
+{
+    FILE *a = fopen(first, "rb"), *b = fopen(second, "rb");
+    int c, same = a && b;
+
+    while (same && (c = fgetc(a)) == fgetc(b) && c != EOF)
+    {
+    }
+    same = same && c == EOF;
+    if (a)
+    {
+        fclose(a);
+    }
+    if (b)
+    {
+        fclose(b);
+    }
+    return same;
+}
+
+/* Writes a manifest line by line, with every {} replaced by the test
+ * directory, and runs it. */
+static int run_manifest(const char *lines, int threads)
+{
+    char manifest[2048], *out = manifest;
+    const char *in;
+
+    for (in = lines; *in; in++)
+    {
+        if (in[0] == '{' && in[1] == '}')
+        {
+            out += sprintf(out, "%s", directory);
+            in++;
+        }
+        else
+        {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+    write_text("manifest", manifest);
+    return run_batch(path("manifest"), threads, ENGINE_INTERPRETER);
+}
+
+static int init_batch() {
+    return mkdtemp(directory) == NULL;
+}
+
+static int clean_batch() {
+    char command[256];
+
+    snprintf(command, sizeof(command), "rm -rf %s", directory);
+    return system(command) != 0;
+}
+
+int main(int arc, char **argv) {
+    CU_pSuite pSuite1 = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry()) {
+        return CU_get_error();
+    }
+
+    pSuite1 = CU_add_suite("Testing batch runs", init_batch, clean_batch);
+    if (!pSuite1) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_batch_runs", test_batch_runs)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_batch_data", test_batch_data)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_batch_trace", test_batch_trace)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_batch_failures", test_batch_failures)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_malformed_manifest", test_malformed_manifest)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_reference_traces", test_reference_traces)) {
+        goto exit;
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+    exit:
+    CU_cleanup_registry();
+    return CU_get_error();
+}
+
+void test_batch_runs() {
+    write_words("print", print_words, 4);
+
+    // driver.py lines, comments and blank lines, on more threads than jobs
+    CU_ASSERT_EQUAL(run_manifest("# two jobs\n"
+                                 "\n"
+                                 "timeout 5 ./riscv -e -v {}/print > {}/first\n"
+                                 "./riscv {}/print >{}/second\n",
+                                 8), 0);
+    CU_ASSERT_EQUAL(read_text("first"), 23);
+    CU_ASSERT_STRING_EQUAL(text, "0exiting the simulator\n");
+    CU_ASSERT_EQUAL(read_text("second"), 23);
+    CU_ASSERT_STRING_EQUAL(text, "0exiting the simulator\n");
+}
+
+void test_batch_data() {
+    // lw x11, 4(x11), then print it
+    Word words[] = {0x0045a583, 0x00100513, 0x00000073, 0x00a00513, 0x00000073};
+
+    write_words("load", words, 5);
+    write_text("data", "00000007\n0000002a\n0000000b\n");
+    // -a counts words in hex, so only the first two are loaded
+    CU_ASSERT_EQUAL(run_manifest("./riscv -s {}/data -a 2,3000 {}/load > {}/loaded\n", 1), 0);
+    CU_ASSERT_EQUAL(read_text("loaded"), 24);
+    CU_ASSERT_STRING_EQUAL(text, "42exiting the simulator\n");
+    CU_ASSERT_EQUAL(run_manifest("./riscv -d {}/print > {}/listing\n", 1), 0);
+    read_text("listing");
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "00001000: addi\tx10, x0, 1\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "0000100c: ecall\n"));
+}
+
+void test_batch_trace() {
+    // addi x1, x1, 1 three times, then falls off the end of the program
+    Word words[] = {0x00108093, 0x00108093, 0x00108093};
+
+    write_words("count", words, 3);
+    CU_ASSERT_EQUAL(run_manifest("./riscv -r {}/count > {}/trace\n", 1), 0);
+    CU_ASSERT_EQUAL(read_text("trace"), 3 * TRACE_TEXT_BLOCK);
+}
+
+void test_batch_failures() {
+    // ecall with a0 = 0 is not a system call
+    Word words[] = {0x00000073};
+
+    write_words("illegal", words, 1);
+    write_words("print", print_words, 4);
+    // the failing jobs are counted, the others still run
+    CU_ASSERT_EQUAL(run_manifest("./riscv {}/illegal > {}/illegal.out\n"
+                                 "./riscv {}/missing > {}/missing.out\n"
+                                 "./riscv {}/print > {}/print.out\n",
+                                 2), 2);
+    read_text("illegal.out");
+    CU_ASSERT_STRING_EQUAL(text, "Illegal ecall number 0\n");
+    read_text("missing.out");
+    CU_ASSERT_PTR_NOT_NULL(strstr(text, "cannot read"));
+    read_text("print.out");
+    CU_ASSERT_STRING_EQUAL(text, "0exiting the simulator\n");
+}
+
+void test_malformed_manifest() {
+    // a malformed line stops the whole batch before any job runs
+    CU_ASSERT_EQUAL(run_manifest("./riscv {}/print > {}/never\n"
+                                 "./riscv {}/print\n",
+                                 1), -1);
+    CU_ASSERT_EQUAL(read_text("never"), -1);
+    CU_ASSERT_EQUAL(run_manifest("./riscv -a 2 {}/print > {}/never\n", 1), -1);
+    CU_ASSERT_EQUAL(run_manifest("./riscv -x {}/print > {}/never\n", 1), -1);
+    CU_ASSERT_EQUAL(run_manifest("timeout ./riscv {}/print > {}/never\n", 1), -1);
+    CU_ASSERT_EQUAL(run_manifest("./riscv {}/print {}/print > {}/never\n", 1), -1);
+    CU_ASSERT_EQUAL(run_manifest("./riscv {}/print >\n", 1), -1);
+    CU_ASSERT_EQUAL(read_text("never"), -1);
+    CU_ASSERT_EQUAL(run_batch(path("no-manifest"), 1, ENGINE_INTERPRETER), -1);
+}
+
+void test_reference_traces() {
+    // driver.py's lines for the programs in code/input that run to their
+    // end, whose traces must match code/ref byte for byte
+    static const char *const names[] = {"R/R", "I/I", "I/L", "S/S", "U/U", "simple"};
+    char manifest[2048], *out = manifest, name[32], expected[256];
+    unsigned i;
+
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        out += sprintf(out, "timeout 60 ./riscv -r ./code/input/%s.input > {}/%u.trace\n", names[i], i);
+        out += sprintf(out, "./riscv -d ./code/input/%s.input > {}/%u.solution\n", names[i], i);
+    }
+    CU_ASSERT_EQUAL(run_manifest(manifest, 4), 0);
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        snprintf(expected, sizeof(expected), "code/ref/%s.trace", names[i]);
+        snprintf(name, sizeof(name), "%u.trace", i);
+        CU_ASSERT(same_file(path(name), expected));
+        snprintf(expected, sizeof(expected), "code/ref/%s.solution", names[i]);
+        snprintf(name, sizeof(name), "%u.solution", i);
+        CU_ASSERT(same_file(path(name), expected));
+    }
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <cunit/Basic.h>
+
+#include "types.h"
+#include "utils.h"
+#include "decoder.h"
+
+#define WORDS 1000003 // not a whole number of batches, so the tail is decoded too
+
+void test_matches_parse();
+
+int main(int arc, char **argv) {
+    CU_pSuite pSuite1 = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry()) {
+        return CU_get_error();
+    }
+
+    pSuite1 = CU_add_suite("Testing the batch decoder", NULL, NULL);
+    if (!pSuite1) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_matches_parse", test_matches_parse)) {
+        goto exit;
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+    exit:
+    CU_cleanup_registry();
+    return CU_get_error();
+}
+
+/* Whether entry i of fields disagrees with parse_instruction() and the
+ * offset helpers on word. */
+static int mismatch(Word word, const DecodedFields *fields, size_t i)
+{
+    Instruction raw, parsed;
+    int wrong;
+
+    raw.bits = word;
+    wrong = fields->opcode[i] != raw.opcode || fields->rd[i] != raw.rtype.rd ||
+            fields->funct3[i] != raw.rtype.funct3 || fields->rs1[i] != raw.rtype.rs1 ||
+            fields->rs2[i] != raw.rtype.rs2 || fields->funct7[i] != raw.rtype.funct7 ||
+            fields->itype_imm[i] != sign_extend_number(raw.itype.imm, 12) ||
+            fields->store_offset[i] != get_store_offset(raw) ||
+            fields->branch_offset[i] != get_branch_offset(raw) ||
+            fields->jump_offset[i] != get_jump_offset(raw) ||
+            fields->utype_imm[i] != (sWord)sign_extend_number(raw.utype.imm, 20) << 12;
+    switch (word & 0x7F)
+    {
+    case 0x33:
+        parsed = parse_instruction(word);
+        return wrong || fields->rd[i] != parsed.rtype.rd || fields->funct3[i] != parsed.rtype.funct3 ||
+               fields->rs1[i] != parsed.rtype.rs1 || fields->rs2[i] != parsed.rtype.rs2 ||
+               fields->funct7[i] != parsed.rtype.funct7;
+    case 0x13:
+    case 0x03:
+    case 0x73:
+        parsed = parse_instruction(word);
+        return wrong || fields->rd[i] != parsed.itype.rd || fields->funct3[i] != parsed.itype.funct3 ||
+               fields->rs1[i] != parsed.itype.rs1 ||
+               fields->itype_imm[i] != sign_extend_number(parsed.itype.imm, 12);
+    case 0x23:
+        parsed = parse_instruction(word);
+        return wrong || fields->funct3[i] != parsed.stype.funct3 || fields->rs1[i] != parsed.stype.rs1 ||
+               fields->rs2[i] != parsed.stype.rs2 || fields->store_offset[i] != get_store_offset(parsed);
+    case 0x63:
+        parsed = parse_instruction(word);
+        return wrong || fields->funct3[i] != parsed.sbtype.funct3 || fields->rs1[i] != parsed.sbtype.rs1 ||
+               fields->rs2[i] != parsed.sbtype.rs2 || fields->branch_offset[i] != get_branch_offset(parsed);
+    case 0x6F:
+        parsed = parse_instruction(word);
+        return wrong || fields->rd[i] != parsed.ujtype.rd || fields->jump_offset[i] != get_jump_offset(parsed);
+    case 0x37:
+        parsed = parse_instruction(word);
+        return wrong || fields->rd[i] != parsed.utype.rd ||
+               fields->utype_imm[i] != (sWord)sign_extend_number(parsed.utype.imm, 20) << 12;
+    default: // parse_instruction() would stop on it
+        return wrong;
+    }
+}
+
+void test_matches_parse() {
+    static const Word opcodes[] = {0x33, 0x13, 0x03, 0x23, 0x63, 0x37, 0x6F, 0x73};
+    Word *words = malloc(WORDS * sizeof(Word));
+    DecodedFields fields;
+    Word seed = 2024;
+    size_t i, offset, mismatches = 0;
+
+    fields.opcode = malloc(WORDS);
+    fields.rd = malloc(WORDS);
+    fields.funct3 = malloc(WORDS);
+    fields.rs1 = malloc(WORDS);
+    fields.rs2 = malloc(WORDS);
+    fields.funct7 = malloc(WORDS);
+    fields.itype_imm = malloc(WORDS * sizeof(sWord));
+    fields.store_offset = malloc(WORDS * sizeof(sWord));
+    fields.branch_offset = malloc(WORDS * sizeof(sWord));
+    fields.jump_offset = malloc(WORDS * sizeof(sWord));
+    fields.utype_imm = malloc(WORDS * sizeof(sWord));
+    // every other word gets an opcode parse_instruction() knows
+    for (i = 0; i < WORDS; i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        words[i] = i & 1 ? (seed & ~0x7Fu) | opcodes[(seed >> 4) % 8] : seed;
+    }
+    for (offset = 0; offset < 3; offset++)
+    {
+        // from an unaligned start as well
+        decode_words(words + offset, WORDS - offset, &fields);
+        for (i = 0; i < WORDS - offset; i++)
+        {
+            mismatches += mismatch(words[i + offset], &fields, i);
+        }
+    }
+    CU_ASSERT_EQUAL(mismatches, 0);
+    free(words);
+    free(fields.opcode);
+    free(fields.rd);
+    free(fields.funct3);
+    free(fields.rs1);
+    free(fields.rs2);
+    free(fields.funct7);
+    free(fields.itype_imm);
+    free(fields.store_offset);
+    free(fields.branch_offset);
+    free(fields.jump_offset);
+    free(fields.utype_imm);
+}
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cunit/Basic.h>
+
+#include "types.h"
+#include "riscv.h"
+#include "instance.h"
+#include "disasm.h"
+
+void test_matches_decode();
+void test_invalid_inline();
+void test_stream_order();
+
+typedef struct {
+    char text[256];
+    size_t length;
+} Captured;
+
+static void capture(void *context, const char *text, size_t length)
+{
+    Captured *captured = context;
+
+    if (captured->length + length < sizeof(captured->text))
+    {
+        memcpy(captured->text + captured->length, text, length);
+        captured->length += length;
+        captured->text[captured->length] = '\0';
+    }
+}
+
+int main(int arc, char **argv) {
+    CU_pSuite pSuite1 = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry()) {
+        return CU_get_error();
+    }
+
+    pSuite1 = CU_add_suite("Testing the streaming disassembler", NULL, NULL);
+    if (!pSuite1) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_matches_decode", test_matches_decode)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_invalid_inline", test_invalid_inline)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_stream_order", test_stream_order)) {
+        goto exit;
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+    exit:
+    CU_cleanup_registry();
+    return CU_get_error();
+}
+
+void test_matches_decode() {
+    // every opcode decode_instruction() knows, with random other bits
+    static const Word opcodes[] = {0x33, 0x13, 0x03, 0x23, 0x63, 0x37, 0x6F, 0x73};
+    Captured captured;
+    char line[DISASM_LINE + 1];
+    Word seed = 12345, bits;
+    size_t length;
+    int i, mismatches = 0;
+
+    current_instance->sink = capture;
+    current_instance->sink_context = &captured;
+    for (i = 0; i < 100000; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        bits = (seed & ~0x7Fu) | opcodes[(seed >> 16) % 8];
+        seed = seed * 1103515245 + 12345;
+        bits ^= seed & 0xFFFF0000u;
+        captured.length = 0;
+        captured.text[0] = '\0';
+        instance_printf("%08x: ", 4 * i);
+        decode_instruction(bits);
+        length = disasm_words(&bits, 1, 4 * i, line);
+        line[length] = '\0';
+        mismatches += strcmp(line, captured.text) != 0;
+    }
+    current_instance->sink = NULL;
+    CU_ASSERT_EQUAL(mismatches, 0);
+}
+
+void test_invalid_inline() {
+    // addi x1, x0, 5; an unknown opcode; ecall
+    Word words[] = {0x00500093, 0x0000007f, 0x00000073};
+    char text[3 * DISASM_LINE + 1];
+    size_t length = disasm_words(words, 3, 0x1000, text);
+
+    text[length] = '\0';
+    CU_ASSERT_STRING_EQUAL(text, "00001000: addi\tx1, x0, 5\n"
+                                 "00001004: Invalid Instruction: 0x0000007f\n"
+                                 "00001008: ecall\n");
+}
+
+void test_stream_order() {
+    size_t count = 3 * DISASM_CHUNK + 17, length, i;
+    Word *words = malloc(4 * count);
+    char *expected = malloc(DISASM_LINE * count), *actual;
+    FILE *input = tmpfile(), *raw = tmpfile(), *output = tmpfile();
+    Word seed = 7;
+
+    for (i = 0; i < count; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        words[i] = seed;
+        fprintf(input, "%08x\n", seed);
+    }
+    fwrite(words, 4, count, raw);
+    length = disasm_words(words, count, 0x1000, expected);
+    rewind(input);
+    CU_ASSERT_EQUAL(disasm_stream(input, output, 0x1000, 0, 3), 0);
+    actual = malloc(length + 1);
+    rewind(output);
+    CU_ASSERT_EQUAL(fread(actual, 1, length + 1, output), length);
+    CU_ASSERT_EQUAL(memcmp(actual, expected, length), 0);
+
+    // the same words in binary, one thread
+    rewind(output);
+    rewind(raw);
+    CU_ASSERT_EQUAL(disasm_stream(raw, output, 0x1000, 1, 1), 0);
+    rewind(output);
+    CU_ASSERT_EQUAL(fread(actual, 1, length, output), length);
+    CU_ASSERT_EQUAL(memcmp(actual, expected, length), 0);
+    fclose(input);
+    fclose(raw);
+    fclose(output);
+    free(actual);
+    free(expected);
+    free(words);
+}
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <elf.h>
+#include <cunit/Basic.h>
+
+#include "types.h"
+#include "riscv.h"
+#include "memory.h"
+#include "elf_loader.h"
+
+void test_partial_pages();
+void test_unaligned_segment();
+void test_bss();
+void test_segment_rights();
+void test_not_riscv();
+
+#define FILE_SIZE 0x3200
+
+static char path[] = "/tmp/test_elf_XXXXXX";
+static Byte file[FILE_SIZE];
+static Byte *memory;
+static Address entry;
+
+/* Writes an executable with a text segment whose ends share pages with
+ * nothing, a data segment at an offset that cannot be mapped and a bss
+ * part past it, and a note that is not loaded. Every other byte of the
+ * file is a pattern, so misplaced bytes show. */
+static void write_elf(Elf32_Half machine)
+{
+    Elf32_Ehdr header;
+    Elf32_Phdr segments[3];
+    FILE *output;
+    int i;
+
+    for (i = 0; i < FILE_SIZE; i++)
+    {
+        file[i] = i * 7 + 3;
+    }
+    memset(&header, 0, sizeof(header));
+    memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS] = ELFCLASS32;
+    header.e_ident[EI_DATA] = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_type = ET_EXEC;
+    header.e_machine = machine;
+    header.e_version = EV_CURRENT;
+    header.e_entry = 0x10F00;
+    header.e_phoff = sizeof(header);
+    header.e_ehsize = sizeof(header);
+    header.e_phentsize = sizeof(Elf32_Phdr);
+    header.e_phnum = 3;
+    memset(segments, 0, sizeof(segments));
+    segments[0].p_type = PT_LOAD;
+    segments[0].p_offset = 0xF00;
+    segments[0].p_vaddr = 0x10F00;
+    segments[0].p_filesz = 0x2200;
+    segments[0].p_memsz = 0x2200;
+    segments[0].p_flags = PF_R | PF_X;
+    segments[1].p_type = PT_LOAD;
+    segments[1].p_offset = 0x3110;
+    segments[1].p_vaddr = 0x20010;
+    segments[1].p_filesz = 0x20;
+    segments[1].p_memsz = 0x1000;
+    segments[1].p_flags = PF_R | PF_W;
+    segments[2].p_type = PT_NOTE;
+    segments[2].p_offset = 0x3180;
+    segments[2].p_vaddr = 0x30000;
+    segments[2].p_filesz = 0x80;
+    segments[2].p_memsz = 0x80;
+    memcpy(file, &header, sizeof(header));
+    memcpy(file + sizeof(header), segments, sizeof(segments));
+    output = fopen(path, "wb");
+    fwrite(file, 1, FILE_SIZE, output);
+    fclose(output);
+}
+
+static int init_elf() {
+    close(mkstemp(path));
+    write_elf(EM_RISCV);
+    memory = allocate_memory();
+    return memory == NULL || load_elf(path, memory, &entry) != 0;
+}
+
+static int clean_elf() {
+    free_memory(memory);
+    unlink(path);
+    return 0;
+}
+
+int main(int arc, char **argv) {
+    CU_pSuite pSuite1 = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry()) {
+        return CU_get_error();
+    }
+
+    pSuite1 = CU_add_suite("Testing the ELF loader", init_elf, clean_elf);
+    if (!pSuite1) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_partial_pages", test_partial_pages)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_unaligned_segment", test_unaligned_segment)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_bss", test_bss)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_segment_rights", test_segment_rights)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_not_riscv", test_not_riscv)) {
+        goto exit;
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+    exit:
+    CU_cleanup_registry();
+    return CU_get_error();
+}
+
+void test_partial_pages() {
+    // copied head page, two mapped pages, copied tail page
+    CU_ASSERT_EQUAL(entry, 0x10F00);
+    CU_ASSERT_EQUAL(memcmp(memory + 0x10F00, file + 0xF00, 0x100), 0);
+    CU_ASSERT_EQUAL(memcmp(memory + 0x11000, file + 0x1000, 0x2000), 0);
+    CU_ASSERT_EQUAL(memcmp(memory + 0x13000, file + 0x3000, 0x100), 0);
+    // the rest of the partial pages is not taken from the file
+    CU_ASSERT_EQUAL(load(memory, 0x10EFC, LENGTH_WORD), 0);
+    CU_ASSERT_EQUAL(load(memory, 0x13100, LENGTH_WORD), 0);
+}
+
+void test_unaligned_segment() {
+    // vaddr and offset differ modulo the page size, so it is all copied
+    CU_ASSERT_EQUAL(memcmp(memory + 0x20010, file + 0x3110, 0x20), 0);
+    CU_ASSERT_EQUAL(load(memory, 0x2000C, LENGTH_WORD), 0);
+    // and the note is not loaded at all
+    CU_ASSERT_EQUAL(load(memory, 0x30000, LENGTH_WORD), 0);
+}
+
+void test_bss() {
+    Address address;
+    int zero = 1;
+
+    // the file bytes after p_filesz are not part of the segment
+    for (address = 0x20030; address < 0x21010; address += 4)
+    {
+        zero = zero && load(memory, address, LENGTH_WORD) == 0;
+    }
+    CU_ASSERT(zero);
+    CU_ASSERT_PTR_NOT_NULL(memory_write_pointer(memory, 0x21000, 4));
+}
+
+void test_segment_rights() {
+    CU_ASSERT_PTR_NOT_NULL(memory_fetch_pointer(memory, 0x10F00));
+    CU_ASSERT_PTR_NOT_NULL(memory_read_pointer(memory, 0x12000, 4));
+    CU_ASSERT_PTR_NULL(memory_write_pointer(memory, 0x12000, 4));
+    CU_ASSERT_PTR_NOT_NULL(memory_write_pointer(memory, 0x20010, 4));
+    CU_ASSERT_PTR_NULL(memory_fetch_pointer(memory, 0x20010));
+}
+
+void test_not_riscv() {
+    Byte *other = allocate_memory();
+    Address other_entry = 0;
+
+    write_elf(EM_X86_64);
+    CU_ASSERT_EQUAL(load_elf(path, other, &other_entry), -1);
+    CU_ASSERT_EQUAL(other_entry, 0);
+    CU_ASSERT_EQUAL(load_elf("/nonexistent", other, &other_entry), -1);
+    free_memory(other);
+}
@@ -0,0 +1,1037 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cunit/Basic.h>
+
+#include "types.h"
+#include "riscv.h"
+#include "emulator.h"
+#include "cache.h"
+#include "branches.h"
+#include "replay.h"
+
+void test_run_steps();
+void test_exit_ecall();
+void test_invalid_read();
+void test_invalid_instruction();
+void test_rv32i();
+void test_rv32im();
+void test_rv32c();
+void test_ebreak();
+void test_engines_agree();
+void test_self_modifying();
+void test_fusion_patched();
+void test_jit_stops();
+void test_two_emulators();
+void test_load_image();
+void test_disassemble();
+void test_profile();
+void test_timing();
+void test_cache();
+void test_branches();
+void test_snapshot();
+void test_replay();
+void test_debug();
+
+typedef struct {
+    char text[256];
+    size_t length;
+} Captured;
+
+static void capture(void *context, const char *text, size_t length)
+{
+    Captured *captured = context;
+
+    if (captured->length + length < sizeof(captured->text))
+    {
+        memcpy(captured->text + captured->length, text, length);
+        captured->length += length;
+        captured->text[captured->length] = '\0';
+    }
+}
+
+static Emulator *program(const Word *words, Word count, Captured *captured)
+{
+    Emulator *emulator = emulator_create();
+
+    emulator_write(emulator, EMULATOR_ENTRY, words, 4 * count);
+    memset(captured, 0, sizeof(Captured));
+    emulator_set_output(emulator, capture, captured);
+    return emulator;
+}
+
+/* Runs count words on every engine, steps instructions at a time for up to
+ * runs runs, and checks that after each run the other engines stopped the
+ * same way with the same registers, output and step count as the
+ * interpreter. */
+static void check_engines(const Word *words, Word count, unsigned long steps, int runs)
+{
+    Captured captured[ENGINE_JIT + 1];
+    Emulator *emulators[ENGINE_JIT + 1];
+    StopReason reasons[ENGINE_JIT + 1];
+    Engine engine;
+    int run;
+
+    for (engine = ENGINE_INTERPRETER; engine <= ENGINE_JIT; engine++) {
+        emulators[engine] = program(words, count, &captured[engine]);
+        emulator_set_engine(emulators[engine], engine);
+    }
+    for (run = 0; run < runs; run++) {
+        for (engine = ENGINE_INTERPRETER; engine <= ENGINE_JIT; engine++) {
+            reasons[engine] = emulator_run(emulators[engine], steps);
+        }
+        for (engine = ENGINE_THREADED; engine <= ENGINE_JIT; engine++) {
+            CU_ASSERT_EQUAL(reasons[engine], reasons[ENGINE_INTERPRETER]);
+            CU_ASSERT_EQUAL(memcmp(emulator_processor(emulators[engine]),
+                                   emulator_processor(emulators[ENGINE_INTERPRETER]), sizeof(Processor)), 0);
+            CU_ASSERT_STRING_EQUAL(captured[engine].text, captured[ENGINE_INTERPRETER].text);
+            CU_ASSERT_EQUAL(emulator_steps(emulators[engine]), emulator_steps(emulators[ENGINE_INTERPRETER]));
+        }
+        if (reasons[ENGINE_INTERPRETER] != STOP_STEPS) {
+            break;
+        }
+    }
+    for (engine = ENGINE_INTERPRETER; engine <= ENGINE_JIT; engine++) {
+        emulator_destroy(emulators[engine]);
+    }
+}
+
+int main(int arc, char **argv) {
+    CU_pSuite pSuite1 = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry()) {
+        return CU_get_error();
+    }
+
+    pSuite1 = CU_add_suite("Testing the embedding interface", NULL, NULL);
+    if (!pSuite1) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_run_steps", test_run_steps)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_exit_ecall", test_exit_ecall)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_invalid_read", test_invalid_read)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_invalid_instruction", test_invalid_instruction)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_rv32i", test_rv32i)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_rv32im", test_rv32im)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_rv32c", test_rv32c)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_ebreak", test_ebreak)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_engines_agree", test_engines_agree)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_jit_stops", test_jit_stops)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_self_modifying", test_self_modifying)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_fusion_patched", test_fusion_patched)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_two_emulators", test_two_emulators)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_load_image", test_load_image)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_disassemble", test_disassemble)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_profile", test_profile)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_timing", test_timing)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_cache", test_cache)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_branches", test_branches)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_snapshot", test_snapshot)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_replay", test_replay)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_debug", test_debug)) {
+        goto exit;
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+    exit:
+    CU_cleanup_registry();
+    return CU_get_error();
+}
+
+void test_run_steps() {
+    // addi x1, x0, 5; addi x1, x1, 7
+    Word words[] = {0x00500093, 0x00708093};
+    Captured captured;
+    Emulator *emulator = program(words, 2, &captured);
+
+    CU_ASSERT_EQUAL(emulator_run(emulator, 1), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->R[1], 5);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 1), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->R[1], 12);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, EMULATOR_ENTRY + 8);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->R[2], 0xEFFFF);
+    CU_ASSERT_EQUAL(captured.length, 0);
+    emulator_destroy(emulator);
+}
+
+void test_exit_ecall() {
+    // addi x11, x0, 42; addi x10, x0, 10; ecall
+    Word words[] = {0x02a00593, 0x00a00513, 0x00000073};
+    Captured captured;
+    Emulator *emulator = program(words, 3, &captured);
+
+    CU_ASSERT_EQUAL(emulator_run(emulator, 100), STOP_EXIT);
+    CU_ASSERT_EQUAL(emulator_exit_status(emulator), 0);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, EMULATOR_ENTRY + 8);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->R[11], 42);
+    CU_ASSERT_EQUAL(emulator_steps(emulator), 2);
+    CU_ASSERT_STRING_EQUAL(captured.text, "exiting the simulator\n");
+    emulator_destroy(emulator);
+}
+
+void test_invalid_read() {
+    // lui x5, 0x80000; lw x6, 0(x5)
+    Word words[] = {0x800002b7, 0x0002a303};
+    Captured captured;
+    Emulator *emulator = program(words, 2, &captured);
+
+    CU_ASSERT_EQUAL(emulator_run(emulator, 10), STOP_INVALID_READ);
+    CU_ASSERT_NOT_EQUAL(emulator_exit_status(emulator), 0);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, EMULATOR_ENTRY + 4);
+    CU_ASSERT_STRING_EQUAL(captured.text, "Bad Read. Address: 0x80000000\n");
+    emulator_destroy(emulator);
+}
+
+void test_invalid_instruction() {
+    Word words[] = {0xFFFFFFFF};
+    Captured captured;
+    Emulator *emulator = program(words, 1, &captured);
+
+    CU_ASSERT_EQUAL(emulator_run(emulator, 10), STOP_INVALID_INSTRUCTION);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, EMULATOR_ENTRY);
+    emulator_destroy(emulator);
+}
+
+void test_rv32i() {
+    // the ops the hand-written handlers got wrong before isa.def described
+    // them, as code/ref/R/R.trace and code/ref/I/I.trace expect them
+    Word words[] = {
+        0xff800093, // addi x1, x0, -8
+        0x00300113, // addi x2, x0, 3
+        0x0020a1b3, // slt x3, x1, x2
+        0x0020c233, // xor x4, x1, x2
+        0x0020e2b3, // or x5, x1, x2
+        0x0020d333, // srl x6, x1, x2
+        0x4020d3b3, // sra x7, x1, x2
+        0xff90a413, // slti x8, x1, -7
+        0x04016493, // ori x9, x2, 0x40
+        0x00100513, // addi x10, x0, 1
+        0x00700593, // addi x11, x0, 7
+        0x00000073, // ecall
+        0x00500613, // addi x12, x0, 5
+        0x00a00513, // addi x10, x0, 10
+        0x00000073, // ecall
+    };
+    Captured captured;
+    Emulator *emulator;
+    Processor *processor;
+    Engine engine;
+
+    for (engine = ENGINE_INTERPRETER; engine <= ENGINE_JIT; engine++) {
+        emulator = program(words, 15, &captured);
+        emulator_set_engine(emulator, engine);
+        processor = emulator_processor(emulator);
+        CU_ASSERT_EQUAL(emulator_run(emulator, 100), STOP_EXIT);
+        CU_ASSERT_EQUAL(processor->R[3], 1);
+        CU_ASSERT_EQUAL(processor->R[4], 0xFFFFFFFB);
+        CU_ASSERT_EQUAL(processor->R[5], 0xFFFFFFFB);
+        CU_ASSERT_EQUAL(processor->R[6], 0x1FFFFFFF);
+        CU_ASSERT_EQUAL(processor->R[7], 0xFFFFFFFF);
+        CU_ASSERT_EQUAL(processor->R[8], 1);
+        CU_ASSERT_EQUAL(processor->R[9], 0x43);
+        // an ecall that returns goes on with the next instruction
+        CU_ASSERT_EQUAL(processor->R[12], 5);
+        CU_ASSERT_EQUAL(processor->PC, EMULATOR_ENTRY + 56);
+        CU_ASSERT_STRING_EQUAL(captured.text, "7exiting the simulator\n");
+        emulator_destroy(emulator);
+    }
+}
+
+void test_rv32im() {
+    Word words[] = {
+        0x800000b7, // lui x1, 0x80000
+        0xfff00113, // addi x2, x0, -1
+        0x0220c1b3, // div x3, x1, x2
+        0x0220e233, // rem x4, x1, x2
+        0x0200d2b3, // divu x5, x1, x0
+        0x0200e333, // rem x6, x1, x0
+        0x021093b3, // mulh x7, x1, x1
+        0x02213433, // mulhu x8, x2, x2
+        0x022124b3, // mulhsu x9, x2, x2
+        0x00203533, // sltu x10, x0, x2
+        0x00000597, // auipc x11, 0
+        0x00c58667, // jalr x12, x11, 12
+        0x00100693, // addi x13, x0, 1
+        0x00200713, // addi x14, x0, 2
+    };
+    Captured captured;
+    Emulator *emulator;
+    Processor *processor;
+    Engine engine;
+
+    // every engine, since each has its own code for these
+    for (engine = ENGINE_INTERPRETER; engine <= ENGINE_JIT; engine++) {
+        emulator = program(words, 14, &captured);
+        emulator_set_engine(emulator, engine);
+        processor = emulator_processor(emulator);
+        CU_ASSERT_EQUAL(emulator_run(emulator, 13), STOP_STEPS);
+        CU_ASSERT_EQUAL(processor->R[3], 0x80000000);
+        CU_ASSERT_EQUAL(processor->R[4], 0);
+        CU_ASSERT_EQUAL(processor->R[5], 0xFFFFFFFF);
+        CU_ASSERT_EQUAL(processor->R[6], 0x80000000);
+        CU_ASSERT_EQUAL(processor->R[7], 0x40000000);
+        CU_ASSERT_EQUAL(processor->R[8], 0xFFFFFFFE);
+        CU_ASSERT_EQUAL(processor->R[9], 0xFFFFFFFF);
+        CU_ASSERT_EQUAL(processor->R[10], 1);
+        CU_ASSERT_EQUAL(processor->R[11], EMULATOR_ENTRY + 40);
+        CU_ASSERT_EQUAL(processor->R[12], EMULATOR_ENTRY + 48);
+        CU_ASSERT_EQUAL(processor->R[13], 0);
+        CU_ASSERT_EQUAL(processor->R[14], 2);
+        CU_ASSERT_EQUAL(processor->PC, EMULATOR_ENTRY + 56);
+        emulator_destroy(emulator);
+    }
+}
+
+void test_rv32c() {
+    // two parcels per word, the first in the low half
+    Word words[] = {
+        0x45814515, // c.li x10, 5; c.li x11, 0
+        0x157d95aa, // c.add x11, x10; c.addi x10, -1
+        0x8613fd75, // c.bnez x10, -4; addi x12, x11, 100 (low half)
+        0x20110645, // (high half); c.jal 4
+        0x8082a019, // c.j 6; c.jr x1
+        0x11410001, // c.nop; c.addi x2, -16
+        0x4692c22e, // c.swsp x11, 4; c.lwsp x13, 4
+        0x00000000, // illegal
+    };
+    Captured captured;
+    Emulator *emulator;
+    Processor *processor;
+    Engine engine;
+
+    // off by default: the first parcel is an invalid word
+    emulator = program(words, 8, &captured);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 1), STOP_INVALID_INSTRUCTION);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, EMULATOR_ENTRY);
+    emulator_destroy(emulator);
+
+    for (engine = ENGINE_INTERPRETER; engine <= ENGINE_JIT; engine++) {
+        emulator = program(words, 8, &captured);
+        emulator_set_engine(emulator, engine);
+        emulator_set_compressed(emulator, 1);
+        processor = emulator_processor(emulator);
+        CU_ASSERT_EQUAL(emulator_run(emulator, 100), STOP_INVALID_INSTRUCTION);
+        CU_ASSERT_EQUAL(processor->R[1], EMULATOR_ENTRY + 0x10);
+        CU_ASSERT_EQUAL(processor->R[2], 0xEFFFF - 16);
+        CU_ASSERT_EQUAL(processor->R[10], 0);
+        CU_ASSERT_EQUAL(processor->R[11], 15);
+        CU_ASSERT_EQUAL(processor->R[12], 115);
+        CU_ASSERT_EQUAL(processor->R[13], 15);
+        CU_ASSERT_EQUAL(processor->PC, EMULATOR_ENTRY + 0x1C);
+        emulator_destroy(emulator);
+    }
+}
+
+void test_ebreak() {
+    // a0 holds a system call number, which neither ebreak may act on
+    Word words[] = {
+        0x00100513, // addi x10, x0, 1
+        0x00700593, // addi x11, x0, 7
+        0x00100073, // ebreak
+    };
+    Word compressed[] = {
+        0x00100513, // addi x10, x0, 1
+        0x00700593, // addi x11, x0, 7
+        0x00019002, // c.ebreak; c.nop
+    };
+    Captured captured;
+    Emulator *emulator;
+    Engine engine;
+    int c;
+
+    for (c = 0; c < 2; c++) {
+        for (engine = ENGINE_INTERPRETER; engine <= ENGINE_JIT; engine++) {
+            emulator = program(c ? compressed : words, 3, &captured);
+            emulator_set_engine(emulator, engine);
+            emulator_set_compressed(emulator, c);
+            CU_ASSERT_EQUAL(emulator_run(emulator, 100), STOP_INVALID_INSTRUCTION);
+            CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, EMULATOR_ENTRY + 8);
+            CU_ASSERT_EQUAL(emulator_steps(emulator), 2);
+            // c.ebreak expands to no instruction, which stops the run quietly
+            // as an unknown opcode does
+            CU_ASSERT_STRING_EQUAL(captured.text, c ? "" : "Invalid Instruction: 0x00100073\n");
+            emulator_destroy(emulator);
+        }
+    }
+}
+
+void test_engines_agree() {
+    Word words[] = {
+        0x00a00093, // addi x1, x0, 10
+        0x00003137, // lui x2, 0x3
+        0x00112023, // sw x1, 0(x2)
+        0x00012183, // lw x3, 0(x2)
+        0x00320233, // add x4, x4, x3
+        0x00410113, // addi x2, x2, 4
+        0xfff08093, // addi x1, x1, -1
+        0xfe0096e3, // bne x1, x0, -20
+        0x000022b7, // lui x5, 0x2
+        0x0007f337, // lui x6, 0x7f
+        0x0002a383, // lw x7, 0(x5)
+        0x006282b3, // add x5, x5, x6
+        0xff9ff06f, // jal x0, -8
+    };
+    unsigned long steps;
+    Captured captured;
+    Emulator *emulator;
+    Engine engine;
+
+    // the loads of the last loop fault once the decoded records are warm
+    for (engine = ENGINE_INTERPRETER; engine <= ENGINE_JIT; engine++) {
+        emulator = program(words, 13, &captured);
+        emulator_set_engine(emulator, engine);
+        CU_ASSERT_EQUAL(emulator_run(emulator, 1000), STOP_INVALID_READ);
+        CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, EMULATOR_ENTRY + 40);
+        CU_ASSERT_EQUAL(emulator_processor(emulator)->R[4], 55);
+        CU_ASSERT_EQUAL(emulator_processor(emulator)->R[5], MEMORY_SPACE);
+        // the faulting load does not count as run
+        CU_ASSERT_EQUAL(emulator_steps(emulator), 70);
+        emulator_destroy(emulator);
+    }
+    // and the engines agree wherever a run ends
+    for (steps = 1; steps <= 9; steps++) {
+        check_engines(words, 13, steps, 100);
+    }
+    check_engines(words, 13, 1000, 1);
+}
+
+void test_jit_stops() {
+    Word faulting[] = {
+        0x00100093, // addi x1, x0, 1
+        0x001002b7, // lui x5, 0x100
+        0x0012a023, // sw x1, 0(x5)
+        0x00200093, // addi x1, x0, 2
+    };
+    Word chained[] = {
+        0x00108093, // addi x1, x1, 1
+        0x0040006f, // jal x0, 4
+        0x0002a103, // lw x2, 0(x5)
+        0x0000006f, // jal x0, 0
+        0x00120213, // addi x4, x4, 1
+        0x0000006f, // jal x0, 0
+    };
+    Captured captured;
+    Emulator *emulator;
+    Processor *processor;
+    FILE *file = tmpfile();
+    char report[512];
+    size_t length;
+
+    // a store faulting in the middle of a block
+    emulator = program(faulting, 4, &captured);
+    emulator_set_engine(emulator, ENGINE_JIT);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 100), STOP_INVALID_WRITE);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, EMULATOR_ENTRY + 8);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->R[1], 1);
+    CU_ASSERT_EQUAL(emulator_steps(emulator), 2);
+    // the statistics go where the caller asks, and only when asked
+    emulator_jit_report(emulator, file);
+    rewind(file);
+    length = fread(report, 1, sizeof(report) - 1, file);
+    report[length] = '\0';
+    fclose(file);
+#if defined(__x86_64__) && defined(__unix__)
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "jit: 1 blocks, 4 instructions, "));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "jit: 0 chained exits, 0 flushes\n"));
+#else
+    CU_ASSERT_EQUAL(length, 0);
+#endif
+    emulator_destroy(emulator);
+    check_engines(faulting, 4, 100, 1);
+
+    // the exit into a block that faulted is not chained to whatever runs next
+    emulator = program(chained, 6, &captured);
+    emulator_set_engine(emulator, ENGINE_JIT);
+    processor = emulator_processor(emulator);
+    processor->R[5] = MEMORY_SPACE;
+    CU_ASSERT_EQUAL(emulator_run(emulator, 100), STOP_INVALID_READ);
+    CU_ASSERT_EQUAL(processor->PC, EMULATOR_ENTRY + 8);
+    processor->PC = EMULATOR_ENTRY + 16;
+    CU_ASSERT_EQUAL(emulator_run(emulator, 10), STOP_STEPS);
+    CU_ASSERT_EQUAL(processor->R[4], 1);
+    processor->PC = EMULATOR_ENTRY;
+    processor->R[5] = 0x2000;
+    CU_ASSERT_EQUAL(emulator_run(emulator, 3), STOP_STEPS);
+    CU_ASSERT_EQUAL(processor->PC, EMULATOR_ENTRY + 12);
+    CU_ASSERT_EQUAL(processor->R[1], 2);
+    CU_ASSERT_EQUAL(processor->R[4], 1);
+    emulator_destroy(emulator);
+}
+
+void test_self_modifying() {
+    // the loop patches the upper half of its first instruction, so the
+    // second pass adds 16 instead of 1
+    Word words[] = {
+        0x00001337, // lui x6, 0x1
+        0x10000393, // addi x7, x0, 0x100
+        0x00200413, // addi x8, x0, 2
+        0x00108093, // addi x1, x1, 1
+        0x00731723, // sh x7, 14(x6)
+        0xfff40413, // addi x8, x8, -1
+        0xfe041ae3, // bne x8, x0, -12
+        0x00000000, // illegal
+    };
+    unsigned long steps;
+    Captured captured;
+    Emulator *emulator;
+    Engine engine;
+
+    for (engine = ENGINE_INTERPRETER; engine <= ENGINE_JIT; engine++) {
+        emulator = program(words, 8, &captured);
+        emulator_set_engine(emulator, engine);
+        CU_ASSERT_EQUAL(emulator_run(emulator, 100), STOP_INVALID_INSTRUCTION);
+        CU_ASSERT_EQUAL(emulator_processor(emulator)->R[1], 17);
+        CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, EMULATOR_ENTRY + 28);
+        emulator_destroy(emulator);
+    }
+    for (steps = 1; steps <= 4; steps++) {
+        check_engines(words, 8, steps, 100);
+    }
+}
+
+void test_fusion_patched() {
+    // the loop overwrites the addi fused with the lui before it, so the
+    // second pass adds 7 instead of 3
+    Word words[] = {
+        0x00001337, // lui x6, 0x1
+        0x007083b7, // lui x7, 0x708
+        0x09338393, // addi x7, x7, 0x93
+        0x00200413, // addi x8, x0, 2
+        0x000050b7, // lui x1, 0x5
+        0x00308093, // addi x1, x1, 3
+        0x001484b3, // add x9, x9, x1
+        0x00732a23, // sw x7, 0x14(x6)
+        0xfff40413, // addi x8, x8, -1
+        0xfe0416e3, // bne x8, x0, -20
+        0x00000000, // illegal
+    };
+    unsigned long steps;
+    Captured captured;
+    Emulator *emulator;
+    Engine engine;
+    FILE *file;
+    char report[512];
+    size_t length;
+
+    for (engine = ENGINE_INTERPRETER; engine <= ENGINE_JIT; engine++) {
+        emulator = program(words, 11, &captured);
+        emulator_set_engine(emulator, engine);
+        CU_ASSERT_EQUAL(emulator_run(emulator, 100), STOP_INVALID_INSTRUCTION);
+        CU_ASSERT_EQUAL(emulator_processor(emulator)->R[9], 0xA00A);
+        CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, EMULATOR_ENTRY + 40);
+        // only the threaded engine fuses, and it reports only when asked
+        file = tmpfile();
+        emulator_fusion_report(emulator, file);
+        rewind(file);
+        length = fread(report, 1, sizeof(report) - 1, file);
+        report[length] = '\0';
+        fclose(file);
+        if (engine == ENGINE_THREADED) {
+            CU_ASSERT_PTR_NOT_NULL(strstr(report, "fusion: lui+addi       3 hits, 6 instructions\n"));
+            CU_ASSERT_PTR_NOT_NULL(strstr(report, "fusion: addi+bne       2 hits, 4 instructions\n"));
+        } else {
+            CU_ASSERT_EQUAL(length, 0);
+        }
+        emulator_destroy(emulator);
+    }
+    // short runs leave too few steps for a fused pair, which then runs alone
+    for (steps = 1; steps <= 4; steps++) {
+        check_engines(words, 11, steps, 100);
+    }
+}
+
+void test_two_emulators() {
+    // addi x1, x1, 1
+    Word words[] = {0x00108093};
+    Captured first_output, second_output;
+    Emulator *first = program(words, 1, &first_output);
+    Emulator *second = program(words, 1, &second_output);
+    Word value = 0x00208093; // addi x1, x1, 2
+
+    // patching one emulator's code must not touch the other's decoded copy
+    CU_ASSERT_EQUAL(emulator_run(first, 1), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_run(second, 1), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_write(second, EMULATOR_ENTRY, &value, 4), 0);
+    emulator_reset(first, EMULATOR_ENTRY);
+    emulator_reset(second, EMULATOR_ENTRY);
+    CU_ASSERT_EQUAL(emulator_run(first, 1), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_run(second, 1), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_processor(first)->R[1], 1);
+    CU_ASSERT_EQUAL(emulator_processor(second)->R[1], 2);
+    CU_ASSERT_EQUAL(emulator_read(second, EMULATOR_ENTRY, &value, 4), 0);
+    CU_ASSERT_EQUAL(value, 0x00208093);
+    CU_ASSERT_EQUAL(emulator_read(first, 0x80000, &value, 4), 0);
+    CU_ASSERT_EQUAL(value, 0);
+    CU_ASSERT_EQUAL(emulator_read(first, MEMORY_SPACE - 2, &value, 4), -1);
+    emulator_destroy(first);
+    emulator_destroy(second);
+}
+
+void test_load_image() {
+    // copies its data word into its own code page and reads it back
+    Word words[] = {
+        0x000032b7, // lui x5, 0x3
+        0x0002a303, // lw x6, 0(x5)
+        0x000013b7, // lui x7, 0x1
+        0x0263a023, // sw x6, 0x20(x7)
+        0x0203a403, // lw x8, 0x20(x7)
+        0x00a00513, // addi x10, x0, 10
+        0x00000073, // ecall
+    };
+    char code[] = "/tmp/codeXXXXXX", data[] = "/tmp/dataXXXXXX", image[] = "/tmp/imageXXXXXX";
+    char command[256];
+    Captured hex_output, image_output;
+    Emulator *hex = emulator_create(), *mapped = emulator_create();
+    Word hex_page[64], image_page[64];
+    FILE *file;
+    int i;
+
+    close(mkstemp(code));
+    close(mkstemp(data));
+    close(mkstemp(image));
+    file = fopen(code, "w");
+    for (i = 0; i < 7; i++)
+    {
+        fprintf(file, "%08x\n", words[i]);
+    }
+    fclose(file);
+    file = fopen(data, "w");
+    fputs("deadbeef\n", file);
+    fclose(file);
+    snprintf(command, sizeof(command), "python3 hex2image.py -o %s %s %s@0x3000", image, code, data);
+    CU_ASSERT_EQUAL(system(command), 0);
+
+    // the converted image runs as the hex files do
+    CU_ASSERT_EQUAL(emulator_load_hex(hex, code, EMULATOR_ENTRY, -1), 7);
+    CU_ASSERT_EQUAL(emulator_load_hex(hex, data, 0x3000, -1), 1);
+    CU_ASSERT_EQUAL(emulator_load_image(mapped, image), 0);
+    memset(&hex_output, 0, sizeof(Captured));
+    memset(&image_output, 0, sizeof(Captured));
+    emulator_set_output(hex, capture, &hex_output);
+    emulator_set_output(mapped, capture, &image_output);
+    CU_ASSERT_EQUAL(emulator_run(hex, 100), STOP_EXIT);
+    CU_ASSERT_EQUAL(emulator_run(mapped, 100), STOP_EXIT);
+    CU_ASSERT_EQUAL(emulator_processor(mapped)->R[8], 0xdeadbeef);
+    CU_ASSERT_EQUAL(memcmp(emulator_processor(hex), emulator_processor(mapped), sizeof(Processor)), 0);
+    CU_ASSERT_STRING_EQUAL(hex_output.text, image_output.text);
+    emulator_read(hex, EMULATOR_ENTRY, hex_page, sizeof(hex_page));
+    emulator_read(mapped, EMULATOR_ENTRY, image_page, sizeof(image_page));
+    CU_ASSERT_EQUAL(memcmp(hex_page, image_page, sizeof(hex_page)), 0);
+    unlink(code);
+    unlink(data);
+    unlink(image);
+    emulator_destroy(hex);
+    emulator_destroy(mapped);
+}
+
+void test_disassemble() {
+    Word words[] = {0x00500093, 0x00000073};
+    Captured captured;
+    Emulator *emulator = program(words, 2, &captured);
+
+    CU_ASSERT_EQUAL(emulator_disassemble(emulator, EMULATOR_ENTRY, 2), STOP_STEPS);
+    CU_ASSERT_STRING_EQUAL(captured.text, "00001000: addi\tx1, x0, 5\n00001004: ecall\n");
+    emulator_destroy(emulator);
+}
+
+void test_profile() {
+    // addi x5, x0, 3; loop: addi x5, x5, -1; bne x5, x0, loop; sw x5, 256(x0)
+    Word words[] = {0x00300293, 0xfff28293, 0xfe029ee3, 0x10502023};
+    Captured captured;
+    Emulator *emulator = program(words, 4, &captured);
+    FILE *file = tmpfile();
+    char report[2048];
+    size_t length;
+
+    // profiling runs on the handlers whatever the engine
+    emulator_set_engine(emulator, ENGINE_JIT);
+    CU_ASSERT_EQUAL(emulator_set_profiling(emulator, 1), 0);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 8), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, EMULATOR_ENTRY + 16);
+    emulator_profile_report(emulator, file, 1);
+    rewind(file);
+    length = fread(report, 1, sizeof(report) - 1, file);
+    report[length] = '\0';
+    fclose(file);
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "profile: 8 instructions, 0 bytes loaded, 4 bytes stored\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "profile:   bne               3  37.5%  2 taken, 1 not taken\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "profile:   00001004            3  37.5%  addi\tx5, x5, -1\n"));
+    CU_ASSERT_PTR_NULL(strstr(report, "00001000"));
+    CU_ASSERT_EQUAL(captured.length, 0);
+    emulator_destroy(emulator);
+}
+
+void test_timing() {
+    // lw x5, 256(x0); add x6, x5, x5; mul x7, x6, x6; jal x0, 8; (skipped); addi x1, x0, 5;
+    // div x8, x1, x1
+    Word words[] = {0x10002283, 0x00528333, 0x026303b3, 0x0080006f, 0xffffffff, 0x00500093, 0x0210c433};
+    Captured captured;
+    Emulator *emulator = program(words, 7, &captured);
+    FILE *file = tmpfile();
+    char report[2048];
+    size_t length;
+
+    CU_ASSERT_EQUAL(emulator_set_timing(emulator, 1, NULL), 0);
+    CU_ASSERT_EQUAL(emulator_timing_region(emulator, "head", EMULATOR_ENTRY, 8), 0);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 6), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->R[8], 1);
+    emulator_timing_report(emulator, file);
+    rewind(file);
+    length = fread(report, 1, sizeof(report) - 1, file);
+    report[length] = '\0';
+    fclose(file);
+    // one load-use stall, two more cycles of mul in EX, a jump bubble and
+    // 31 more cycles of div in EX
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "timing: 6 instructions in 45 cycles, CPI 7.500\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "timing: all                         6           41  6.833"
+                                          "          1          0          1          2         31\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "timing: head                        2            3  1.500"
+                                          "          1          0          0          0          0\n"));
+    emulator_destroy(emulator);
+}
+
+void test_cache() {
+    // addi x5, x0, 7; sw x5, 256(x0); sw x5, 320(x0); lw x6, 256(x0)
+    Word words[] = {0x00700293, 0x10502023, 0x14502023, 0x10002303};
+    Captured captured;
+    Emulator *emulator = program(words, 4, &captured);
+    CacheHierarchyConfig config;
+    FILE *file = tmpfile();
+    char report[2048];
+    size_t length;
+
+    cache_defaults(&config);
+    CU_ASSERT_EQUAL(cache_parse("l1d=64:1:16:fifo", &config), -1);
+    // 64 bytes do not split into three ways of 16-byte lines
+    CU_ASSERT_EQUAL(cache_parse("l1d=64:3:16", &config), 0);
+    CU_ASSERT_EQUAL(emulator_set_caches(emulator, 1, &config), -1);
+    CU_ASSERT_EQUAL(cache_parse("l1d=64:1:16,l2=off", &config), 0);
+    CU_ASSERT_EQUAL(emulator_set_caches(emulator, 1, &config), 0);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 4), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->R[6], 7);
+    emulator_cache_report(emulator, file, 1);
+    rewind(file);
+    length = fread(report, 1, sizeof(report) - 1, file);
+    report[length] = '\0';
+    fclose(file);
+    // 256 and 320 share the one way of a set, so each access evicts the other
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "cache: L1I      32768     8    64 lru                4            1  25.00%            0\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "cache: L1D         64     1    16 lru                3            3 100.00%            2\n"));
+    CU_ASSERT_PTR_NULL(strstr(report, "cache: L2 "));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "cache:   00001000  L1I 1/1  L1D 0/0  L2 0/0  wb 0  addi\tx5, x0, 7\n"));
+    emulator_destroy(emulator);
+}
+
+void test_branches() {
+    // addi x5, x0, 100; outer: addi x6, x0, 3; inner: addi x6, x6, -1; bne x6, x0, inner;
+    // addi x5, x5, -1; bne x5, x0, outer
+    Word words[] = {0x06400293, 0x00300313, 0xfff30313, 0xfe031ee3, 0xfff28293, 0xfe0298e3};
+    Captured captured;
+    Emulator *emulator = program(words, 6, &captured);
+    FILE *file = tmpfile(), *bitstream = tmpfile();
+    char report[2048];
+    Byte bits[64];
+    size_t length;
+
+    CU_ASSERT_EQUAL(emulator_set_branches(emulator, 1, 0, NULL), -1);
+    CU_ASSERT_EQUAL(emulator_set_branches(emulator, 1, BRANCHES_ALL, bitstream), 0);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 901), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, EMULATOR_ENTRY + 24);
+    emulator_branch_report(emulator, file, 1);
+    rewind(file);
+    length = fread(report, 1, sizeof(report) - 1, file);
+    report[length] = '\0';
+    fclose(file);
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "branches: 400 conditional branches, 74.8% taken, 0 jumps\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "branches: not-taken                 299    25.25%\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "branches: backward-taken            101    74.75%\n"));
+    // a counter per PC keeps predicting the inner loop's exit wrong, history learns it
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "branches: bimodal                   103    74.25%\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "branches: gshare                     12    97.00%\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "branches: tage-lite                   8    98.00%\n"));
+    CU_ASSERT_PTR_NOT_NULL(strstr(report, "branches:   0000100c        300   66.7%  not-taken 200"));
+
+    // the inner loop goes taken, taken, not taken, then the outer one is taken
+    CU_ASSERT_EQUAL(emulator_set_branches(emulator, 0, 0, NULL), 0);
+    rewind(bitstream);
+    CU_ASSERT_EQUAL(fread(bits, 1, sizeof(bits), bitstream), 50);
+    CU_ASSERT_EQUAL(bits[0], 0xBB);
+    CU_ASSERT_EQUAL(bits[49], 0x3B);
+    fclose(bitstream);
+    emulator_destroy(emulator);
+}
+
+void test_snapshot() {
+    // addi x5, x0, 100; loop: addi x5, x5, -1; sw x5, 256(x0); bne x5, x0, loop
+    Word words[] = {0x06400293, 0xfff28293, 0x10502023, 0xfe029ce3};
+    Word dense[1024], sparse = 0x12345678, seed = 1, a[1024], b[1024];
+    char path[] = "/tmp/snapshotXXXXXX", periodic[64];
+    Captured captured;
+    Emulator *emulator = program(words, 4, &captured), *fork = emulator_create();
+    FILE *file;
+    int i;
+
+    close(mkstemp(path));
+    for (i = 0; i < 1024; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        dense[i] = seed | 1;
+    }
+    emulator_write(emulator, 0x8000, dense, sizeof(dense));
+    emulator_write(emulator, 0x20010, &sparse, 4);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 10), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_save_snapshot(emulator, path), 0);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 20), STOP_STEPS);
+
+    // the fork picks up where the snapshot was taken and catches up
+    emulator_write(fork, 0x30000, &sparse, 4);
+    CU_ASSERT_EQUAL(emulator_restore_snapshot(fork, path), 0);
+    CU_ASSERT_EQUAL(emulator_steps(fork), 10);
+    CU_ASSERT_EQUAL(emulator_set_snapshots(fork, 8, path), 0);
+    CU_ASSERT_EQUAL(emulator_run(fork, 20), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_steps(fork), 30);
+    CU_ASSERT_EQUAL(memcmp(emulator_processor(fork), emulator_processor(emulator), sizeof(Processor)), 0);
+    emulator_read(emulator, 0x8000, a, sizeof(a));
+    emulator_read(fork, 0x8000, b, sizeof(b));
+    CU_ASSERT_EQUAL(memcmp(a, b, sizeof(a)), 0);
+    emulator_read(fork, 0x20010, a, 4);
+    emulator_read(fork, 0x30000, b, 4);
+    CU_ASSERT_EQUAL(a[0], sparse);
+    CU_ASSERT_EQUAL(b[0], 0);
+    emulator_read(fork, 256, b, 4);
+    CU_ASSERT_EQUAL(b[0], emulator_processor(emulator)->R[5]);
+
+    // periodic snapshots land at multiples of the interval
+    snprintf(periodic, sizeof(periodic), "%s.24", path);
+    CU_ASSERT_EQUAL(emulator_restore_snapshot(emulator, periodic), 0);
+    CU_ASSERT_EQUAL(unlink(periodic), 0);
+    snprintf(periodic, sizeof(periodic), "%s.16", path);
+    CU_ASSERT_EQUAL(unlink(periodic), 0);
+
+    file = fopen(path, "w");
+    fputs("not a snapshot", file);
+    fclose(file);
+    CU_ASSERT_EQUAL(emulator_restore_snapshot(emulator, path), -1);
+    unlink(path);
+    emulator_destroy(fork);
+    emulator_destroy(emulator);
+}
+
+/* What the recorded run in test_replay did, one step at a time. */
+static void intervene(Emulator *emulator, Double step)
+{
+    // addi x5, x5, -2
+    Word faster = 0xffe28293;
+
+    if (step == 10)
+    {
+        emulator_processor(emulator)->R[5] = 40;
+        emulator_write(emulator, 0x1004, &faster, 4);
+    }
+    if (step == 60)
+    {
+        emulator_processor(emulator)->R[5] = 2;
+    }
+}
+
+void test_replay() {
+    // addi x5, x0, 100; loop: addi x5, x5, -1; sw x5, 256(x0); bne x5, x0, loop
+    Word words[] = {0x06400293, 0xfff28293, 0x10502023, 0xfe029ce3}, word;
+    Address loop = 0x100c, entry = 0x1000, never = 0x2000;
+    Processor states[65];
+    char directory[] = "/tmp/replayXXXXXX", path[64];
+    Captured captured;
+    Emulator *emulator, *reference = program(words, 4, &captured), *replaying = emulator_create();
+    Replay *replay;
+    Double step, last_loop = 0;
+    int i;
+
+    // the reference single-steps through what the recording runs in chunks
+    for (step = 0; step < 65; step++)
+    {
+        intervene(reference, step);
+        states[step] = *emulator_processor(reference);
+        if (step < 64)
+        {
+            CU_ASSERT_EQUAL(emulator_run(reference, 1), STOP_STEPS);
+        }
+        last_loop = states[step].PC == loop ? step : last_loop;
+    }
+    CU_ASSERT_EQUAL(states[64].PC, 0x1010);
+
+    emulator = program(words, 4, &captured);
+    CU_ASSERT_PTR_NOT_NULL(mkdtemp(directory));
+    CU_ASSERT_EQUAL(emulator_record(emulator, directory, 7), 0);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 10), STOP_STEPS);
+    intervene(emulator, 10);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 25), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 25), STOP_STEPS);
+    intervene(emulator, 60);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 10), STOP_INVALID_INSTRUCTION);
+    CU_ASSERT_EQUAL(emulator_steps(emulator), 64);
+    CU_ASSERT_EQUAL(emulator_record(emulator, NULL, 0), 0);
+
+    replay = replay_open(directory);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(replay);
+    CU_ASSERT_EQUAL(replay_seek(replay, replaying, 33), STOP_STEPS);
+    CU_ASSERT_EQUAL(emulator_steps(replaying), 33);
+    CU_ASSERT_EQUAL(memcmp(emulator_processor(replaying), &states[33], sizeof(Processor)), 0);
+    CU_ASSERT_EQUAL(replay_step_back(replay, replaying), 0);
+    CU_ASSERT_EQUAL(memcmp(emulator_processor(replaying), &states[32], sizeof(Processor)), 0);
+    CU_ASSERT_EQUAL(replay_seek(replay, replaying, 10), STOP_STEPS);
+    CU_ASSERT_EQUAL(memcmp(emulator_processor(replaying), &states[10], sizeof(Processor)), 0);
+    emulator_read(replaying, 0x1004, &word, 4);
+    CU_ASSERT_EQUAL(word, 0xffe28293);
+    CU_ASSERT_EQUAL(replay_seek(replay, replaying, 5), STOP_STEPS);
+    CU_ASSERT_EQUAL(memcmp(emulator_processor(replaying), &states[5], sizeof(Processor)), 0);
+    emulator_read(replaying, 0x1004, &word, 4);
+    CU_ASSERT_EQUAL(word, 0xfff28293);
+
+    // past the end the replay stops where the recorded run did
+    CU_ASSERT_EQUAL(replay_seek(replay, replaying, 70), STOP_INVALID_INSTRUCTION);
+    CU_ASSERT_EQUAL(emulator_steps(replaying), 64);
+    CU_ASSERT_EQUAL(memcmp(emulator_processor(replaying), &states[64], sizeof(Processor)), 0);
+
+    CU_ASSERT_EQUAL(replay_continue_back(replay, replaying, &loop, 1), 0);
+    CU_ASSERT_EQUAL(emulator_steps(replaying), last_loop);
+    CU_ASSERT_EQUAL(memcmp(emulator_processor(replaying), &states[last_loop], sizeof(Processor)), 0);
+    CU_ASSERT_EQUAL(replay_continue_back(replay, replaying, &entry, 1), 0);
+    CU_ASSERT_EQUAL(emulator_steps(replaying), 0);
+    CU_ASSERT_EQUAL(replay_step_back(replay, replaying), -1);
+    CU_ASSERT_EQUAL(replay_seek(replay, replaying, 40), STOP_STEPS);
+    CU_ASSERT_EQUAL(replay_continue_back(replay, replaying, &never, 1), -1);
+    CU_ASSERT_EQUAL(emulator_steps(replaying), 0);
+
+    replay_close(replay);
+    for (i = 0; i <= 70; i++)
+    {
+        snprintf(path, sizeof(path), "%s/checkpoint.%d", directory, i);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/events", directory);
+    CU_ASSERT_EQUAL(unlink(path), 0);
+    CU_ASSERT_EQUAL(rmdir(directory), 0);
+    emulator_destroy(replaying);
+    emulator_destroy(reference);
+    emulator_destroy(emulator);
+}
+
+void test_debug() {
+    // addi x5, x0, 100; loop: addi x5, x5, -1; sw x5, 256(x0); bne x5, x0, loop;
+    // addi a0, x0, 10; ecall
+    Word words[] = {0x06400293, 0xfff28293, 0x10502023, 0xfe029ce3, 0x00a00513, 0x00000073};
+    Captured captured;
+    Emulator *emulator = program(words, 6, &captured);
+    WatchKind kind;
+    Address pc;
+
+    // the threaded engine gives way to the handlers while debugging
+    emulator_set_engine(emulator, ENGINE_THREADED);
+    CU_ASSERT_EQUAL(emulator_set_breakpoint(emulator, 0x100c, 1), 0);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 1000), STOP_BREAKPOINT);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, 0x100c);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->R[5], 99);
+    CU_ASSERT_EQUAL(emulator_steps(emulator), 3);
+    // a run starting on the breakpoint runs it and stops there next time
+    CU_ASSERT_EQUAL(emulator_run(emulator, 1000), STOP_BREAKPOINT);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->R[5], 98);
+    CU_ASSERT_EQUAL(emulator_steps(emulator), 6);
+
+    // enough breakpoints to grow the set, then gone again
+    for (pc = 0x8000; pc < 0x8400; pc += 4)
+    {
+        CU_ASSERT_EQUAL(emulator_set_breakpoint(emulator, pc, 1), 0);
+    }
+    for (pc = 0x8000; pc < 0x8400; pc += 4)
+    {
+        CU_ASSERT_EQUAL(emulator_set_breakpoint(emulator, pc, 0), 0);
+    }
+    CU_ASSERT_TRUE(emulator_breakpoint(emulator, 0x100c));
+    CU_ASSERT_FALSE(emulator_breakpoint(emulator, 0x8000));
+    CU_ASSERT_FALSE(emulator_breakpoint(emulator, 0x1008));
+    CU_ASSERT_EQUAL(emulator_set_breakpoint(emulator, 0x100c, 0), 0);
+
+    // a watchpoint stops after the store, with PC past it
+    CU_ASSERT_EQUAL(emulator_set_watchpoint(emulator, 256, 4, WATCH_WRITE, 1), 0);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 1000), STOP_WATCHPOINT);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->PC, 0x100c);
+    CU_ASSERT_EQUAL(emulator_watch_hit(emulator, &kind), 256);
+    CU_ASSERT_EQUAL(kind, WATCH_WRITE);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->R[5], 97);
+    CU_ASSERT_EQUAL(emulator_steps(emulator), 9);
+    CU_ASSERT_EQUAL(emulator_set_watchpoint(emulator, 256, 4, WATCH_READ, 0), -1);
+    CU_ASSERT_EQUAL(emulator_set_watchpoint(emulator, 256, 4, WATCH_WRITE, 0), 0);
+
+    // nothing loads from it
+    CU_ASSERT_EQUAL(emulator_set_watchpoint(emulator, 258, 1, WATCH_READ, 1), 0);
+    CU_ASSERT_EQUAL(emulator_run(emulator, 1000), STOP_EXIT);
+    CU_ASSERT_EQUAL(emulator_processor(emulator)->R[5], 0);
+    emulator_destroy(emulator);
+}
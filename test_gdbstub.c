@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <cunit/Basic.h>
+
+#include "types.h"
+#include "riscv.h"
+#include "emulator.h"
+#include "gdbstub.h"
+
+void test_packet_framing();
+void test_registers();
+void test_memory_packets();
+void test_step_and_continue();
+void test_stop_replies();
+
+typedef struct {
+    Emulator *emulator;
+    pthread_t thread;
+    int fd;
+    int served;
+} Stub;
+
+static char address[108];
+static char reply[GDB_PACKET_SIZE + 1];
+
+// addi x1, x1, 1 four times, then exits
+static Word count_words[] = {
+    0x00108093, 0x00108093, 0x00108093, 0x00108093,
+    0x00a00513, // addi x10, x0, 10
+    0x00000073, // ecall
+};
+
+static void discard(void *context, const char *text, size_t length)
+{
+}
+
+static void *serve(void *argument)
+{
+    Stub *stub = argument;
+
+    stub->served = gdb_serve(stub->emulator, address);
+    return NULL;
+}
+
+/* Serves the program on a fresh emulator and connects to it. */
+static int start_stub(Stub *stub, const Word *words, Word count)
+{
+    struct timeval limit = {5, 0};
+    struct sockaddr_un local;
+    int tries;
+
+    stub->emulator = emulator_create();
+    emulator_write(stub->emulator, EMULATOR_ENTRY, words, 4 * count);
+    emulator_set_output(stub->emulator, discard, NULL);
+    pthread_create(&stub->thread, NULL, serve, stub);
+    memset(&local, 0, sizeof(local));
+    local.sun_family = AF_UNIX;
+    strcpy(local.sun_path, address + 5);
+    // the stub may not be listening yet
+    for (tries = 0; tries < 1000; tries++)
+    {
+        stub->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(stub->fd, (struct sockaddr *)&local, sizeof(local)) == 0)
+        {
+            // a reply that never comes fails the test instead of hanging it
+            setsockopt(stub->fd, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+            return 0;
+        }
+        close(stub->fd);
+        usleep(1000);
+    }
+    return -1;
+}
+
+/* Kills the session and waits for the stub to return. */
+static void stop_stub(Stub *stub)
+{
+    write(stub->fd, "$k#6b", 5);
+    pthread_join(stub->thread, NULL);
+    close(stub->fd);
+    emulator_destroy(stub->emulator);
+}
+
+static int next_byte(Stub *stub)
+{
+    unsigned char c;
+
+    return read(stub->fd, &c, 1) == 1 ? c : -1;
+}
+
+/* Frames text as a packet, with the checksum off by error. */
+static void send_packet(Stub *stub, const char *text, int error)
+{
+    char frame[GDB_PACKET_SIZE + 4];
+    unsigned char sum = 0;
+    const char *c;
+
+    for (c = text; *c; c++)
+    {
+        sum += (unsigned char)*c;
+    }
+    write(stub->fd, frame, sprintf(frame, "$%s#%02x", text, (unsigned char)(sum + error)));
+}
+
+/* Reads one packet into reply without acknowledging it. Returns 0 if its
+ * checksum is right. */
+static int read_reply(Stub *stub)
+{
+    unsigned char sum = 0;
+    int c, length = 0;
+    char check[3] = "";
+
+    while ((c = next_byte(stub)) != '$')
+    {
+        if (c < 0)
+        {
+            return -1;
+        }
+    }
+    while ((c = next_byte(stub)) >= 0 && c != '#' && length < GDB_PACKET_SIZE)
+    {
+        reply[length++] = c;
+        sum += c;
+    }
+    reply[length] = '\0';
+    check[0] = next_byte(stub);
+    check[1] = next_byte(stub);
+    return c == '#' && strtoul(check, NULL, 16) == sum ? 0 : -1;
+}
+
+/* Sends text, checks the stub acknowledges it and acknowledges its reply,
+ * which is left in reply. Returns reply, or "" on any framing error. */
+static const char *request(Stub *stub, const char *text)
+{
+    send_packet(stub, text, 0);
+    if (next_byte(stub) != '+' || read_reply(stub) != 0)
+    {
+        return "";
+    }
+    write(stub->fd, "+", 1);
+    return reply;
+}
+
+static int init_gdbstub() {
+    snprintf(address, sizeof(address), "unix:/tmp/test_gdbstub_%d", (int)getpid());
+    return 0;
+}
+
+static int clean_gdbstub() {
+    unlink(address + 5);
+    return 0;
+}
+
+int main(int arc, char **argv) {
+    CU_pSuite pSuite1 = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry()) {
+        return CU_get_error();
+    }
+
+    pSuite1 = CU_add_suite("Testing the gdb stub", init_gdbstub, clean_gdbstub);
+    if (!pSuite1) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_packet_framing", test_packet_framing)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_registers", test_registers)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_memory_packets", test_memory_packets)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_step_and_continue", test_step_and_continue)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_stop_replies", test_stop_replies)) {
+        goto exit;
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+    exit:
+    CU_cleanup_registry();
+    return CU_get_error();
+}
+
+void test_packet_framing() {
+    Stub stub;
+
+    CU_ASSERT_EQUAL_FATAL(start_stub(&stub, count_words, 6), 0);
+    // a bad checksum is naked and the packet is taken once it is resent
+    send_packet(&stub, "?", 1);
+    CU_ASSERT_EQUAL(next_byte(&stub), '-');
+    send_packet(&stub, "?", 0);
+    CU_ASSERT_EQUAL(next_byte(&stub), '+');
+    CU_ASSERT_EQUAL(read_reply(&stub), 0);
+    CU_ASSERT_STRING_EQUAL(reply, "S05");
+    // a naked reply is sent again
+    write(stub.fd, "-", 1);
+    CU_ASSERT_EQUAL(read_reply(&stub), 0);
+    CU_ASSERT_STRING_EQUAL(reply, "S05");
+    write(stub.fd, "+", 1);
+    // bytes before the $ are skipped, unknown packets get an empty reply
+    write(stub.fd, "xx", 2);
+    CU_ASSERT_STRING_EQUAL(request(&stub, "vMustReplyEmpty"), "");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "qAttached"), "1");
+    CU_ASSERT_PTR_NOT_NULL(strstr(request(&stub, "qSupported:xmlRegisters=i386"), "qXfer:features:read+"));
+    CU_ASSERT_EQUAL(strncmp(request(&stub, "qXfer:features:read:target.xml:0,20"), "m<?xml", 6), 0);
+    CU_ASSERT_EQUAL(strlen(reply), 1 + 0x20);
+    stop_stub(&stub);
+    CU_ASSERT_EQUAL(stub.served, 0);
+}
+
+void test_registers() {
+    char registers[33 * 8 + 1];
+    Stub stub;
+
+    CU_ASSERT_EQUAL_FATAL(start_stub(&stub, count_words, 6), 0);
+    // x0 to x31 then pc, each as little-endian bytes
+    CU_ASSERT_EQUAL(strlen(request(&stub, "g")), 33 * 8);
+    CU_ASSERT_EQUAL(strncmp(reply + 2 * 8, "ffff0e00", 8), 0);
+    CU_ASSERT_EQUAL(strncmp(reply + 32 * 8, "00100000", 8), 0);
+    // G writes them all back, but x0 stays zero
+    memset(registers, '0', 33 * 8);
+    registers[33 * 8] = '\0';
+    memcpy(registers, "01000000", 8);
+    memcpy(registers + 1 * 8, "78563412", 8);
+    memcpy(registers + 32 * 8, "08100000", 8);
+    CU_ASSERT_EQUAL(strlen(registers), 33 * 8);
+    CU_ASSERT_STRING_EQUAL(request(&stub, (sprintf(reply, "G%s", registers), reply)), "OK");
+    CU_ASSERT_EQUAL(emulator_processor(stub.emulator)->R[0], 0);
+    CU_ASSERT_EQUAL(emulator_processor(stub.emulator)->R[1], 0x12345678);
+    CU_ASSERT_EQUAL(emulator_processor(stub.emulator)->R[2], 0);
+    CU_ASSERT_EQUAL(emulator_processor(stub.emulator)->PC, EMULATOR_ENTRY + 8);
+    CU_ASSERT_STRING_EQUAL(request(&stub, "p1"), "78563412");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "P20=00200000"), "OK");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "p20"), "00200000");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "P0=ffffffff"), "OK");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "p0"), "00000000");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "p21"), "E01");
+    stop_stub(&stub);
+}
+
+void test_memory_packets() {
+    Word value;
+    Stub stub;
+
+    CU_ASSERT_EQUAL_FATAL(start_stub(&stub, count_words, 6), 0);
+    CU_ASSERT_STRING_EQUAL(request(&stub, "m1000,8"), "9380100093801000");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "M3000,4:efbeadde"), "OK");
+    CU_ASSERT_EQUAL(emulator_read(stub.emulator, 0x3000, &value, 4), 0);
+    CU_ASSERT_EQUAL(value, 0xdeadbeef);
+    CU_ASSERT_STRING_EQUAL(request(&stub, "m3001,2"), "bead");
+    // too few data bytes, and addresses past the guest's memory
+    CU_ASSERT_STRING_EQUAL(request(&stub, "M3000,4:ef"), "E01");
+    CU_ASSERT_STRING_EQUAL(request(&stub, (sprintf(reply, "m%x,4", MEMORY_SPACE - 2), reply)), "E01");
+    CU_ASSERT_STRING_EQUAL(request(&stub, (sprintf(reply, "M%x,1:00", MEMORY_SPACE), reply)), "E01");
+    stop_stub(&stub);
+}
+
+void test_step_and_continue() {
+    Stub stub;
+
+    CU_ASSERT_EQUAL_FATAL(start_stub(&stub, count_words, 6), 0);
+    CU_ASSERT_STRING_EQUAL(request(&stub, "s"), "S05");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "p20"), "04100000");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "p1"), "01000000");
+    // continue stops on the breakpoint without running it
+    CU_ASSERT_STRING_EQUAL(request(&stub, "Z0,100c,4"), "OK");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "c"), "S05");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "p20"), "0c100000");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "p1"), "03000000");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "z0,100c,4"), "OK");
+    // and an address after c or s resumes there
+    CU_ASSERT_STRING_EQUAL(request(&stub, "s1004"), "S05");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "p1"), "04000000");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "c"), "W00");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "Z9,1000,4"), "");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "D"), "OK");
+    pthread_join(stub.thread, NULL);
+    close(stub.fd);
+    emulator_destroy(stub.emulator);
+    CU_ASSERT_EQUAL(stub.served, 0);
+}
+
+void test_stop_replies() {
+    // lw x2, 0(x5) with x5 past memory, then sw x0, 0(x3) and a bad ecall
+    Word words[] = {0x0002a103, 0x0001a023, 0x00000073};
+    Stub stub;
+
+    CU_ASSERT_EQUAL_FATAL(start_stub(&stub, words, 3), 0);
+    CU_ASSERT_STRING_EQUAL(request(&stub, (sprintf(reply, "P5=%08x", __builtin_bswap32(MEMORY_SPACE)), reply)), "OK");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "c"), "S0b");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "?"), "S0b");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "P20=00100000"), "OK");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "P5=00300000"), "OK");
+    // a watchpoint stops after the store and names its address
+    CU_ASSERT_STRING_EQUAL(request(&stub, "Z2,3000,4"), "OK");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "s"), "S05");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "c"), "T05watch:3000;");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "p20"), "08100000");
+    CU_ASSERT_STRING_EQUAL(request(&stub, "c"), "S04");
+    stop_stub(&stub);
+}
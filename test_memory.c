@@ -0,0 +1,310 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cunit/Basic.h>
+
+#include "types.h"
+#include "riscv.h"
+#include "memory.h"
+#include "instance.h"
+
+void test_store_load_byte();
+void test_store_load_half_word();
+void test_store_load_word();
+void test_store_word_upper_bytes();
+void test_misaligned();
+void test_page_crossing();
+void test_untouched_memory();
+void test_region_rights();
+void test_reset();
+void test_flat_memory();
+void test_flat_rights();
+
+static Byte *memory;
+
+static int init_memory() {
+    memory = allocate_memory();
+    return memory == NULL;
+}
+
+static int clean_memory() {
+    free_memory(memory);
+    return 0;
+}
+
+static char output[256];
+static size_t output_length;
+
+static void capture(void *context, const char *text, size_t length)
+{
+    if (output_length + length < sizeof(output))
+    {
+        memcpy(output + output_length, text, length);
+        output_length += length;
+        output[output_length] = '\0';
+    }
+}
+
+/* Runs one load or store on the default instance and returns why it
+ * stopped, or STOP_STEPS if it did not, with its output in output. */
+static StopReason try_access(Byte *at, Address address, int write)
+{
+    Instance *instance = instance_default();
+    jmp_buf stop;
+
+    output_length = 0;
+    output[0] = '\0';
+    instance->sink = capture;
+    instance->stop = &stop;
+    instance->reason = STOP_STEPS;
+    if (!setjmp(stop))
+    {
+        if (write)
+        {
+            store(at, address, LENGTH_WORD, 1);
+        }
+        else
+        {
+            load(at, address, LENGTH_WORD);
+        }
+    }
+    instance->sink = NULL;
+    instance->stop = NULL;
+    return instance->reason;
+}
+
+int main(int arc, char **argv) {
+    CU_pSuite pSuite1 = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry()) {
+        return CU_get_error();
+    }
+
+    pSuite1 = CU_add_suite("Testing load and store", init_memory, clean_memory);
+    if (!pSuite1) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_store_load_byte", test_store_load_byte)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_store_load_half_word", test_store_load_half_word)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_store_load_word", test_store_load_word)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_store_word_upper_bytes", test_store_word_upper_bytes)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_misaligned", test_misaligned)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_page_crossing", test_page_crossing)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_untouched_memory", test_untouched_memory)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_region_rights", test_region_rights)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_reset", test_reset)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_flat_memory", test_flat_memory)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_flat_rights", test_flat_rights)) {
+        goto exit;
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+    exit:
+    CU_cleanup_registry();
+    return CU_get_error();
+}
+
+void test_store_load_byte() {
+    store(memory, 0x3000, LENGTH_WORD, 0x00000000);
+    store(memory, 0x3001, LENGTH_BYTE, 0x123456AB);
+    CU_ASSERT_EQUAL(load(memory, 0x3001, LENGTH_BYTE), 0xAB);
+    CU_ASSERT_EQUAL(load(memory, 0x3000, LENGTH_BYTE), 0x00);
+    CU_ASSERT_EQUAL(load(memory, 0x3002, LENGTH_BYTE), 0x00);
+    CU_ASSERT_EQUAL(load(memory, 0x3000, LENGTH_WORD), 0x0000AB00);
+    // loads zero-extend, the executor sign-extends where needed
+    store(memory, 0x3003, LENGTH_BYTE, 0x80);
+    CU_ASSERT_EQUAL(load(memory, 0x3003, LENGTH_BYTE), 0x80);
+}
+
+void test_store_load_half_word() {
+    store(memory, 0x3010, LENGTH_WORD, 0x00000000);
+    store(memory, 0x3010, LENGTH_HALF_WORD, 0x1234BEEF);
+    CU_ASSERT_EQUAL(load(memory, 0x3010, LENGTH_HALF_WORD), 0xBEEF);
+    CU_ASSERT_EQUAL(load(memory, 0x3010, LENGTH_BYTE), 0xEF);
+    CU_ASSERT_EQUAL(load(memory, 0x3011, LENGTH_BYTE), 0xBE);
+    CU_ASSERT_EQUAL(load(memory, 0x3012, LENGTH_HALF_WORD), 0x0000);
+    store(memory, 0x3012, LENGTH_HALF_WORD, 0xCAFE);
+    CU_ASSERT_EQUAL(load(memory, 0x3010, LENGTH_WORD), 0xCAFEBEEF);
+}
+
+void test_store_load_word() {
+    store(memory, 0x3020, LENGTH_WORD, 0x89ABCDEF);
+    CU_ASSERT_EQUAL(load(memory, 0x3020, LENGTH_WORD), 0x89ABCDEF);
+    CU_ASSERT_EQUAL(load(memory, 0x3020, LENGTH_HALF_WORD), 0xCDEF);
+    CU_ASSERT_EQUAL(load(memory, 0x3022, LENGTH_HALF_WORD), 0x89AB);
+    store(memory, 0x3024, LENGTH_WORD, 0xFFFFFFFF);
+    CU_ASSERT_EQUAL(load(memory, 0x3024, LENGTH_WORD), 0xFFFFFFFF);
+    CU_ASSERT_EQUAL(load(memory, 0x3020, LENGTH_WORD), 0x89ABCDEF);
+}
+
+void test_store_word_upper_bytes() {
+    // each byte lands in its own slot, little-endian
+    store(memory, 0x3030, LENGTH_WORD, 0xAABBCCDD);
+    CU_ASSERT_EQUAL(load(memory, 0x3030, LENGTH_BYTE), 0xDD);
+    CU_ASSERT_EQUAL(load(memory, 0x3031, LENGTH_BYTE), 0xCC);
+    CU_ASSERT_EQUAL(load(memory, 0x3032, LENGTH_BYTE), 0xBB);
+    CU_ASSERT_EQUAL(load(memory, 0x3033, LENGTH_BYTE), 0xAA);
+    store(memory, 0x3034, LENGTH_WORD, 0x00FF0000);
+    CU_ASSERT_EQUAL(load(memory, 0x3036, LENGTH_BYTE), 0xFF);
+    CU_ASSERT_EQUAL(load(memory, 0x3037, LENGTH_BYTE), 0x00);
+}
+
+void test_misaligned() {
+    store(memory, 0x3040, LENGTH_WORD, 0x00000000);
+    store(memory, 0x3044, LENGTH_WORD, 0x00000000);
+    store(memory, 0x3041, LENGTH_WORD, 0x11223344);
+    CU_ASSERT_EQUAL(load(memory, 0x3041, LENGTH_WORD), 0x11223344);
+    CU_ASSERT_EQUAL(load(memory, 0x3040, LENGTH_WORD), 0x22334400);
+    CU_ASSERT_EQUAL(load(memory, 0x3044, LENGTH_WORD), 0x00000011);
+    store(memory, 0x3047, LENGTH_HALF_WORD, 0x5566);
+    CU_ASSERT_EQUAL(load(memory, 0x3047, LENGTH_HALF_WORD), 0x5566);
+    CU_ASSERT_EQUAL(load(memory, 0x3044, LENGTH_WORD), 0x66000011);
+}
+
+void test_page_crossing() {
+    store(memory, 0x4FFE, LENGTH_WORD, 0xA1B2C3D4);
+    CU_ASSERT_EQUAL(load(memory, 0x4FFE, LENGTH_WORD), 0xA1B2C3D4);
+    CU_ASSERT_EQUAL(load(memory, 0x4FFE, LENGTH_HALF_WORD), 0xC3D4);
+    CU_ASSERT_EQUAL(load(memory, 0x5000, LENGTH_HALF_WORD), 0xA1B2);
+}
+
+void test_untouched_memory() {
+    CU_ASSERT_EQUAL(load(memory, 0x80000, LENGTH_WORD), 0);
+    CU_ASSERT_EQUAL(load(memory, MEMORY_SPACE - 4, LENGTH_WORD), 0);
+    CU_ASSERT_EQUAL(load(memory, MEMORY_SPACE - 1, LENGTH_BYTE), 0);
+    store(memory, MEMORY_SPACE - 4, LENGTH_WORD, 0x01020304);
+    CU_ASSERT_EQUAL(load(memory, MEMORY_SPACE - 1, LENGTH_BYTE), 0x01);
+}
+
+void test_region_rights() {
+    Byte *regions = allocate_memory();
+
+    // everything is allowed until the default is narrowed
+    CU_ASSERT_PTR_NOT_NULL(memory_write_pointer(regions, 0x9000, 4));
+    CU_ASSERT_EQUAL(memory_map(regions, 0x1000, 0x100, MEMORY_READ | MEMORY_EXEC), 0);
+    CU_ASSERT_EQUAL(memory_map(regions, 0x2800, 0x1000, MEMORY_READ | MEMORY_WRITE), 0);
+    memory_set_default(regions, 0);
+
+    CU_ASSERT_PTR_NOT_NULL(memory_read_pointer(regions, 0x1000, 4));
+    CU_ASSERT_PTR_NOT_NULL(memory_fetch_pointer(regions, 0x1004));
+    // a fetch of compressed code at 2 mod 4 is fine, unless the word runs
+    // into a page without the right
+    CU_ASSERT_PTR_EQUAL(memory_fetch_pointer(regions, 0x1006), regions + 0x1006);
+    CU_ASSERT_PTR_NULL(memory_fetch_pointer(regions, 0x1FFE));
+    CU_ASSERT_PTR_NULL(memory_write_pointer(regions, 0x1000, 4));
+    CU_ASSERT_PTR_NULL(memory_write_pointer(regions, 0x1001, 1));
+    CU_ASSERT_PTR_NOT_NULL(memory_write_pointer(regions, 0x3000, 4));
+    CU_ASSERT_PTR_NULL(memory_fetch_pointer(regions, 0x3000));
+    CU_ASSERT_PTR_NULL(memory_read_pointer(regions, 0x9000, 4));
+    // the page holding the end of the code region is readable throughout
+    CU_ASSERT_PTR_NOT_NULL(memory_read_pointer(regions, 0x1FFC, 4));
+    // a misaligned word needs both pages
+    CU_ASSERT_PTR_NOT_NULL(memory_write_pointer(regions, 0x2FFE, 4));
+    CU_ASSERT_PTR_NULL(memory_write_pointer(regions, 0x1FFE, 4));
+    CU_ASSERT_PTR_NULL(memory_read_pointer(regions, MEMORY_SPACE - 2, 4));
+    CU_ASSERT_PTR_NULL(memory_read_pointer(regions, MEMORY_SPACE, 1));
+    free_memory(regions);
+}
+
+void test_reset() {
+    Byte *reset = allocate_memory();
+
+    store(reset, 0x7000, LENGTH_WORD, 0xCAFEF00D);
+    CU_ASSERT_EQUAL(memory_map(reset, 0x1000, 0x100, MEMORY_READ), 0);
+    memory_set_default(reset, 0);
+    memory_reset(reset);
+    CU_ASSERT_EQUAL(page_table(reset)->committed, 0);
+    CU_ASSERT_EQUAL(page_table(reset)->region_count, 0);
+    // the old contents are gone and every page is writable again
+    CU_ASSERT_PTR_NOT_NULL(memory_write_pointer(reset, 0x1000, 4));
+    CU_ASSERT_EQUAL(load(reset, 0x7000, LENGTH_WORD), 0);
+    free_memory(reset);
+}
+
+void test_flat_memory() {
+    // how the driver runs a program: in memory of its own, one word at a time
+    Word words[] = {
+        0x02a00093, // addi x1, x0, 42
+        0x0011a023, // sw x1, 0(x3)
+        0x0001a203, // lw x4, 0(x3)
+    };
+    Byte *flat = calloc(MEMORY_SPACE, 1);
+    Processor processor;
+    int i;
+
+    memset(&processor, 0, sizeof(processor));
+    processor.PC = 0x1000;
+    processor.R[3] = 0x6000;
+    memcpy(flat + 0x1000, words, sizeof(words));
+    for (i = 0; i < 3; i++)
+    {
+        execute_instruction(load(flat, processor.PC, LENGTH_WORD), &processor, flat);
+    }
+    CU_ASSERT_EQUAL(processor.PC, 0x100C);
+    CU_ASSERT_EQUAL(processor.R[4], 42);
+    CU_ASSERT_EQUAL(flat[0x6000], 42);
+    store(flat, MEMORY_SPACE - 4, LENGTH_WORD, 0xA1B2C3D4);
+    CU_ASSERT_EQUAL(load(flat, MEMORY_SPACE - 2, LENGTH_HALF_WORD), 0xA1B2);
+    CU_ASSERT_EQUAL(flat[MEMORY_SPACE - 4], 0xD4);
+    // and a second block of memory is not mistaken for the first
+    CU_ASSERT_EQUAL(load(memory, 0x6000, LENGTH_WORD), 0x00000000);
+    free(flat);
+}
+
+void test_flat_rights() {
+    Byte *flat = calloc(MEMORY_SPACE, 1);
+
+    // accesses past the end reach the handlers, not the host heap
+    CU_ASSERT_EQUAL(try_access(flat, MEMORY_SPACE, 0), STOP_INVALID_READ);
+    CU_ASSERT_STRING_EQUAL(output, "Bad Read. Address: 0x00100000\n");
+    CU_ASSERT_EQUAL(try_access(flat, MEMORY_SPACE - 2, 1), STOP_INVALID_WRITE);
+    CU_ASSERT_STRING_EQUAL(output, "Bad Write. Address: 0x000ffffe\n");
+    CU_ASSERT_EQUAL(try_access(flat, 0xFFFFFFFC, 0), STOP_INVALID_READ);
+    // and regions narrow flat memory as they do paged memory
+    CU_ASSERT_EQUAL(try_access(flat, 0x9000, 1), STOP_STEPS);
+    CU_ASSERT_EQUAL(memory_map(flat, 0x1000, 0x100, MEMORY_READ | MEMORY_EXEC), 0);
+    memory_set_default(flat, 0);
+    CU_ASSERT_EQUAL(try_access(flat, 0x1000, 0), STOP_STEPS);
+    CU_ASSERT_EQUAL(try_access(flat, 0x1000, 1), STOP_INVALID_WRITE);
+    CU_ASSERT_EQUAL(try_access(flat, 0x9000, 0), STOP_INVALID_READ);
+    CU_ASSERT_PTR_NOT_NULL(memory_fetch_pointer(flat, 0x1000));
+    // a reset clears the memory and the regions, and keeps it flat
+    memory_reset(flat);
+    CU_ASSERT_EQUAL(flat[0x9000], 0);
+    CU_ASSERT_EQUAL(try_access(flat, 0x1000, 1), STOP_STEPS);
+    CU_ASSERT_EQUAL(page_table(flat)->committed, MEMORY_PAGES);
+    free(flat);
+}
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cunit/Basic.h>
+
+#include "types.h"
+#include "trace.h"
+
+void test_format();
+void test_round_trip();
+void test_long_output();
+void test_not_a_trace();
+void test_compare();
+
+static char path[] = "/tmp/test_trace_XXXXXX";
+
+static int init_path() {
+    int fd = mkstemp(path);
+
+    return fd < 0;
+}
+
+static int clean_path() {
+    remove(path);
+    return 0;
+}
+
+int main(int arc, char **argv) {
+    CU_pSuite pSuite1 = NULL;
+
+    if (CUE_SUCCESS != CU_initialize_registry()) {
+        return CU_get_error();
+    }
+
+    pSuite1 = CU_add_suite("Testing binary traces", init_path, clean_path);
+    if (!pSuite1) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_format", test_format)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_round_trip", test_round_trip)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_long_output", test_long_output)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_not_a_trace", test_not_a_trace)) {
+        goto exit;
+    }
+
+    if (!CU_add_test(pSuite1, "test_compare", test_compare)) {
+        goto exit;
+    }
+
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+
+    exit:
+    CU_cleanup_registry();
+    return CU_get_error();
+}
+
+void test_format() {
+    Processor processor;
+    char block[TRACE_TEXT_BLOCK + 1], expected[TRACE_TEXT_BLOCK + 1], *at = expected;
+    int i;
+
+    memset(&processor, 0, sizeof(Processor));
+    for (i = 0; i < 32; i++) {
+        processor.R[i] = 0x01234567u * i;
+    }
+    for (i = 0; i < 32; i++) {
+        at += sprintf(at, "r%2d=%08x ", i, processor.R[i]);
+        if (i % 4 == 3) {
+            at += sprintf(at, "\n");
+        }
+    }
+    sprintf(at, "\n");
+    trace_format(block, &processor);
+    block[TRACE_TEXT_BLOCK] = '\0';
+    CU_ASSERT_EQUAL(strlen(expected), TRACE_TEXT_BLOCK);
+    CU_ASSERT_STRING_EQUAL(block, expected);
+}
+
+void test_round_trip() {
+    Processor processor;
+    TraceWriter *writer;
+    TraceReader *reader;
+    const char *text;
+    size_t length;
+
+    memset(&processor, 0, sizeof(Processor));
+    processor.PC = 0x1000;
+    processor.R[2] = 0xEFFFF;
+    writer = trace_create(path, &processor);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(writer);
+    processor.R[5] = 0xDEADBEEF;
+    processor.PC += 4;
+    trace_step(writer, &processor);
+    trace_output(writer, "hi\n", 3);
+    processor.PC = 0x2000;
+    trace_step(writer, &processor);
+    processor.R[1] = 1;
+    processor.R[31] = 0xFFFFFFFF;
+    processor.PC += 4;
+    trace_step(writer, &processor);
+    CU_ASSERT_EQUAL(trace_close(writer), 0);
+
+    reader = trace_open(path);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+    CU_ASSERT_EQUAL(trace_state(reader)->R[2], 0xEFFFF);
+    CU_ASSERT_EQUAL(trace_next(reader), TRACE_STEP);
+    CU_ASSERT_EQUAL(trace_state(reader)->R[5], 0xDEADBEEF);
+    CU_ASSERT_EQUAL(trace_state(reader)->PC, 0x1004);
+    CU_ASSERT_EQUAL(trace_next(reader), TRACE_TEXT);
+    text = trace_text(reader, &length);
+    CU_ASSERT_EQUAL(length, 3);
+    CU_ASSERT_NSTRING_EQUAL(text, "hi\n", 3);
+    CU_ASSERT_EQUAL(trace_next(reader), TRACE_STEP);
+    CU_ASSERT_EQUAL(trace_state(reader)->PC, 0x2000);
+    CU_ASSERT_EQUAL(trace_next(reader), TRACE_STEP);
+    CU_ASSERT_EQUAL(trace_state(reader)->R[1], 1);
+    CU_ASSERT_EQUAL(trace_state(reader)->R[31], 0xFFFFFFFF);
+    CU_ASSERT_EQUAL(trace_state(reader)->R[5], 0xDEADBEEF);
+    CU_ASSERT_EQUAL(trace_state(reader)->PC, 0x2004);
+    CU_ASSERT_EQUAL(trace_next(reader), TRACE_END);
+    trace_close_reader(reader);
+}
+
+void test_long_output() {
+    Processor processor;
+    TraceWriter *writer;
+    TraceReader *reader;
+    char *output = malloc(3 * TRACE_MAX_TEXT);
+    size_t length, total = 0;
+
+    memset(&processor, 0, sizeof(Processor));
+    memset(output, 'x', 3 * TRACE_MAX_TEXT);
+    writer = trace_create(path, &processor);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(writer);
+    trace_output(writer, output, 3 * TRACE_MAX_TEXT);
+    CU_ASSERT_EQUAL(trace_close(writer), 0);
+    reader = trace_open(path);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(reader);
+    while (trace_next(reader) == TRACE_TEXT) {
+        trace_text(reader, &length);
+        total += length;
+    }
+    CU_ASSERT_EQUAL(total, 3 * TRACE_MAX_TEXT);
+    trace_close_reader(reader);
+    free(output);
+}
+
+void test_not_a_trace() {
+    FILE *file = fopen(path, "w");
+
+    fputs("r 0=00000000 r 1=00000000 r 2=000effff r 3=00003000\n", file);
+    fclose(file);
+    CU_ASSERT_PTR_NULL(trace_open(path));
+}
+
+static void write_trace(const char *name, Word changed) {
+    Processor processor;
+    TraceWriter *writer;
+
+    memset(&processor, 0, sizeof(Processor));
+    processor.PC = 0x1000;
+    writer = trace_create(name, &processor);
+    processor.R[5] = 7;
+    processor.PC += 4;
+    trace_step(writer, &processor);
+    processor.R[6] = changed;
+    processor.PC += 4;
+    trace_step(writer, &processor);
+    trace_close(writer);
+}
+
+void test_compare() {
+    char other[] = "/tmp/test_trace_XXXXXX", text[] = "/tmp/test_trace_XXXXXX";
+    TraceDifference difference;
+    FILE *file;
+
+    close(mkstemp(other));
+    close(mkstemp(text));
+    write_trace(path, 1);
+    write_trace(other, 2);
+    CU_ASSERT_EQUAL(trace_compare(path, path, 0, &difference), 0);
+    CU_ASSERT_EQUAL(difference.step, 2);
+    CU_ASSERT_EQUAL(trace_compare(path, other, 0, &difference), 1);
+    CU_ASSERT_EQUAL(difference.kind, DIFFERENCE_REGISTER);
+    CU_ASSERT_EQUAL(difference.step, 1);
+    CU_ASSERT_EQUAL(difference.pc, 0x1004);
+    CU_ASSERT_EQUAL(difference.reg, 6);
+    CU_ASSERT_EQUAL(difference.expected, 1);
+    CU_ASSERT_EQUAL(difference.actual, 2);
+
+    // the text form of a trace agrees with the trace itself
+    file = fopen(text, "w");
+    trace_to_text(other, file);
+    fclose(file);
+    CU_ASSERT_EQUAL(trace_compare(other, text, 0, &difference), 0);
+    CU_ASSERT_EQUAL(trace_compare(text, path, 0, &difference), 1);
+    CU_ASSERT_EQUAL(difference.reg, 6);
+    CU_ASSERT_EQUAL(trace_compare(path, text, 1, &difference), 0);
+    remove(other);
+    remove(text);
+}
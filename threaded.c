@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "types.h"
+#include "utils.h"
+#include "riscv.h"
+#include "predecode.h"
+#include "instance.h"
+
+/* Direct-threaded engine. Each predecoded record caches the address of the
+ * code implementing its op, and every implementation ends by jumping
+ * straight to the next record's code, so there is no central switch for the
+ * branch predictor to miss on. The PC is kept in a local and only written
+ * back when leaving the loop or before a call that may stop the run. The
+ * code for each op is expanded from isa.def like the handlers in part2.c,
+ * so the semantics match exactly. */
+
+#if defined(__GNUC__)
+
+#define R (processor->R)
+
+/* Retire the instruction just executed and run the next one. */
+#define DISPATCH()                  \
+    do                              \
+    {                               \
+        R[0] = 0;                   \
+        if (--count == 0)           \
+            goto done;              \
+        if (!d->target)             \
+            goto lookup;            \
+        goto *d->target;            \
+    } while (0)
+
+/* Fall through to the following instruction, whose record is one slot
+ * per parcel on. */
+#define NEXT()               \
+    do                       \
+    {                        \
+        pc += d->length;     \
+        d += d->length >> 1; \
+        DISPATCH();          \
+    } while (0)
+
+/* Control moved somewhere other than the following instruction: find the
+ * record for pc. */
+#define JUMP()            \
+    do                    \
+    {                     \
+        R[0] = 0;         \
+        if (--count == 0) \
+            goto done;    \
+        goto lookup;      \
+    } while (0)
+
+/* Retire one instruction of a fused sequence other than the last, which
+ * is retired by the NEXT/JUMP that follows. */
+#define SKIP()               \
+    do                       \
+    {                        \
+        count--;             \
+        pc += d->length;     \
+        d += d->length >> 1; \
+    } while (0)
+
+/* Write back the PC and the instructions left before a call that may
+ * stop the run, which must leave PC at the instruction that stopped it. */
+#define SYNC()                  \
+    do                          \
+    {                           \
+        processor->PC = pc;     \
+        instance->left = count; \
+    } while (0)
+
+/* Run the part2.c handler for rare ops that need the architectural PC. */
+#define CALL_OUT()                         \
+    do                                     \
+    {                                      \
+        SYNC();                            \
+        d->handler(d, processor, memory);  \
+        pc = processor->PC;                \
+        JUMP();                            \
+    } while (0)
+
+/* Operands and effects for the isa.def lines, see isa.def. A store may
+ * invalidate the following records, which DISPATCH rechecks. */
+#define RS1 R[d->rs1]
+#define RS2 R[d->rs2]
+#define IMM d->imm
+#define HERE pc
+
+#define THREAD_R(value) \
+    R[d->rd] = (value); \
+    NEXT()
+#define THREAD_I THREAD_R
+#define THREAD_SHIFT THREAD_R
+#define THREAD_U THREAD_R
+#define THREAD_LOAD(access)                                                      \
+    SYNC();                                                                      \
+    R[d->rd] = ISA_EXTEND(load(memory, RS1 + IMM, ISA_WIDTH(access)), (access)); \
+    NEXT()
+#define THREAD_STORE(width)                 \
+    SYNC();                                 \
+    store(memory, RS1 + IMM, (width), RS2); \
+    NEXT()
+#define THREAD_BRANCH(taken) \
+    if (taken)               \
+    {                        \
+        pc += IMM;           \
+        JUMP();              \
+    }                        \
+    NEXT()
+#define THREAD_J(target)           \
+    {                              \
+        Address next = (target);   \
+        R[d->rd] = pc + d->length; \
+        pc = next;                 \
+        JUMP();                    \
+    }
+#define THREAD_JR THREAD_J
+#define THREAD_ECALL(unused) CALL_OUT()
+
+/* The value each R, I, SHIFT or U line writes to rd, for the leading
+ * instructions of a fused sequence. The last one of a sequence runs the
+ * op's own code above. */
+#define VALUE_R(name, effect)                                               \
+    static inline Word value_##name(const DecodedInstruction *d,            \
+                                    const Processor *processor, Address pc) \
+    {                                                                       \
+        return (effect);                                                    \
+    }
+#define VALUE_I VALUE_R
+#define VALUE_SHIFT VALUE_R
+#define VALUE_U VALUE_R
+#define VALUE_LOAD(name, effect)
+#define VALUE_STORE(name, effect)
+#define VALUE_BRANCH(name, effect)
+#define VALUE_J(name, effect)
+#define VALUE_JR(name, effect)
+#define VALUE_ECALL(name, effect)
+#define INSTRUCTION(op, name, opcode, funct3, funct7, format, effect) VALUE_##format(name, effect)
+#include "isa.def"
+#undef INSTRUCTION
+
+/* Run one leading instruction of a fused sequence. */
+#define STEP(name)                                 \
+    do                                             \
+    {                                              \
+        R[d->rd] = value_##name(d, processor, pc); \
+        SKIP();                                    \
+    } while (0)
+
+/* Enter a fused sequence of length instructions, or run the first alone
+ * when fewer steps are left. */
+#define FUSE(fusion, length)     \
+    do                           \
+    {                            \
+        if (count < (length))    \
+        {                        \
+            goto *labels[d->op]; \
+        }                        \
+        fusion_hits[fusion]++;   \
+    } while (0)
+
+unsigned long execute_threaded(Processor *processor, Byte *memory, unsigned long count)
+{
+    static const void *const labels[OP_COUNT] = {
+#define INSTRUCTION(op, name, opcode, funct3, funct7, format, effect) [OP_##op] = &&op_##name,
+#include "isa.def"
+#undef INSTRUCTION
+        [OP_INVALID] = &&op_call_out,
+    };
+    static const void *const fused_labels[FUSION_COUNT] = {
+        [FUSE_LUI_ADDI] = &&fuse_lui_addi,
+        [FUSE_ADDI_BNE] = &&fuse_addi_bne,
+        [FUSE_SLLI_ADD] = &&fuse_slli_add,
+        [FUSE_ADDI_SLLI_ADD] = &&fuse_addi_slli_add,
+    };
+    Instance *instance = current_instance;
+    DecodedInstruction *cache = instance->predecode_cache;
+    unsigned long *fusion_hits = instance->fusion_hits;
+    Fusion fusion;
+    unsigned long requested = count;
+    Address pc = processor->PC;
+    DecodedInstruction *d;
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+lookup:
+    if (!(pc & 0x1) && pc < MEMORY_SPACE)
+    {
+        d = &cache[pc >> 1];
+        if (d->target)
+        {
+            goto *d->target;
+        }
+    }
+    // fetching or decoding may stop the run
+    SYNC();
+    d = predecode_lookup(pc, fetch(memory, pc));
+    d->target = labels[d->op];
+    if ((pc & 0x1) || pc >= MEMORY_SPACE)
+    {
+        goto *d->target; // scratch record, no neighbours to fuse with
+    }
+    fusion = fuse(d, pc, memory);
+    if (fusion != FUSE_NONE)
+    {
+        d->target = fused_labels[fusion];
+    }
+    goto *d->target;
+
+#define INSTRUCTION(op, name, opcode, funct3, funct7, format, effect) \
+    op_##name:                                                        \
+    THREAD_##format(effect);
+#include "isa.def"
+#undef INSTRUCTION
+op_call_out:
+    CALL_OUT();
+
+fuse_lui_addi:
+    FUSE(FUSE_LUI_ADDI, 2);
+    STEP(lui);
+    goto op_addi;
+fuse_addi_bne:
+    FUSE(FUSE_ADDI_BNE, 2);
+    STEP(addi);
+    goto op_bne;
+fuse_slli_add:
+    FUSE(FUSE_SLLI_ADD, 2);
+    STEP(slli);
+    goto op_add;
+fuse_addi_slli_add:
+    FUSE(FUSE_ADDI_SLLI_ADD, 3);
+    STEP(addi);
+    STEP(slli);
+    goto op_add;
+
+done:
+    processor->PC = pc;
+    return requested;
+}
+
+#else
+
+/* Without computed goto there is no portable way to thread the handlers
+ * (C has no guaranteed tail calls), so dispatch through the handler table
+ * in a loop instead. */
+unsigned long execute_threaded(Processor *processor, Byte *memory, unsigned long count)
+{
+    const DecodedInstruction *d;
+    unsigned long i;
+
+    for (i = 0; i < count; i++)
+    {
+        current_instance->left = count - i;
+        d = predecode_lookup(processor->PC, fetch(memory, processor->PC));
+        d->handler(d, processor, memory);
+        processor->R[0] = 0;
+    }
+    return count;
+}
+
+#endif
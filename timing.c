@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "types.h"
+#include "memory.h"
+#include "predecode.h"
+#include "predictor.h"
+#include "instance.h"
+#include "timing.h"
+
+/* Accounts cycles and stalls per PC as instructions retire, and sums them
+ * per region for the report. See timing.h for the pipeline modelled. */
+
+static const char *const stall_names[STALL_KINDS] = {
+    [STALL_LOAD_USE] = "load-use",
+    [STALL_BRANCH] = "branch",
+    [STALL_JUMP] = "jump",
+    [STALL_MULTIPLY] = "multiply",
+    [STALL_DIVIDE] = "divide",
+};
+
+static void report_at_exit(void)
+{
+    timing_report(stderr);
+}
+
+void timing_defaults(TimingConfig *config)
+{
+    config->mul_latency = 3;
+    config->div_latency = 32; // one quotient bit a cycle
+    config->branch_penalty = 2;
+    config->jump_penalty = 1;
+    config->predictor = PREDICT_BACKWARD;
+}
+
+/* Starts modelling the current instance's execution with config, or the
+ * defaults if it is NULL, from an empty pipeline. A model already running
+ * is replaced. Returns -1 if the predictor is unknown or out of memory. */
+int timing_start(const TimingConfig *config)
+{
+    Timing *timing = calloc(1, sizeof(Timing));
+
+    if (!timing)
+    {
+        return -1;
+    }
+    if (config)
+    {
+        timing->config = *config;
+    }
+    else
+    {
+        timing_defaults(&timing->config);
+    }
+    timing->predictor = predictor_create(timing->config.predictor);
+    timing->counts = instance_pc_table(sizeof(TimingCounts));
+    if (!timing->predictor || !timing->counts)
+    {
+        timing_destroy(timing);
+        return -1;
+    }
+    if (current_instance->timing)
+    {
+        timing_destroy(current_instance->timing);
+    }
+    current_instance->timing = timing;
+    instance_flush(current_instance);
+    instance_report_at_exit(report_at_exit);
+    return 0;
+}
+
+/* Stops modelling the current instance and drops what was counted. */
+void timing_stop(void)
+{
+    if (!current_instance->timing)
+    {
+        return;
+    }
+    timing_destroy(current_instance->timing);
+    current_instance->timing = NULL;
+    instance_flush(current_instance);
+}
+
+void timing_destroy(Timing *timing)
+{
+    if (timing->predictor)
+    {
+        predictor_destroy(timing->predictor);
+    }
+    instance_pc_table_free(timing->counts, sizeof(TimingCounts));
+    free(timing);
+}
+
+/* Reports the words from base to base + size as region name. Without any
+ * regions the report has a line per 4 KiB page of code. Returns -1 once
+ * there are TIMING_REGIONS. */
+int timing_region(const char *name, Address base, Word size)
+{
+    Timing *timing = current_instance->timing;
+    TimingRegion *region;
+
+    if (!timing || timing->region_count == TIMING_REGIONS)
+    {
+        return -1;
+    }
+    region = &timing->regions[timing->region_count++];
+    snprintf(region->name, sizeof(region->name), "%s", name);
+    region->base = base;
+    region->size = size;
+    return 0;
+}
+
+static void stall(Timing *timing, TimingCounts *counts, StallKind kind, unsigned long cycles)
+{
+    counts->stalls[kind] += cycles;
+    timing->total.stalls[kind] += cycles;
+}
+
+/* Accounts the instruction at pc, which has run and left PC at next. */
+void timing_retire(Timing *timing, const DecodedInstruction *decoded, Address pc, Address next)
+{
+    TimingCounts *counts = &timing->elsewhere;
+    Byte loaded = timing->loaded;
+    int taken, predicted;
+
+    if (!(pc & 0x1) && pc < MEMORY_SPACE)
+    {
+        counts = &timing->counts[pc >> 1];
+    }
+    counts->instructions++;
+    timing->total.instructions++;
+    // x0 is never loaded for anyone, and unused fields decode as x0
+    if (loaded && (decoded->rs1 == loaded || decoded->rs2 == loaded ||
+                   (decoded->op == OP_ECALL && (loaded == 10 || loaded == 11))))
+    {
+        stall(timing, counts, STALL_LOAD_USE, 1);
+    }
+    timing->loaded = 0;
+    switch (decoded->op)
+    {
+    case OP_LB:
+    case OP_LH:
+    case OP_LW:
+    case OP_LBU:
+    case OP_LHU:
+        timing->loaded = decoded->rd;
+        break;
+    case OP_MUL:
+    case OP_MULH:
+    case OP_MULHSU:
+    case OP_MULHU:
+        if (timing->config.mul_latency > 1)
+        {
+            stall(timing, counts, STALL_MULTIPLY, timing->config.mul_latency - 1);
+        }
+        break;
+    case OP_DIV:
+    case OP_DIVU:
+    case OP_REM:
+    case OP_REMU:
+        if (timing->config.div_latency > 1)
+        {
+            stall(timing, counts, STALL_DIVIDE, timing->config.div_latency - 1);
+        }
+        break;
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLT:
+    case OP_BGE:
+    case OP_BLTU:
+    case OP_BGEU:
+        taken = next != pc + decoded->length;
+        predicted = timing->predictor->predict(timing->predictor, pc, pc + decoded->imm);
+        timing->predictor->update(timing->predictor, pc, pc + decoded->imm, taken);
+        timing->branches++;
+        if (predicted != taken)
+        {
+            timing->mispredicted++;
+            stall(timing, counts, STALL_BRANCH, timing->config.branch_penalty);
+        }
+        else if (taken)
+        {
+            stall(timing, counts, STALL_JUMP, timing->config.jump_penalty);
+        }
+        break;
+    case OP_JAL:
+    case OP_JALR:
+        timing->predictor->update(timing->predictor, pc, next, 1);
+        stall(timing, counts, STALL_JUMP, timing->config.jump_penalty);
+        break;
+    default:
+        break;
+    }
+}
+
+static unsigned long cycles(const TimingCounts *counts)
+{
+    unsigned long total = counts->instructions;
+    int i;
+
+    for (i = 0; i < STALL_KINDS; i++)
+    {
+        total += counts->stalls[i];
+    }
+    return total;
+}
+
+/* Adds the counts of the instructions from base up to end. */
+static void sum_range(const Timing *timing, Address base, Address end, TimingCounts *sum)
+{
+    Address i;
+    int kind;
+
+    memset(sum, 0, sizeof(TimingCounts));
+    for (i = (base + 1) >> 1; i < PREDECODE_ENTRIES && i < (end + 1) >> 1; i++)
+    {
+        sum->instructions += timing->counts[i].instructions;
+        for (kind = 0; kind < STALL_KINDS; kind++)
+        {
+            sum->stalls[kind] += timing->counts[i].stalls[kind];
+        }
+    }
+}
+
+static void report_line(FILE *output, const char *name, const TimingCounts *counts)
+{
+    int kind;
+
+    fprintf(output, "timing: %-16s %12lu %12lu %6.3f", name, counts->instructions, cycles(counts),
+            (double)cycles(counts) / counts->instructions);
+    for (kind = 0; kind < STALL_KINDS; kind++)
+    {
+        fprintf(output, " %10lu", counts->stalls[kind]);
+    }
+    fprintf(output, "\n");
+}
+
+/* Prints the current instance's cycle estimate, CPI and stalls by kind,
+ * overall and per region. */
+void timing_report(FILE *output)
+{
+    const Timing *timing = current_instance->timing;
+    unsigned long total;
+    TimingCounts sum;
+    Address page;
+    char name[32];
+    int i;
+
+    if (!timing || !timing->total.instructions)
+    {
+        return;
+    }
+    total = cycles(&timing->total) + TIMING_FILL;
+    fprintf(output, "timing: %lu instructions in %lu cycles, CPI %.3f\n", timing->total.instructions,
+            total, (double)total / timing->total.instructions);
+    fprintf(output, "timing: %lu branches, %lu mispredicted by %s (%.1f%% right)\n", timing->branches,
+            timing->mispredicted, timing->predictor->name,
+            timing->branches ? 100.0 * (timing->branches - timing->mispredicted) / timing->branches : 100.0);
+    fprintf(output, "timing: %-16s %12s %12s %6s", "region", "instructions", "cycles", "CPI");
+    for (i = 0; i < STALL_KINDS; i++)
+    {
+        fprintf(output, " %10s", stall_names[i]);
+    }
+    fprintf(output, "\n");
+    report_line(output, "all", &timing->total);
+    for (i = 0; i < timing->region_count; i++)
+    {
+        sum_range(timing, timing->regions[i].base,
+                  timing->regions[i].base + timing->regions[i].size, &sum);
+        if (sum.instructions)
+        {
+            report_line(output, timing->regions[i].name, &sum);
+        }
+    }
+    for (page = 0; !timing->region_count && page < MEMORY_SPACE / MEMORY_PAGE_SIZE; page++)
+    {
+        sum_range(timing, page << MEMORY_PAGE_SHIFT, (page + 1) << MEMORY_PAGE_SHIFT, &sum);
+        if (sum.instructions)
+        {
+            snprintf(name, sizeof(name), "%08x", page << MEMORY_PAGE_SHIFT);
+            report_line(output, name, &sum);
+        }
+    }
+}
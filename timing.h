@@ -0,0 +1,81 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdio.h>
+#include "types.h"
+#include "predecode.h"
+#include "predictor.h"
+#include "instance.h"
+
+/* Cycle-approximate model of a classic in-order IF/ID/EX/MEM/WB pipeline
+ * with full forwarding, run beside the functional emulator. Every retired
+ * instruction costs one cycle, plus stalls:
+ *
+ *   load-use  1 cycle when an instruction reads the register the load
+ *             right before it wrote
+ *   branch    branch_penalty cycles when the predictor got a branch wrong,
+ *             since branches resolve in EX
+ *   jump      jump_penalty cycles for jal, jalr and correctly predicted
+ *             taken branches, whose target is only known in ID
+ *   multiply  mul_latency - 1 cycles while a mul or mulh* holds EX
+ *   divide    div_latency - 1 cycles while a div, divu, rem or remu holds
+ *             EX, as the divider is iterative and not pipelined
+ *
+ * and the cycles to fill the pipeline once. Like a profile (see profile.h)
+ * the model sees instructions through the observed handler, so an instance
+ * without one runs exactly as before. */
+
+#define TIMING_FILL 4      // cycles before the first instruction retires
+#define TIMING_REGIONS 32
+
+typedef enum {
+    STALL_LOAD_USE,
+    STALL_BRANCH,
+    STALL_JUMP,
+    STALL_MULTIPLY,
+    STALL_DIVIDE,
+    STALL_KINDS
+} StallKind;
+
+struct TimingConfig {
+    unsigned mul_latency;    // cycles a mul or mulh* spends in EX
+    unsigned div_latency;    // cycles a div, divu, rem or remu spends in EX
+    unsigned branch_penalty; // cycles lost to a mispredicted branch
+    unsigned jump_penalty;   // cycles lost to a taken jump or branch
+    PredictorKind predictor;
+};
+
+typedef struct {
+    unsigned long instructions;
+    unsigned long stalls[STALL_KINDS];
+} TimingCounts;
+
+/* A named address range the report gives its own line. */
+typedef struct {
+    char name[32];
+    Address base;
+    Word size;
+} TimingRegion;
+
+struct Timing {
+    TimingConfig config;
+    Predictor *predictor;
+    TimingCounts *counts;   // per parcel, indexed by PC >> 1
+    TimingCounts total;
+    TimingCounts elsewhere; // PCs without a slot, only in the total
+    Byte loaded;            // register the previous instruction loaded, or 0
+    unsigned long branches;
+    unsigned long mispredicted;
+    TimingRegion regions[TIMING_REGIONS];
+    int region_count;
+};
+
+/* see timing.c */
+void timing_defaults(TimingConfig *config);
+int timing_start(const TimingConfig *config);
+void timing_stop(void);
+int timing_region(const char *name, Address base, Word size);
+void timing_retire(Timing *timing, const DecodedInstruction *decoded, Address pc, Address next);
+void timing_report(FILE *output);
+
+#endif
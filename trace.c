@@ -0,0 +1,374 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "types.h"
+#include "trace.h"
+
+#define STEP_RECORD_SIZE (1 + 32 * 5 + 4)
+#define TEXT_RECORD_SIZE (1 + 4 + TRACE_MAX_TEXT)
+
+struct TraceWriter {
+    int fd;
+    int failed;
+    Processor last;
+    size_t used;
+    Byte buffer[TRACE_BUFFER_SIZE];
+};
+
+struct TraceReader {
+    int fd;
+    Processor state;
+    const char *text;
+    size_t text_length;
+    size_t start; // first unread byte in buffer
+    size_t end;
+    Byte buffer[TRACE_BUFFER_SIZE];
+};
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+static const char hex_digits[] = "0123456789abcdef";
+#endif
+
+static void put_word(Byte *at, Word value)
+{
+    at[0] = (Byte)value;
+    at[1] = (Byte)(value >> 8);
+    at[2] = (Byte)(value >> 16);
+    at[3] = (Byte)(value >> 24);
+}
+
+static Word get_word(const Byte *at)
+{
+    return at[0] | (at[1] << 8) | (at[2] << 16) | ((Word)at[3] << 24);
+}
+
+/* Writes value as 8 lowercase hex digits. On little-endian hosts the
+ * digits are spread one nibble per byte of a 64-bit word and turned into
+ * ASCII all at once. */
+static void format_register(char *at, Word value)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t x = value, letters;
+
+    x = (x | (x << 16)) & 0x0000FFFF0000FFFFULL;
+    x = (x | (x << 8)) & 0x00FF00FF00FF00FFULL;
+    x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    letters = ((x + 0x0606060606060606ULL) >> 4) & 0x0101010101010101ULL; // nibbles >= 10
+    x += 0x3030303030303030ULL + letters * ('a' - '0' - 10);
+    x = __builtin_bswap64(x);
+    memcpy(at, &x, 8);
+#else
+    int i;
+
+    for (i = 7; i >= 0; i--, value >>= 4)
+    {
+        at[i] = hex_digits[value & 0xF];
+    }
+#endif
+}
+
+/* Fills block with the TRACE_TEXT_BLOCK characters the -r mode prints for
+ * processor, without a terminating NUL. Much cheaper than printf. */
+void trace_format(char *block, const Processor *processor)
+{
+    char *at = block;
+    int i;
+
+    for (i = 0; i < 32; i++)
+    {
+        at[0] = 'r';
+        at[1] = i < 10 ? ' ' : '0' + i / 10;
+        at[2] = '0' + i % 10;
+        at[3] = '=';
+        format_register(at + 4, processor->R[i]);
+        at[12] = ' ';
+        at += 13;
+        if (i % 4 == 3)
+        {
+            *at++ = '\n';
+        }
+    }
+    *at = '\n';
+}
+
+static void flush_writer(TraceWriter *writer)
+{
+    size_t done = 0;
+    ssize_t written;
+
+    while (done < writer->used && !writer->failed)
+    {
+        written = write(writer->fd, writer->buffer + done, writer->used - done);
+        if (written <= 0)
+        {
+            writer->failed = 1;
+        }
+        else
+        {
+            done += written;
+        }
+    }
+    writer->used = 0;
+}
+
+/* Starts a trace of a run beginning in state initial. Returns NULL if path
+ * cannot be created. */
+TraceWriter *trace_create(const char *path, const Processor *initial)
+{
+    TraceWriter *writer = malloc(sizeof(TraceWriter));
+    Byte *at;
+    int i;
+
+    if (!writer)
+    {
+        return NULL;
+    }
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (writer->fd < 0)
+    {
+        free(writer);
+        return NULL;
+    }
+    writer->failed = 0;
+    writer->last = *initial;
+    at = writer->buffer;
+    memcpy(at, TRACE_MAGIC, 4);
+    put_word(at + 4, TRACE_VERSION);
+    for (i = 0; i < 32; i++)
+    {
+        put_word(at + 8 + 4 * i, initial->R[i]);
+    }
+    put_word(at + 8 + 4 * 32, initial->PC);
+    writer->used = sizeof(TraceHeader);
+    return writer;
+}
+
+/* Records the state after one step. */
+void trace_step(TraceWriter *writer, const Processor *processor)
+{
+    Byte *record, *at;
+    Byte count = 0;
+    int i;
+
+    if (writer->used + STEP_RECORD_SIZE > TRACE_BUFFER_SIZE)
+    {
+        flush_writer(writer);
+    }
+    record = writer->buffer + writer->used;
+    at = record + 1;
+    for (i = 0; i < 32; i++)
+    {
+        if (processor->R[i] != writer->last.R[i])
+        {
+            at[0] = (Byte)i;
+            put_word(at + 1, processor->R[i]);
+            at += 5;
+            count++;
+        }
+    }
+    if (processor->PC != writer->last.PC + 4)
+    {
+        count |= TRACE_JUMP;
+        put_word(at, processor->PC);
+        at += 4;
+    }
+    record[0] = count;
+    writer->used = at - writer->buffer;
+    writer->last = *processor;
+}
+
+/* Records program output. Matches OutputSink, so a writer can be an
+ * emulator's output sink. */
+void trace_output(void *context, const char *text, size_t length)
+{
+    TraceWriter *writer = context;
+    size_t chunk;
+
+    while (length)
+    {
+        chunk = length < TRACE_MAX_TEXT ? length : TRACE_MAX_TEXT;
+        if (writer->used + TEXT_RECORD_SIZE > TRACE_BUFFER_SIZE)
+        {
+            flush_writer(writer);
+        }
+        writer->buffer[writer->used] = TRACE_OUTPUT;
+        put_word(writer->buffer + writer->used + 1, (Word)chunk);
+        memcpy(writer->buffer + writer->used + 5, text, chunk);
+        writer->used += 5 + chunk;
+        text += chunk;
+        length -= chunk;
+    }
+}
+
+/* Writes out what is buffered and closes the trace. Returns -1 if any
+ * write failed. */
+int trace_close(TraceWriter *writer)
+{
+    int failed;
+
+    flush_writer(writer);
+    failed = writer->failed || close(writer->fd) != 0;
+    free(writer);
+    return failed ? -1 : 0;
+}
+
+/* Makes at least size unread bytes available unless the file ends first.
+ * Returns whether it could. */
+static int fill_reader(TraceReader *reader, size_t size)
+{
+    ssize_t got;
+
+    if (reader->end - reader->start >= size)
+    {
+        return 1;
+    }
+    memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->start = 0;
+    while (reader->end < size)
+    {
+        got = read(reader->fd, reader->buffer + reader->end, TRACE_BUFFER_SIZE - reader->end);
+        if (got <= 0)
+        {
+            return 0;
+        }
+        reader->end += got;
+    }
+    return 1;
+}
+
+/* Opens a binary trace and reads its header. Returns NULL if path cannot
+ * be read or is not a trace. */
+TraceReader *trace_open(const char *path)
+{
+    TraceReader *reader = malloc(sizeof(TraceReader));
+    const Byte *header;
+    int i;
+
+    if (!reader)
+    {
+        return NULL;
+    }
+    reader->fd = open(path, O_RDONLY);
+    reader->start = reader->end = 0;
+    reader->text = NULL;
+    reader->text_length = 0;
+    if (reader->fd < 0 || !fill_reader(reader, sizeof(TraceHeader)) ||
+        memcmp(reader->buffer, TRACE_MAGIC, 4) != 0 || get_word(reader->buffer + 4) != TRACE_VERSION)
+    {
+        if (reader->fd >= 0)
+        {
+            close(reader->fd);
+        }
+        free(reader);
+        return NULL;
+    }
+    header = reader->buffer;
+    for (i = 0; i < 32; i++)
+    {
+        reader->state.R[i] = get_word(header + 8 + 4 * i);
+    }
+    reader->state.PC = get_word(header + 8 + 4 * 32);
+    reader->start = sizeof(TraceHeader);
+    return reader;
+}
+
+/* Reads the next record. After TRACE_STEP trace_state() holds the state
+ * after that step; after TRACE_TEXT trace_text() holds the output, valid
+ * until the next call. */
+TraceRecord trace_next(TraceReader *reader)
+{
+    const Byte *at;
+    Byte tag;
+    Word count, i, size;
+
+    if (!fill_reader(reader, 1))
+    {
+        return reader->end == reader->start ? TRACE_END : TRACE_ERROR;
+    }
+    tag = reader->buffer[reader->start];
+    if (tag == TRACE_OUTPUT)
+    {
+        if (!fill_reader(reader, 5))
+        {
+            return TRACE_ERROR;
+        }
+        size = get_word(reader->buffer + reader->start + 1);
+        if (size > TRACE_MAX_TEXT || !fill_reader(reader, 5 + size))
+        {
+            return TRACE_ERROR;
+        }
+        reader->text = (const char *)reader->buffer + reader->start + 5;
+        reader->text_length = size;
+        reader->start += 5 + size;
+        return TRACE_TEXT;
+    }
+    count = tag & TRACE_COUNT_MASK;
+    size = 1 + 5 * count + ((tag & TRACE_JUMP) ? 4 : 0);
+    if (count > 32 || (tag & TRACE_OUTPUT) || !fill_reader(reader, size))
+    {
+        return TRACE_ERROR;
+    }
+    at = reader->buffer + reader->start + 1;
+    for (i = 0; i < count; i++, at += 5)
+    {
+        if (at[0] >= 32)
+        {
+            return TRACE_ERROR;
+        }
+        reader->state.R[at[0]] = get_word(at + 1);
+    }
+    reader->state.PC = (tag & TRACE_JUMP) ? get_word(at) : reader->state.PC + 4;
+    reader->start += size;
+    return TRACE_STEP;
+}
+
+const Processor *trace_state(const TraceReader *reader)
+{
+    return &reader->state;
+}
+
+const char *trace_text(const TraceReader *reader, size_t *length)
+{
+    *length = reader->text_length;
+    return reader->text;
+}
+
+void trace_close_reader(TraceReader *reader)
+{
+    close(reader->fd);
+    free(reader);
+}
+
+/* Writes the text trace -r would have printed for the binary trace at
+ * path. Returns 0 on success, -1 if the trace is unreadable or corrupt. */
+int trace_to_text(const char *path, FILE *output)
+{
+    TraceReader *reader = trace_open(path);
+    TraceRecord record;
+    char block[TRACE_TEXT_BLOCK];
+    const char *text;
+    size_t length;
+
+    if (!reader)
+    {
+        return -1;
+    }
+    while ((record = trace_next(reader)) == TRACE_STEP || record == TRACE_TEXT)
+    {
+        if (record == TRACE_STEP)
+        {
+            trace_format(block, trace_state(reader));
+            fwrite(block, 1, TRACE_TEXT_BLOCK, output);
+        }
+        else
+        {
+            text = trace_text(reader, &length);
+            fwrite(text, 1, length, output);
+        }
+    }
+    trace_close_reader(reader);
+    return record == TRACE_END ? 0 : -1;
+}
@@ -0,0 +1,85 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "types.h"
+
+/* Binary register trace, the compact form of the -r text trace. A header
+ * holding the initial registers and PC is followed by one record per step
+ * or per piece of program output, in the order the text trace would show
+ * them. A step record is a byte giving the number of registers the step
+ * changed, with TRACE_JUMP set when PC did not simply advance by 4, then
+ * an index byte and value for each changed register, then the new PC if
+ * TRACE_JUMP is set. An output record is TRACE_OUTPUT, a length and that
+ * many bytes of text. All fields are little-endian. */
+
+#define TRACE_MAGIC "RVTR"
+#define TRACE_VERSION 1
+#define TRACE_JUMP 0x80
+#define TRACE_OUTPUT 0x40
+#define TRACE_COUNT_MASK 0x3F
+#define TRACE_MAX_TEXT 4096 // longer output is split over several records
+#define TRACE_BUFFER_SIZE (1 << 20)
+
+/* One step of the text trace: 8 lines of 4 "r%2d=%08x " fields and a
+ * blank line. */
+#define TRACE_TEXT_BLOCK (8 * (4 * 13 + 1) + 1)
+
+typedef struct {
+    char magic[4];
+    Word version;
+    Word registers[32];
+    Address pc;
+} TraceHeader;
+
+typedef enum {
+    TRACE_END,
+    TRACE_STEP,
+    TRACE_TEXT,
+    TRACE_ERROR,
+} TraceRecord;
+
+typedef enum {
+    DIFFERENCE_REGISTER, // a register differs after the step
+    DIFFERENCE_PC,       // both traces are binary and PC differs after it
+    DIFFERENCE_OUTPUT,   // the program printed something else before it
+    DIFFERENCE_SHORTER,  // the actual trace ends before the step
+    DIFFERENCE_LONGER,   // the expected trace ends before the step
+    DIFFERENCE_MALFORMED,
+} DifferenceKind;
+
+typedef struct {
+    DifferenceKind kind;
+    unsigned long step;  // 0-based index of the first differing step
+    int has_pc;          // whether pc is known, i.e. a trace is binary
+    Address pc;          // address of that step's instruction
+    int reg;             // for DIFFERENCE_REGISTER
+    Word expected;
+    Word actual;
+    unsigned long line;  // for DIFFERENCE_MALFORMED in a text trace
+} TraceDifference;
+
+typedef struct TraceWriter TraceWriter;
+typedef struct TraceReader TraceReader;
+
+/* see trace.c */
+void trace_format(char *block, const Processor *processor);
+
+TraceWriter *trace_create(const char *path, const Processor *initial);
+void trace_step(TraceWriter *writer, const Processor *processor);
+void trace_output(void *writer, const char *text, size_t length);
+int trace_close(TraceWriter *writer);
+
+TraceReader *trace_open(const char *path);
+TraceRecord trace_next(TraceReader *reader);
+const Processor *trace_state(const TraceReader *reader);
+const char *trace_text(const TraceReader *reader, size_t *length);
+void trace_close_reader(TraceReader *reader);
+int trace_to_text(const char *path, FILE *output);
+
+/* see trace_compare.c */
+int trace_compare(const char *expected_path, const char *actual_path, unsigned long limit,
+                  TraceDifference *difference);
+
+#endif
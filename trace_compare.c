@@ -0,0 +1,480 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "types.h"
+#include "trace.h"
+
+/* Streaming comparison of two traces, each either the -r text or the
+ * binary form. Both are read a buffer at a time, so memory use does not
+ * depend on the trace length. Steps are compared as text blocks, or as
+ * register files when both traces are binary, and hex digits are only
+ * decoded where the traces differ. Program output between steps is
+ * compared through a running hash. */
+
+#define LINE_LENGTH (4 * 13) // one register row without its newline
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+typedef struct {
+    TraceReader *binary; // NULL for a text trace
+    int fd;
+    Processor state;     // kept by binary traces
+    char block[TRACE_TEXT_BLOCK]; // the step's text, kept by text traces
+    unsigned long long output_hash; // of the output since the last step
+    size_t start;                   // first unread byte in buffer
+    size_t end;
+    int eof;
+    unsigned long line_number;
+    char buffer[TRACE_BUFFER_SIZE];
+} TraceStream;
+
+typedef enum {
+    STREAM_END,
+    STREAM_STEP,
+    STREAM_MALFORMED,
+} StreamResult;
+
+static signed char hex_values[256];
+static pthread_once_t hex_values_once = PTHREAD_ONCE_INIT;
+
+static void hash_output(TraceStream *stream, const char *text, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < length; i++)
+    {
+        stream->output_hash = (stream->output_hash ^ (Byte)text[i]) * FNV_PRIME;
+    }
+}
+
+static void init_hex_values(void)
+{
+    int i;
+
+    memset(hex_values, -1, sizeof(hex_values));
+    for (i = 0; i < 10; i++)
+    {
+        hex_values['0' + i] = i;
+    }
+    for (i = 0; i < 6; i++)
+    {
+        hex_values['a' + i] = 10 + i;
+        hex_values['A' + i] = 10 + i;
+    }
+}
+
+static TraceStream *open_stream(const char *path)
+{
+    TraceStream *stream = calloc(1, sizeof(TraceStream));
+    char magic[4];
+
+    if (!stream)
+    {
+        return NULL;
+    }
+    stream->output_hash = FNV_OFFSET;
+    stream->fd = open(path, O_RDONLY);
+    if (stream->fd < 0)
+    {
+        free(stream);
+        return NULL;
+    }
+    if (read(stream->fd, magic, 4) == 4 && !memcmp(magic, TRACE_MAGIC, 4))
+    {
+        close(stream->fd);
+        stream->fd = -1;
+        stream->binary = trace_open(path);
+        if (!stream->binary)
+        {
+            free(stream);
+            return NULL;
+        }
+        stream->state = *trace_state(stream->binary);
+        return stream;
+    }
+    lseek(stream->fd, 0, SEEK_SET);
+    return stream;
+}
+
+static void close_stream(TraceStream *stream)
+{
+    if (stream->binary)
+    {
+        trace_close_reader(stream->binary);
+    }
+    else
+    {
+        close(stream->fd);
+    }
+    free(stream);
+}
+
+/* Returns the next line of a text trace without its newline, or NULL at
+ * the end. A line longer than the buffer comes back in pieces; newline is
+ * set to whether this piece ends one. */
+static const char *next_line(TraceStream *stream, size_t *length, int *newline)
+{
+    char *line, *found;
+    ssize_t got;
+
+    for (;;)
+    {
+        line = stream->buffer + stream->start;
+        found = memchr(line, '\n', stream->end - stream->start);
+        if (found || (stream->eof && stream->end > stream->start) ||
+            (stream->start == 0 && stream->end == TRACE_BUFFER_SIZE))
+        {
+            *length = found ? (size_t)(found - line) : stream->end - stream->start;
+            *newline = found != NULL;
+            stream->start += *length + *newline;
+            stream->line_number += *newline;
+            return line;
+        }
+        if (stream->eof)
+        {
+            return NULL;
+        }
+        memmove(stream->buffer, line, stream->end - stream->start);
+        stream->end -= stream->start;
+        stream->start = 0;
+        got = read(stream->fd, stream->buffer + stream->end, TRACE_BUFFER_SIZE - stream->end);
+        if (got <= 0)
+        {
+            stream->eof = 1;
+        }
+        else
+        {
+            stream->end += got;
+        }
+    }
+}
+
+/* Whether line has the shape of a row of four "r%2d=%08x " fields starting
+ * at register first. The hex digits are checked only when decoded. */
+static int is_row(const char *line, size_t length, int first)
+{
+    const char *field;
+    int i, number;
+
+    if (length != LINE_LENGTH)
+    {
+        return 0;
+    }
+    for (i = 0; i < 4; i++)
+    {
+        field = line + 13 * i;
+        number = first + i;
+        if (field[0] != 'r' || field[1] != (number < 10 ? ' ' : '0' + number / 10) ||
+            field[2] != '0' + number % 10 || field[3] != '=' || field[12] != ' ')
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Decodes the value of register number from a text block. Returns -1 if
+ * its digits are not hex. */
+static int block_register(const char *block, int number, Word *value)
+{
+    const char *digits = block + (number / 4) * (LINE_LENGTH + 1) + (number % 4) * 13 + 4;
+    int i, digit;
+
+    *value = 0;
+    for (i = 0; i < 8; i++)
+    {
+        digit = hex_values[(Byte)digits[i]];
+        if (digit < 0)
+        {
+            return -1;
+        }
+        *value = *value << 4 | digit;
+    }
+    return 0;
+}
+
+/* Reads up to the next register block and copies it to stream->block.
+ * Anything between blocks, including text ahead of "r 0=" on the block's
+ * first line, is program output. A block cut short at the end of the file
+ * counts as the end. */
+static StreamResult next_text_step(TraceStream *stream)
+{
+    const char *line, *first;
+    size_t length;
+    int newline, row = 0;
+
+    while ((line = next_line(stream, &length, &newline)))
+    {
+        if (row == 0)
+        {
+            first = newline && length >= LINE_LENGTH ? line + length - LINE_LENGTH : NULL;
+            if (first && is_row(first, LINE_LENGTH, 0))
+            {
+                hash_output(stream, line, first - line);
+                memcpy(stream->block, first, LINE_LENGTH + 1);
+                row = 1;
+            }
+            else
+            {
+                hash_output(stream, line, length + newline);
+            }
+        }
+        else if (row < 8)
+        {
+            if (!newline)
+            {
+                return STREAM_END;
+            }
+            if (!is_row(line, length, 4 * row))
+            {
+                return STREAM_MALFORMED;
+            }
+            memcpy(stream->block + row * (LINE_LENGTH + 1), line, LINE_LENGTH + 1);
+            row++;
+        }
+        else
+        {
+            stream->block[TRACE_TEXT_BLOCK - 1] = '\n';
+            return length == 0 ? STREAM_STEP : STREAM_MALFORMED;
+        }
+    }
+    stream->block[TRACE_TEXT_BLOCK - 1] = '\n';
+    return row == 8 ? STREAM_STEP : STREAM_END;
+}
+
+static StreamResult next_step(TraceStream *stream)
+{
+    TraceRecord record;
+    const char *text;
+    size_t length;
+
+    if (!stream->binary)
+    {
+        return next_text_step(stream);
+    }
+    while ((record = trace_next(stream->binary)) == TRACE_TEXT)
+    {
+        text = trace_text(stream->binary, &length);
+        hash_output(stream, text, length);
+    }
+    if (record == TRACE_STEP)
+    {
+        stream->state = *trace_state(stream->binary);
+        return STREAM_STEP;
+    }
+    return record == TRACE_END ? STREAM_END : STREAM_MALFORMED;
+}
+
+/* Index of the first register that differs between two register files, or
+ * -1 if all 32 agree. Whole files are compared a vector at a time and only
+ * a mismatch is looked at register by register. */
+static int first_difference(const Register *expected, const Register *actual)
+{
+    int i;
+
+#if defined(__AVX2__)
+    __m256i same = _mm256_set1_epi32(-1);
+
+    for (i = 0; i < 32; i += 8)
+    {
+        same = _mm256_and_si256(same, _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(expected + i)),
+                                                         _mm256_loadu_si256((const __m256i *)(actual + i))));
+    }
+    if (_mm256_movemask_epi8(same) == -1)
+    {
+        return -1;
+    }
+#elif defined(__SSE2__)
+    __m128i same = _mm_set1_epi32(-1);
+
+    for (i = 0; i < 32; i += 4)
+    {
+        same = _mm_and_si128(same, _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(expected + i)),
+                                                   _mm_loadu_si128((const __m128i *)(actual + i))));
+    }
+    if (_mm_movemask_epi8(same) == 0xFFFF)
+    {
+        return -1;
+    }
+#endif
+    for (i = 0; i < 32; i++)
+    {
+        if (expected[i] != actual[i])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Offset of the first byte that differs between two text blocks, or -1.
+ * Like first_difference(), a vector at a time. */
+static int block_difference(const char *expected, const char *actual)
+{
+    int i = 0;
+
+#if defined(__AVX2__)
+    unsigned mask;
+
+    for (; i + 32 <= TRACE_TEXT_BLOCK; i += 32)
+    {
+        mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(expected + i)),
+                                                      _mm256_loadu_si256((const __m256i *)(actual + i))));
+        if (mask != 0xFFFFFFFFu)
+        {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#elif defined(__SSE2__)
+    unsigned mask;
+
+    for (; i + 16 <= TRACE_TEXT_BLOCK; i += 16)
+    {
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(expected + i)),
+                                                _mm_loadu_si128((const __m128i *)(actual + i))));
+        if (mask != 0xFFFF)
+        {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#endif
+    for (; i < TRACE_TEXT_BLOCK; i++)
+    {
+        if (expected[i] != actual[i])
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Compares one step of two traces. Returns the first register that
+ * differs, -1 if none does and -2 if a text block does not decode. */
+static int compare_step(TraceStream *expected, TraceStream *actual, TraceDifference *difference)
+{
+    int offset, number;
+
+    if (expected->binary && actual->binary)
+    {
+        number = first_difference(expected->state.R, actual->state.R);
+        if (number >= 0)
+        {
+            difference->expected = expected->state.R[number];
+            difference->actual = actual->state.R[number];
+        }
+        return number;
+    }
+    if (expected->binary)
+    {
+        trace_format(expected->block, &expected->state);
+    }
+    if (actual->binary)
+    {
+        trace_format(actual->block, &actual->state);
+    }
+    offset = block_difference(expected->block, actual->block);
+    if (offset < 0)
+    {
+        return -1;
+    }
+    // only hex digits can differ between blocks that have the row shape
+    number = (offset / (LINE_LENGTH + 1)) * 4 + (offset % (LINE_LENGTH + 1)) / 13;
+    if (block_register(expected->block, number, &difference->expected) != 0 ||
+        block_register(actual->block, number, &difference->actual) != 0)
+    {
+        return -2;
+    }
+    return number;
+}
+
+/* Compares the traces at expected_path and actual_path step by step, at
+ * most limit steps (0 for all of them). Returns 0 if they agree, 1 with
+ * difference filled in at the first step where they do not, and -1 if a
+ * trace cannot be read or is malformed. */
+int trace_compare(const char *expected_path, const char *actual_path, unsigned long limit,
+                  TraceDifference *difference)
+{
+    TraceStream *expected = open_stream(expected_path);
+    TraceStream *actual = open_stream(actual_path);
+    StreamResult expected_result, actual_result;
+    int result = 0, index;
+
+    memset(difference, 0, sizeof(TraceDifference));
+    if (!expected || !actual)
+    {
+        if (expected)
+        {
+            close_stream(expected);
+        }
+        if (actual)
+        {
+            close_stream(actual);
+        }
+        return -1;
+    }
+    pthread_once(&hex_values_once, init_hex_values);
+    // a binary trace knows the PC of every step, a text trace does not
+    difference->has_pc = expected->binary || actual->binary;
+    for (; !limit || difference->step < limit; difference->step++)
+    {
+        difference->pc = expected->binary ? expected->state.PC : actual->state.PC;
+        expected_result = next_step(expected);
+        actual_result = next_step(actual);
+        if (expected_result == STREAM_MALFORMED || actual_result == STREAM_MALFORMED)
+        {
+            difference->line = expected_result == STREAM_MALFORMED ? expected->line_number
+                                                                    : actual->line_number;
+            difference->kind = DIFFERENCE_MALFORMED;
+            result = -1;
+            break;
+        }
+        if (expected_result != actual_result)
+        {
+            difference->kind = expected_result == STREAM_END ? DIFFERENCE_LONGER : DIFFERENCE_SHORTER;
+            result = 1;
+            break;
+        }
+        if (expected->output_hash != actual->output_hash)
+        {
+            difference->kind = DIFFERENCE_OUTPUT;
+            result = 1;
+            break;
+        }
+        if (expected_result == STREAM_END)
+        {
+            break;
+        }
+        index = compare_step(expected, actual, difference);
+        if (index == -2)
+        {
+            difference->kind = DIFFERENCE_MALFORMED;
+            result = -1;
+            break;
+        }
+        if (index >= 0)
+        {
+            difference->kind = DIFFERENCE_REGISTER;
+            difference->reg = index;
+            result = 1;
+            break;
+        }
+        if (expected->binary && actual->binary && expected->state.PC != actual->state.PC)
+        {
+            difference->kind = DIFFERENCE_PC;
+            difference->expected = expected->state.PC;
+            difference->actual = actual->state.PC;
+            result = 1;
+            break;
+        }
+        expected->output_hash = actual->output_hash = FNV_OFFSET;
+    }
+    close_stream(expected);
+    close_stream(actual);
+    return result;
+}
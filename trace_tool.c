@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "types.h"
+#include "trace.h"
+
+/* Turns a binary trace (see trace.h) back into the text -r prints, so the
+ * result can go to part2_tester.py or compare.py, or compares two traces
+ * of either form and reports the first step where they differ:
+ *
+ *   trace_tool program.rvt > program.trace
+ *   trace_tool -c [-n steps] expected actual
+ *
+ * Comparing exits with 0 when the traces agree, 1 when they differ and 2
+ * if one cannot be read. Build it with make trace_tool, which compiles the
+ * comparison for the host's vector width. */
+
+static const char *const names[] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1", "a0",
+    "a1", "a2", "a3", "a4", "a5", "a6", "a7", "s2", "s3", "s4", "s5",
+    "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+};
+
+static int compare(const char *expected, const char *actual, unsigned long limit)
+{
+    TraceDifference difference;
+    int result = trace_compare(expected, actual, limit, &difference);
+
+    if (result == 0)
+    {
+        printf("traces agree for %lu instructions\n", difference.step);
+        return 0;
+    }
+    if (result < 0 && difference.kind != DIFFERENCE_MALFORMED)
+    {
+        fprintf(stderr, "cannot read %s or %s\n", expected, actual);
+        return 2;
+    }
+    printf("first difference at instruction %lu", difference.step);
+    if (difference.has_pc)
+    {
+        printf(" (pc 0x%08x)", difference.pc);
+    }
+    printf(": ");
+    switch (difference.kind)
+    {
+    case DIFFERENCE_REGISTER:
+        printf("x%d (%s) is 0x%08x, expected 0x%08x\n", difference.reg, names[difference.reg],
+               difference.actual, difference.expected);
+        break;
+    case DIFFERENCE_PC:
+        printf("next pc is 0x%08x, expected 0x%08x\n", difference.actual, difference.expected);
+        break;
+    case DIFFERENCE_OUTPUT:
+        printf("program output differs\n");
+        break;
+    case DIFFERENCE_SHORTER:
+        printf("%s ends, %s continues\n", actual, expected);
+        break;
+    case DIFFERENCE_LONGER:
+        printf("%s ends, %s continues\n", expected, actual);
+        break;
+    case DIFFERENCE_MALFORMED:
+        printf("malformed trace");
+        if (difference.line)
+        {
+            printf(" near line %lu", difference.line);
+        }
+        printf("\n");
+        return 2;
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    static char buffer[1 << 20];
+    unsigned long limit = 0;
+    int option, comparing = 0;
+
+    while ((option = getopt(argc, argv, "cn:")) != -1)
+    {
+        switch (option)
+        {
+        case 'c':
+            comparing = 1;
+            break;
+        case 'n':
+            limit = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            optind = argc + 1;
+            break;
+        }
+    }
+    if (argc - optind != (comparing ? 2 : 1))
+    {
+        fprintf(stderr, "usage: %s trace\n       %s -c [-n steps] expected actual\n", argv[0], argv[0]);
+        return 2;
+    }
+    if (comparing)
+    {
+        return compare(argv[optind], argv[optind + 1], limit);
+    }
+    setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
+    if (trace_to_text(argv[optind], stdout) != 0)
+    {
+        fprintf(stderr, "%s: not a readable trace\n", argv[optind]);
+        return 2;
+    }
+    return 0;
+}
@@ -3,7 +3,7 @@
 #define RTYPE_FORMAT "%s\tx%d, x%d, x%d\n"
 #define ITYPE_FORMAT "%s\tx%d, x%d, %d\n"
 #define MEM_FORMAT "%s\tx%d, %d(x%d)\n"
-#define LUI_FORMAT "lui\tx%d, %d\n"
+#define UTYPE_FORMAT "%s\tx%d, %d\n"
 #define JAL_FORMAT "jal\tx%d, %d\n"
 #define BRANCH_FORMAT "%s\tx%d, x%d, %d\n"
 #define ECALL_FORMAT "ecall\n"